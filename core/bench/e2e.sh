@@ -0,0 +1,139 @@
+#!/bin/sh
+#
+#  Measures what the module costs real listings: large directories and
+#  deep trees are built on a fresh tmpfs and listed with the module
+#  unloaded, loaded with nothing hidden, and loaded with a share of the
+#  files hidden. Results go out as a single JSON document.
+#
+#  It loads and unloads the module, so it needs root and is meant for a
+#  throwaway machine, e.g. a QEMU guest running the kernel humble.ko was
+#  built against, with the source tree shared in:
+#
+#    qemu-system-x86_64 -enable-kvm -m 16G -smp 4 -kernel bzImage ... \
+#        -virtfs local,path=core,mount_tag=core,security_model=none
+#
+#  and inside the guest
+#
+#    mount -t 9p -o trans=virtio core /mnt && make -C /mnt/bench e2e
+#
+#  10M files take about 10 GB of guest memory, pass smaller sizes with -s
+#  otherwise.
+#
+
+set -e
+
+usage() {
+    echo "usage: $0 [-k humble.ko] [-o output.json] [-s \"entries...\"]" >&2
+    echo "       [-t \"depth:fanout:entries...\"] [-r \"ratios...\"]" >&2
+    echo "       [-i iterations] [-n samples]" >&2
+    exit 2
+}
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+BIN="$HERE/humble-e2e"
+KO="$HERE/../humble.ko"
+OUTPUT=e2e.json
+SIZES="10000 100000 1000000 10000000"
+TREES="8:4:1000000 3:100:1000000"
+RATIOS="0.01 0.1 0.5"
+ITERATIONS=5
+SAMPLES=10000
+
+while getopts k:o:s:t:r:i:n: opt; do
+    case $opt in
+    k) KO=$OPTARG ;;
+    o) OUTPUT=$OPTARG ;;
+    s) SIZES=$OPTARG ;;
+    t) TREES=$OPTARG ;;
+    r) RATIOS=$OPTARG ;;
+    i) ITERATIONS=$OPTARG ;;
+    n) SAMPLES=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+
+[ "$(id -u)" = 0 ] || { echo "$0: has to run as root" >&2; exit 1; }
+[ -x "$BIN" ] || { echo "$0: build $BIN first" >&2; exit 1; }
+[ -f "$KO" ] || { echo "$0: no module at $KO" >&2; exit 1; }
+
+WORK=$(mktemp -d /tmp/humble-e2e.XXXXXX)
+RUNS="$WORK.runs"
+
+unload() {
+    if grep -qs '^humble ' /proc/modules; then
+        rmmod humble
+    fi
+}
+
+load() {
+    unload
+    insmod "$KO"
+    # The device node is made by udev
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        [ -c /dev/hcontrol ] && return
+        sleep 0.5
+    done
+    echo "$0: /dev/hcontrol did not show up" >&2
+    exit 1
+}
+
+cleanup() {
+    unload || true
+    umount "$WORK" 2>/dev/null || true
+    rmdir "$WORK"
+    rm -f "$RUNS"
+}
+trap cleanup EXIT
+
+# nr_inodes=0 lifts the limit on the number of files
+mount -t tmpfs -o size=90%,nr_inodes=0 humble-e2e "$WORK"
+: > "$RUNS"
+
+measure() {
+    [ -s "$RUNS" ] && echo "," >> "$RUNS"
+    "$BIN" measure -i "$ITERATIONS" -s "$SAMPLES" "$@" >> "$RUNS"
+}
+
+# layout <options>: runs the three states over one layout
+layout() {
+    dir="$WORK/dir"
+    first=${RATIOS%% *}
+    echo "layout $*" >&2
+
+    unload
+    "$BIN" create "$@" "$dir"
+    measure "$@" -r "$first" -m unloaded "$dir"
+
+    load
+    measure "$@" -r "$first" -m loaded "$dir"
+
+    for ratio in $RATIOS; do
+        "$BIN" hide "$@" -r "$ratio" "$dir"
+        measure "$@" -r "$ratio" -m hidden "$dir"
+        "$BIN" clear
+    done
+
+    unload
+    rm -rf "$dir"
+}
+
+for entries in $SIZES; do
+    layout -n "$entries"
+done
+for tree in $TREES; do
+    depth=${tree%%:*}
+    rest=${tree#*:}
+    layout -n "${rest#*:}" -d "$depth" -w "${rest%%:*}"
+done
+
+{
+    echo "{"
+    echo "\"kernel\": \"$(uname -r)\","
+    echo "\"cpus\": $(nproc),"
+    echo "\"module\": \"$KO\","
+    echo "\"runs\": ["
+    cat "$RUNS"
+    echo "]"
+    echo "}"
+} > "$OUTPUT"
+echo "results written to $OUTPUT" >&2
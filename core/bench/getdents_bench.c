@@ -0,0 +1,574 @@
+/*
+ *  End-to-end cost of hiding, measured through the real system calls on a
+ *  real file system. See e2e.sh, which runs this in the three interesting
+ *  states of the machine and collects the results.
+ *
+ *    humble-e2e create  [-n entries] [-d depth -w fanout] DIR
+ *    humble-e2e hide    [-n entries] [-d depth -w fanout] [-r ratio] DIR
+ *    humble-e2e clear
+ *    humble-e2e measure [-n entries] [-d depth -w fanout] [-r ratio]
+ *                       [-i iterations] [-s samples] [-m mode] DIR
+ *
+ *  The layout is derived from the options alone, so every command has to
+ *  be given the same ones: @entries files spread round robin over the
+ *  leaves of a tree @depth levels deep with @fanout subdirectories each
+ *  (depth 0 puts them all right into DIR). The files whose share of
+ *  @ratio adds up to a whole one are the hidden ones.
+ *
+ *  measure prints a single JSON object.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define CONTROL_DEVICE "/dev/hcontrol"
+#define GETDENTS_BUFFER_SIZE (64 * 1024)
+/* The module takes at most 4096 bytes of commands a write */
+#define COMMAND_BATCH_SIZE 4096
+
+struct linux_dirent64 {
+	unsigned long long d_ino;
+	long long          d_off;
+	unsigned short     d_reclen;
+	unsigned char      d_type;
+	char               d_name[];
+};
+
+struct layout {
+	char   root[PATH_MAX];
+	long   entries;
+	int    depth;
+	int    fanout;
+	long   leaves;
+	double ratio;
+};
+
+struct latency {
+	long count;
+	long failed;
+	long long *ns;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int is_hidden(const struct layout *l, long i)
+{
+	return (long) ((i + 1) * l->ratio) != (long) (i * l->ratio);
+}
+
+/* Path of the leaf directory number @leaf, relative to the root */
+static int leaf_path(const struct layout *l, long leaf, char *buf, size_t size)
+{
+	int level, len = 0;
+	long divisor = l->leaves;
+
+	buf[0] = '\0';
+	for (level = 0; level < l->depth; ++level) {
+		divisor /= l->fanout;
+		len += snprintf(buf + len, size - len, "/d%03d",
+		                (int) (leaf / divisor % l->fanout));
+	}
+	return len;
+}
+
+static void file_path(const struct layout *l, long i, char *buf, size_t size)
+{
+	int len = snprintf(buf, size, "%s", l->root);
+	len += leaf_path(l, i % l->leaves, buf + len, size - len);
+	snprintf(buf + len, size - len, "/f%010ld", i);
+}
+
+/*
+ *  create
+ */
+
+static int make_tree(const struct layout *l)
+{
+	long leaf;
+	int level, len;
+	char path[PATH_MAX];
+
+	for (leaf = 0; leaf < l->leaves; ++leaf) {
+		len = snprintf(path, sizeof(path), "%s", l->root);
+		leaf_path(l, leaf, path + len, sizeof(path) - len);
+		/* Create every level which is new for this leaf */
+		for (level = 0; level < l->depth; ++level) {
+			char *cut = path + len + 5 * (level + 1);
+			char saved = *cut;
+			*cut = '\0';
+			if (mkdir(path, 0755) && errno != EEXIST) {
+				perror(path);
+				return -1;
+			}
+			*cut = saved;
+		}
+	}
+	return 0;
+}
+
+static int create(const struct layout *l)
+{
+	long i;
+	int fd;
+	char path[PATH_MAX];
+	double start = now();
+
+	if (mkdir(l->root, 0755) && errno != EEXIST) {
+		perror(l->root);
+		return -1;
+	}
+	if (make_tree(l)) {
+		return -1;
+	}
+	for (i = 0; i < l->entries; ++i) {
+		file_path(l, i, path, sizeof(path));
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+		close(fd);
+	}
+	fprintf(stderr, "created %ld files in %ld directories in %.1f s\n",
+	        l->entries, l->leaves, now() - start);
+	return 0;
+}
+
+/*
+ *  hide and clear, through the module's control device
+ */
+
+/* Reads the replies queued so far, counts them and the failed ones */
+static int drain(int fd, long *replies, long *failed, int *line_start)
+{
+	char buf[4096];
+	ssize_t n, k;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (k = 0; k < n; ++k) {
+			if (*line_start && buf[k] == 'E') {
+				++*failed;
+			}
+			*line_start = (buf[k] == '\n');
+			if (*line_start) {
+				++*replies;
+			}
+		}
+	}
+	return n < 0 ? -1 : 0;
+}
+
+/* Sends the batch, as much as the device takes at a time */
+static int send_batch(int fd, const char *batch, size_t len,
+                      long *replies, long *failed, int *line_start)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, batch, len);
+		if (n < 0 && errno != EAGAIN) {
+			return -1;
+		}
+		if (n > 0) {
+			batch += n;
+			len -= n;
+		}
+		if (drain(fd, replies, failed, line_start)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int hide(const struct layout *l)
+{
+	long i, commands = 0, replies = 0, failed = 0;
+	int fd, line_start = 1;
+	size_t len = 0;
+	char batch[COMMAND_BATCH_SIZE];
+	char path[PATH_MAX];
+	double start = now();
+
+	fd = open(CONTROL_DEVICE, O_RDWR);
+	if (fd < 0) {
+		perror(CONTROL_DEVICE);
+		return -1;
+	}
+	for (i = 0; i < l->entries; ++i) {
+		if (!is_hidden(l, i)) {
+			continue;
+		}
+		file_path(l, i, path, sizeof(path));
+		if (len + strlen(path) + 3 > sizeof(batch)) {
+			if (send_batch(fd, batch, len, &replies, &failed, &line_start)) {
+				goto io_error;
+			}
+			len = 0;
+		}
+		len += snprintf(batch + len, sizeof(batch) - len, "H %s\n", path);
+		++commands;
+	}
+	if (send_batch(fd, batch, len, &replies, &failed, &line_start)) {
+		goto io_error;
+	}
+	while (replies < commands) {
+		if (drain(fd, &replies, &failed, &line_start)) {
+			goto io_error;
+		}
+	}
+	close(fd);
+
+	fprintf(stderr, "hidden %ld files in %.1f s, %ld failed\n",
+	        commands - failed, now() - start, failed);
+	return failed ? -1 : 0;
+
+io_error:
+	perror(CONTROL_DEVICE);
+	close(fd);
+	return -1;
+}
+
+static int clear(void)
+{
+	long replies = 0, failed = 0;
+	int line_start = 1;
+	int fd = open(CONTROL_DEVICE, O_RDWR);
+
+	if (fd < 0) {
+		perror(CONTROL_DEVICE);
+		return -1;
+	}
+	if (send_batch(fd, "C\n", 2, &replies, &failed, &line_start)) {
+		perror(CONTROL_DEVICE);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return failed ? -1 : 0;
+}
+
+/*
+ *  measure
+ */
+
+struct walk_stats {
+	long calls;
+	long entries;
+	long long bytes;
+};
+
+/* Lists the whole tree with raw getdents64(), depth first */
+static int walk(const char *root, struct walk_stats *stats)
+{
+	static char buf[GETDENTS_BUFFER_SIZE];
+	char **stack;
+	int top = 0, capacity = 1024;
+	int fd;
+	long n, pos;
+
+	stack = malloc(capacity * sizeof(*stack));
+	stack[top++] = strdup(root);
+	while (top > 0) {
+		char *dir = stack[--top];
+		fd = open(dir, O_RDONLY | O_DIRECTORY);
+		if (fd < 0) {
+			perror(dir);
+			return -1;
+		}
+		while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+			++stats->calls;
+			stats->bytes += n;
+			for (pos = 0; pos < n;) {
+				struct linux_dirent64 *d = (void *) (buf + pos);
+				pos += d->d_reclen;
+				if (d->d_name[0] == '.' && (d->d_name[1] == '\0' ||
+				    (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+				{
+					continue;
+				}
+				++stats->entries;
+				if (d->d_type == DT_DIR) {
+					if (top == capacity) {
+						capacity *= 2;
+						stack = realloc(stack, capacity * sizeof(*stack));
+					}
+					stack[top] = malloc(strlen(dir) + strlen(d->d_name) + 2);
+					sprintf(stack[top++], "%s/%s", dir, d->d_name);
+				}
+			}
+		}
+		++stats->calls;
+		close(fd);
+		free(dir);
+		if (n < 0) {
+			perror("getdents64");
+			return -1;
+		}
+	}
+	free(stack);
+	return 0;
+}
+
+/* Runs the command with its output thrown away, in seconds */
+static double run_command(char *const argv[])
+{
+	int status;
+	double start = now();
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "%s failed\n", argv[0]);
+		return -1;
+	}
+	return now() - start;
+}
+
+static double best_of(char *const argv[], int iterations)
+{
+	int i;
+	double t, best = -1;
+	for (i = 0; i < iterations; ++i) {
+		t = run_command(argv);
+		if (t < 0) {
+			return -1;
+		}
+		if (best < 0 || t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return (x > y) - (x < y);
+}
+
+static void print_latency(const char *name, struct latency *lat)
+{
+	long long *ns = lat->ns;
+	long n = lat->count;
+
+	qsort(ns, n, sizeof(*ns), compare_ns);
+	printf("  \"%s\": {\"samples\": %ld, \"failed\": %ld, "
+	       "\"p50_ns\": %lld, \"p90_ns\": %lld, \"p99_ns\": %lld, "
+	       "\"max_ns\": %lld}",
+	       name, n, lat->failed,
+	       n ? ns[n / 2] : 0, n ? ns[n * 9 / 10] : 0,
+	       n ? ns[n * 99 / 100] : 0, n ? ns[n - 1] : 0);
+}
+
+/*
+ *  Times stat() and open() of @samples names spread over the hidden share,
+ *  or over all files when nothing is to be hidden. Whether they succeed
+ *  depends on the state of the module, failures are only counted.
+ */
+static void sample_names(const struct layout *l, long samples,
+                         struct latency *st, struct latency *op)
+{
+	long i, picked = 0, share = 0, step;
+	int fd;
+	long long t;
+	struct stat sb;
+	char path[PATH_MAX];
+	int all = (l->ratio == 0);
+
+	for (i = 0; i < l->entries; ++i) {
+		share += all || is_hidden(l, i);
+	}
+	if (samples > share) {
+		samples = share;
+	}
+	step = samples ? share / samples : 1;
+	st->ns = calloc((size_t) samples + 1, sizeof(long long));
+	op->ns = calloc((size_t) samples + 1, sizeof(long long));
+
+	for (i = 0, share = 0; i < l->entries && picked < samples; ++i) {
+		if (!all && !is_hidden(l, i)) {
+			continue;
+		}
+		if (share++ % step != 0) {
+			continue;
+		}
+		file_path(l, i, path, sizeof(path));
+
+		t = now_ns();
+		if (stat(path, &sb)) {
+			++st->failed;
+		}
+		st->ns[picked] = now_ns() - t;
+
+		t = now_ns();
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			close(fd);
+		} else {
+			++op->failed;
+		}
+		op->ns[picked] = now_ns() - t;
+		++picked;
+	}
+	st->count = op->count = picked;
+}
+
+static int measure(const struct layout *l, int iterations, long samples,
+                   const char *mode)
+{
+	int i;
+	double start, elapsed, find_s, ls_s;
+	struct walk_stats ws, first = { 0, 0, 0 };
+	struct latency st = { 0, 0, NULL }, op = { 0, 0, NULL };
+	char *find_argv[] = { "find", (char *) l->root, NULL };
+	char *ls_argv[] = { "ls", l->depth ? "-fR" : "-f", (char *) l->root, NULL };
+	long directories = 1, level_dirs = 1;
+
+	for (i = 0; i < l->depth; ++i) {
+		level_dirs *= l->fanout;
+		directories += level_dirs;
+	}
+
+	/* A cold pass first, it also tells what a listing returns */
+	if (walk(l->root, &first)) {
+		return -1;
+	}
+	memset(&ws, 0, sizeof(ws));
+	start = now();
+	for (i = 0; i < iterations; ++i) {
+		if (walk(l->root, &ws)) {
+			return -1;
+		}
+	}
+	elapsed = now() - start;
+
+	find_s = best_of(find_argv, iterations);
+	ls_s = best_of(ls_argv, iterations);
+	if (find_s < 0 || ls_s < 0) {
+		return -1;
+	}
+	sample_names(l, samples, &st, &op);
+
+	printf("{\n");
+	printf("  \"mode\": \"%s\",\n", mode);
+	printf("  \"entries\": %ld,\n", l->entries);
+	printf("  \"depth\": %d,\n", l->depth);
+	printf("  \"fanout\": %d,\n", l->fanout);
+	printf("  \"directories\": %ld,\n", directories);
+	printf("  \"ratio\": %g,\n", l->ratio);
+	printf("  \"listed\": %ld,\n", first.entries);
+	printf("  \"iterations\": %d,\n", iterations);
+	printf("  \"getdents64\": {\"calls\": %ld, \"seconds\": %.6f, "
+	       "\"ns_per_entry\": %.1f, \"entries_per_s\": %.0f, "
+	       "\"mib_per_s\": %.1f},\n",
+	       ws.calls / iterations, elapsed / iterations,
+	       elapsed * 1e9 / ws.entries, ws.entries / elapsed,
+	       ws.bytes / elapsed / (1024 * 1024));
+	printf("  \"find_ms\": %.3f,\n", find_s * 1e3);
+	printf("  \"ls_ms\": %.3f,\n", ls_s * 1e3);
+	print_latency("stat", &st);
+	printf(",\n");
+	print_latency("open", &op);
+	printf("\n}\n");
+
+	free(st.ns);
+	free(op.ns);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	        "usage: %s create|hide|clear|measure [-n entries]\n"
+	        "       [-d depth] [-w fanout] [-r hidden ratio]\n"
+	        "       [-i iterations] [-s samples] [-m mode] DIR\n", name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, level;
+	int iterations = 5;
+	long samples = 10000;
+	const char *mode = "unknown";
+	const char *command;
+	struct layout l = { "", 100000, 0, 16, 1, 0.1 };
+
+	if (argc < 2) {
+		usage(argv[0]);
+	}
+	command = argv[1];
+	optind = 2;
+	while ((opt = getopt(argc, argv, "n:d:w:r:i:s:m:")) != -1) {
+		switch (opt) {
+		case 'n': l.entries = atol(optarg);  break;
+		case 'd': l.depth = atoi(optarg);    break;
+		case 'w': l.fanout = atoi(optarg);   break;
+		case 'r': l.ratio = atof(optarg);    break;
+		case 'i': iterations = atoi(optarg); break;
+		case 's': samples = atol(optarg);    break;
+		case 'm': mode = optarg;             break;
+		default:  usage(argv[0]);
+		}
+	}
+	if (l.entries <= 0 || l.depth < 0 || l.depth > 16 ||
+	    l.fanout <= 0 || l.fanout > 1000 || l.ratio < 0 || l.ratio > 1 ||
+	    iterations <= 0 || samples < 0)
+	{
+		usage(argv[0]);
+	}
+	for (level = 0; level < l.depth; ++level) {
+		l.leaves *= l.fanout;
+	}
+
+	if (strcmp(command, "clear") == 0) {
+		return clear() ? 1 : 0;
+	}
+	if (optind != argc - 1 || argv[optind][0] != '/') {
+		fprintf(stderr, "DIR has to be an absolute path\n");
+		usage(argv[0]);
+	}
+	snprintf(l.root, sizeof(l.root), "%s", argv[optind]);
+
+	if (strcmp(command, "create") == 0) {
+		return create(&l) ? 1 : 0;
+	}
+	if (strcmp(command, "hide") == 0) {
+		return hide(&l) ? 1 : 0;
+	}
+	if (strcmp(command, "measure") == 0) {
+		return measure(&l, iterations, samples, mode) ? 1 : 0;
+	}
+	usage(argv[0]);
+	return 2;
+}
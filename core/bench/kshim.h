@@ -0,0 +1,568 @@
+#ifndef HUMBLE_KSHIM_H__
+#define HUMBLE_KSHIM_H__
+
+/*
+ *  Just enough of the kernel API to build the hashtable, the filtering
+ *  code and the selftest of the module as an ordinary program. It is forced into every
+ *  translation unit with -include, the <linux/...> headers the module asks
+ *  for are empty files generated by the Makefile.
+ *
+ *  Locks, lists and threads behave like the real ones, everything the tests
+ *  never reaches (path walking, exportfs, workqueues) is a stub that fails
+ *  or does nothing.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef unsigned long long u64;
+typedef long long          s64;
+typedef uint32_t u32;
+typedef unsigned short umode_t;
+
+#define __user
+
+#define container_of(ptr, type, member) \
+        ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#define min_t(type, a, b) ((type) (a) < (type) (b) ? (type) (a) : (type) (b))
+
+/* Logging */
+
+#define KERN_CRIT    ""
+#define KERN_ERR     ""
+#define KERN_WARNING ""
+#define KERN_NOTICE  ""
+#define KERN_INFO    ""
+#define KERN_DEBUG   ""
+
+static inline int printk(const char *fmt, ...)
+{
+	int res;
+	va_list args;
+	va_start(args, fmt);
+	res = vprintf(fmt, args);
+	va_end(args);
+	return res;
+}
+
+/* Memory */
+
+#define GFP_KERNEL 0
+
+static inline void *kmalloc(size_t size, int flags)
+{
+	return malloc(size);
+}
+
+static inline void kfree(const void *ptr)
+{
+	free((void *) ptr);
+}
+
+static inline char *kstrndup(const char *s, size_t max, int flags)
+{
+	return strndup(s, max);
+}
+
+static inline void *vmalloc(unsigned long size)
+{
+	return malloc(size);
+}
+
+static inline void *vzalloc(unsigned long size)
+{
+	return calloc(1, size);
+}
+
+static inline void vfree(const void *ptr)
+{
+	free((void *) ptr);
+}
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *) error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long) ptr;
+}
+
+static inline int IS_ERR(const void *ptr)
+{
+	return (unsigned long) ptr >= (unsigned long) -4095;
+}
+
+static inline int IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+static inline void sort(void *base, size_t num, size_t size,
+                        int (*cmp)(const void *, const void *),
+                        void (*swap)(void *, void *, int))
+{
+	qsort(base, num, size, cmp);
+}
+
+typedef struct {
+	volatile int counter;
+} atomic_t;
+
+static inline void atomic_set(atomic_t *v, int i)
+{
+	v->counter = i;
+}
+
+/* Lists */
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+	entry->next = head->next;
+	entry->prev = head;
+	head->next->prev = entry;
+	head->next = entry;
+}
+
+static inline void list_add_tail(struct list_head *entry,
+                                 struct list_head *head)
+{
+	entry->next = head;
+	entry->prev = head->prev;
+	head->prev->next = entry;
+	head->prev = entry;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->next = entry->prev = NULL;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_for_each(pos, head) \
+        for (pos = (head)->next; pos != (head); pos = pos->next)
+#define list_for_each_safe(pos, n, head) \
+        for (pos = (head)->next, n = pos->next; pos != (head); \
+             pos = n, n = pos->next)
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+#define HLIST_HEAD_INIT { .first = NULL }
+
+static inline void INIT_HLIST_HEAD(struct hlist_head *head)
+{
+	head->first = NULL;
+}
+
+static inline void INIT_HLIST_NODE(struct hlist_node *node)
+{
+	node->next = NULL;
+	node->pprev = NULL;
+}
+
+static inline int hlist_unhashed(const struct hlist_node *node)
+{
+	return !node->pprev;
+}
+
+static inline int hlist_empty(const struct hlist_head *head)
+{
+	return !head->first;
+}
+
+static inline void hlist_add_head(struct hlist_node *node,
+                                  struct hlist_head *head)
+{
+	node->next = head->first;
+	if (head->first) {
+		head->first->pprev = &node->next;
+	}
+	head->first = node;
+	node->pprev = &head->first;
+}
+
+static inline void hlist_del(struct hlist_node *node)
+{
+	*node->pprev = node->next;
+	if (node->next) {
+		node->next->pprev = node->pprev;
+	}
+	INIT_HLIST_NODE(node);
+}
+
+#define hlist_entry(ptr, type, member) container_of(ptr, type, member)
+#define hlist_for_each(pos, head) \
+        for (pos = (head)->first; pos; pos = pos->next)
+#define hlist_for_each_safe(pos, n, head) \
+        for (pos = (head)->first; pos && ((n = pos->next), 1); pos = n)
+
+/* Hashing */
+
+static inline u64 hash_64(u64 val, unsigned int bits)
+{
+	return (val * 0x61C8864680B583EBull) >> (64 - bits);
+}
+
+static inline unsigned int full_name_hash(const char *name, unsigned int len)
+{
+	unsigned long hash = 0;
+	while (len--) {
+		unsigned long c = (unsigned char) *name++;
+		hash = (hash + (c << 4) + (c >> 4)) * 11;
+	}
+	return (unsigned int) hash;
+}
+
+/* Locking */
+
+typedef struct {
+	int unused;
+} spinlock_t;
+
+static inline void spin_lock(spinlock_t *lock) {}
+static inline void spin_unlock(spinlock_t *lock) {}
+
+struct rw_semaphore {
+	pthread_rwlock_t lock;
+};
+
+#define DECLARE_RWSEM(name) \
+        struct rw_semaphore name = { PTHREAD_RWLOCK_INITIALIZER }
+
+static inline void down_read(struct rw_semaphore *sem)
+{
+	pthread_rwlock_rdlock(&sem->lock);
+}
+
+static inline void up_read(struct rw_semaphore *sem)
+{
+	pthread_rwlock_unlock(&sem->lock);
+}
+
+static inline void down_write(struct rw_semaphore *sem)
+{
+	pthread_rwlock_wrlock(&sem->lock);
+}
+
+static inline void up_write(struct rw_semaphore *sem)
+{
+	pthread_rwlock_unlock(&sem->lock);
+}
+
+/* Threads, kthreads are plain detached threads */
+
+struct task_struct;
+
+struct shim_kthread {
+	int  (*fn)(void *);
+	void *data;
+};
+
+static inline void *shim_kthread_main(void *arg)
+{
+	struct shim_kthread kt = *(struct shim_kthread *) arg;
+	free(arg);
+	kt.fn(kt.data);
+	return NULL;
+}
+
+static inline struct task_struct *shim_kthread_run(int (*fn)(void *),
+                                                   void *data)
+{
+	pthread_t thread;
+	struct shim_kthread *kt = malloc(sizeof(*kt));
+	kt->fn = fn;
+	kt->data = data;
+	if (pthread_create(&thread, NULL, shim_kthread_main, kt)) {
+		free(kt);
+		return ERR_PTR(-EAGAIN);
+	}
+	pthread_detach(thread);
+	return (struct task_struct *) kt;
+}
+
+#define kthread_run(fn, data, namefmt, ...) shim_kthread_run(fn, data)
+
+static inline void cond_resched(void)
+{
+	sched_yield();
+}
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	int             done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done += 1;
+	pthread_cond_signal(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline void wait_for_completion(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	while (x->done == 0) {
+		pthread_cond_wait(&x->cond, &x->lock);
+	}
+	x->done -= 1;
+	pthread_mutex_unlock(&x->lock);
+}
+
+/* Time and deferred work, timed hides never expire here */
+
+#define HZ 100
+
+static inline u64 get_jiffies_64(void)
+{
+	return 0;
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+struct work_struct {
+	void (*func)(struct work_struct *work);
+};
+
+struct delayed_work {
+	struct work_struct work;
+};
+
+#define DECLARE_DELAYED_WORK(name, fn) \
+        struct delayed_work name = { { (fn) } }
+
+static inline int schedule_delayed_work(struct delayed_work *work,
+                                        unsigned long delay)
+{
+	return 1;
+}
+
+static inline int cancel_delayed_work_sync(struct delayed_work *work)
+{
+	return 0;
+}
+
+typedef s64 ktime_t;
+
+static inline ktime_t ktime_get(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline s64 ktime_to_ns(ktime_t kt)
+{
+	return kt;
+}
+
+/* VFS */
+
+struct module;
+#define THIS_MODULE ((struct module *) NULL)
+
+struct file;
+struct dentry;
+struct inode;
+struct vfsmount;
+struct vm_area_struct;
+struct kstat;
+struct nameidata;
+struct iattr;
+struct fid;
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+
+typedef int (*filldir_t)(void *, const char *, int, loff_t, u64, unsigned);
+
+struct file_operations {
+	struct module *owner;
+	ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+	ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+	int (*readdir)(struct file *, void *, filldir_t);
+	int (*mmap)(struct file *, struct vm_area_struct *);
+	int (*open)(struct inode *, struct file *);
+	int (*release)(struct inode *, struct file *);
+};
+
+struct inode_operations {
+	struct dentry *(*lookup)(struct inode *, struct dentry *, unsigned int);
+	void *(*follow_link)(struct dentry *, struct nameidata *);
+	int (*readlink)(struct dentry *, char __user *, int);
+	void (*put_link)(struct dentry *, struct nameidata *, void *);
+	int (*create)(struct inode *, struct dentry *, umode_t, bool);
+	int (*link)(struct dentry *, struct inode *, struct dentry *);
+	int (*unlink)(struct inode *, struct dentry *);
+	int (*symlink)(struct inode *, struct dentry *, const char *);
+	int (*mkdir)(struct inode *, struct dentry *, umode_t);
+	int (*rmdir)(struct inode *, struct dentry *);
+	int (*mknod)(struct inode *, struct dentry *, umode_t, dev_t);
+	int (*rename)(struct inode *, struct dentry *,
+	              struct inode *, struct dentry *);
+	int (*setattr)(struct dentry *, struct iattr *);
+	int (*getattr)(struct vfsmount *, struct dentry *, struct kstat *);
+	int (*setxattr)(struct dentry *, const char *, const void *, size_t, int);
+	ssize_t (*getxattr)(struct dentry *, const char *, void *, size_t);
+	ssize_t (*listxattr)(struct dentry *, char *, size_t);
+	int (*removexattr)(struct dentry *, const char *);
+};
+
+struct super_block {
+	struct dentry *s_root;
+};
+
+struct inode {
+	unsigned long                  i_ino;
+	umode_t                        i_mode;
+	unsigned int                   i_nlink;
+	atomic_t                       i_count;
+	struct inode_operations        *i_op;
+	struct file_operations         *i_fop;
+	struct super_block             *i_sb;
+	void                           *i_private;
+};
+
+struct qstr {
+	unsigned int        len;
+	const unsigned char *name;
+};
+
+struct dentry {
+	unsigned int       d_flags;
+	spinlock_t         d_lock;
+	struct qstr        d_name;
+	struct inode       *d_inode;
+	struct dentry      *d_parent;
+	struct super_block *d_sb;
+};
+
+#define DCACHE_DISCONNECTED 0x0020
+#define IS_ROOT(x) ((x) == (x)->d_parent)
+
+struct path {
+	struct vfsmount *mnt;
+	struct dentry   *dentry;
+};
+
+struct file {
+	struct path                  f_path;
+	struct file_operations       *f_op;
+	void                         *private_data;
+};
+#define f_dentry f_path.dentry
+
+struct file_handle {
+	unsigned int  handle_bytes;
+	int           handle_type;
+	unsigned char f_handle[0];
+};
+
+#define LOOKUP_DIRECTORY    0x0002
+#define CAP_DAC_READ_SEARCH 2
+
+static inline void inode_init_once(struct inode *inode)
+{
+	memset(inode, 0, sizeof(*inode));
+}
+
+static inline void ihold(struct inode *inode) {}
+static inline void iput(struct inode *inode) {}
+
+static inline struct dentry *dget_parent(struct dentry *dentry)
+{
+	return dentry->d_parent;
+}
+
+static inline void dput(struct dentry *dentry) {}
+
+static inline struct file_operations *fops_get(struct file_operations *fops)
+{
+	return fops;
+}
+
+static inline void fops_put(struct file_operations *fops) {}
+
+static inline int kern_path(const char *name, unsigned int flags,
+                            struct path *path)
+{
+	return -ENOENT;
+}
+
+static inline void path_put(const struct path *path) {}
+
+static inline struct file *fget(unsigned int fd)
+{
+	return NULL;
+}
+
+static inline void fput(struct file *file) {}
+
+static inline int capable(int cap)
+{
+	return 0;
+}
+
+static inline struct dentry *
+exportfs_decode_fh(struct vfsmount *mnt, struct fid *fid, int fh_len,
+                   int fileid_type,
+                   int (*acceptable)(void *, struct dentry *), void *context)
+{
+	return ERR_PTR(-ESTALE);
+}
+
+static inline void generic_fillattr(struct inode *inode, struct kstat *stat) {}
+
+static inline int simple_setattr(struct dentry *dentry, struct iattr *attrs)
+{
+	return 0;
+}
+
+#endif
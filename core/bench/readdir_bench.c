@@ -0,0 +1,254 @@
+/*
+ *  Measures what hiding costs a directory listing: the module's
+ *  filtering_filldir() and humble_hash_contains() run over synthetic
+ *  directories in user space, see kshim.h.
+ *
+ *  The hashtable and the filtering code are compiled right into this file,
+ *  so that their static functions and tables can be reached.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../hashtable.c"
+#include "../clandestine.c"
+
+struct bench_dir {
+	struct inode  inode;
+	struct dentry dentry;
+	int           count;
+	struct inode  *entries;
+	struct dentry *dentries;
+	char          *names;
+};
+
+struct bench_thread {
+	pthread_t   thread;
+	struct file file;
+	int         iterations;
+	long        visible;
+};
+
+#define NAME_LEN 16
+
+static struct super_block g_sb;
+static struct inode g_root_inode;
+static struct dentry g_root_dentry;
+static unsigned long g_next_ino = 2;
+
+void humble_event_post(char type, u64 ino)
+{
+}
+
+/*
+ *  Plays the file system: the module forwards listings to the readdir it
+ *  has wrapped, every directory here shares the same one.
+ */
+static int synthetic_readdir(struct file *file, void *data, filldir_t filldir)
+{
+	int i;
+	struct bench_dir *dir = file->f_dentry->d_inode->i_private;
+	for (i = 0; i < dir->count; ++i) {
+		if (filldir(data, dir->names + i * NAME_LEN, NAME_LEN - 1, i,
+		            dir->entries[i].i_ino, DT_REG))
+		{
+			break;
+		}
+	}
+	return 0;
+}
+
+static struct file_operations synthetic_fops = {
+	.readdir = synthetic_readdir
+};
+
+static int counting_filldir(void *data, const char *name, int namelen,
+                            loff_t offset, u64 ino, unsigned d_type)
+{
+	*(long *) data += 1;
+	return 0;
+}
+
+static void setup_fs(void)
+{
+	g_root_inode.i_ino = 1;
+	g_root_inode.i_mode = S_IFDIR;
+	g_root_inode.i_fop = &synthetic_fops;
+	g_root_inode.i_sb = &g_sb;
+	g_root_dentry.d_inode = &g_root_inode;
+	g_root_dentry.d_parent = &g_root_dentry;
+	g_root_dentry.d_sb = &g_sb;
+	g_sb.s_root = &g_root_dentry;
+}
+
+static struct bench_dir *make_dir(int count)
+{
+	int i;
+	struct bench_dir *dir = calloc(1, sizeof(*dir));
+
+	dir->inode.i_ino = g_next_ino++;
+	dir->inode.i_mode = S_IFDIR;
+	dir->inode.i_fop = &synthetic_fops;
+	dir->inode.i_sb = &g_sb;
+	dir->inode.i_private = dir;
+	dir->dentry.d_inode = &dir->inode;
+	dir->dentry.d_parent = &g_root_dentry;
+	dir->dentry.d_sb = &g_sb;
+
+	dir->count = count;
+	dir->entries = calloc(count, sizeof(*dir->entries));
+	dir->dentries = calloc(count, sizeof(*dir->dentries));
+	dir->names = calloc(count, NAME_LEN);
+	for (i = 0; i < count; ++i) {
+		char *name = dir->names + i * NAME_LEN;
+		snprintf(name, NAME_LEN, "file%011d", i);
+		dir->entries[i].i_ino = g_next_ino++;
+		dir->entries[i].i_mode = S_IFREG;
+		dir->entries[i].i_nlink = 1;
+		dir->entries[i].i_sb = &g_sb;
+		dir->dentries[i].d_name.len = NAME_LEN - 1;
+		dir->dentries[i].d_name.name = (const unsigned char *) name;
+		dir->dentries[i].d_inode = &dir->entries[i];
+		dir->dentries[i].d_parent = &dir->dentry;
+		dir->dentries[i].d_sb = &g_sb;
+	}
+	return dir;
+}
+
+/* Hides every entry whose share of @ratio adds up to a whole one */
+static int hide_share(struct bench_dir *dir, double ratio)
+{
+	int i, err, hidden = 0;
+	for (i = 0; i < dir->count; ++i) {
+		if ((long) ((i + 1) * ratio) == (long) (i * ratio)) {
+			continue;
+		}
+		err = humble_hide_dentry(&dir->dentries[i], HUMBLE_DEFAULT_GROUP,
+		                         0, 1, NULL);
+		if (err) {
+			fprintf(stderr, "hiding entry %d failed: %d\n", i, err);
+			exit(1);
+		}
+		++hidden;
+	}
+	return hidden;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *list_dir(void *arg)
+{
+	int i;
+	struct bench_thread *t = arg;
+	for (i = 0; i < t->iterations; ++i) {
+		t->file.f_op->readdir(&t->file, &t->visible, counting_filldir);
+	}
+	return NULL;
+}
+
+/* Lists @dir @iterations times on each of @threads threads, in seconds */
+static double run(struct bench_dir *dir, int threads, int iterations,
+                  long *visible)
+{
+	int i;
+	double start, elapsed;
+	struct bench_thread *t = calloc(threads, sizeof(*t));
+
+	for (i = 0; i < threads; ++i) {
+		t[i].file.f_dentry = &dir->dentry;
+		t[i].file.f_op = dir->inode.i_fop;
+		t[i].iterations = iterations;
+	}
+	start = now();
+	for (i = 0; i < threads; ++i) {
+		pthread_create(&t[i].thread, NULL, list_dir, &t[i]);
+	}
+	for (i = 0; i < threads; ++i) {
+		pthread_join(t[i].thread, NULL);
+	}
+	elapsed = now() - start;
+	*visible = t[0].visible / iterations;
+	free(t);
+	return elapsed;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	        "usage: %s [-n entries] [-r hidden ratio] [-l other hidden]\n"
+	        "       [-t max threads] [-i iterations]\n", name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, threads, hidden;
+	int entries = 100000, load = 0, iterations = 20;
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	double ratio = 0.1;
+	double base = 0, elapsed, ns, rate, base_rate = 0;
+	long visible;
+	struct bench_dir *dir, *other;
+
+	while ((opt = getopt(argc, argv, "n:r:l:t:i:")) != -1) {
+		switch (opt) {
+		case 'n': entries = atoi(optarg);     break;
+		case 'r': ratio = atof(optarg);       break;
+		case 'l': load = atoi(optarg);        break;
+		case 't': max_threads = atoi(optarg); break;
+		case 'i': iterations = atoi(optarg);  break;
+		default:  usage(argv[0]);
+		}
+	}
+	if (entries <= 0 || ratio < 0 || ratio > 1 || load < 0 ||
+	    max_threads <= 0 || iterations <= 0)
+	{
+		usage(argv[0]);
+	}
+
+	setup_fs();
+	dir = make_dir(entries);
+	run(dir, 1, 1, &visible);
+	base = run(dir, 1, iterations, &visible);
+
+	/* Hidden files elsewhere only make the hash chains longer */
+	other = make_dir(load);
+	hide_share(other, 1.0);
+	hidden = hide_share(dir, ratio);
+
+	printf("entries %d, hidden %d, other hidden %d, hash buckets %d\n",
+	       entries, hidden, load, HASH_BUCKET_COUNT);
+	printf("unfiltered: %.1f ns/entry\n",
+	       base * 1e9 / ((double) entries * iterations));
+	printf("%8s %12s %14s %9s\n",
+	       "threads", "ns/entry", "entries/s", "scaling");
+
+	run(dir, 1, 1, &visible);
+	/* Doubling, with the maximum itself as the last step */
+	for (threads = 1; threads <= max_threads;
+	     threads = (threads < max_threads && threads * 2 > max_threads)
+	               ? max_threads : threads * 2)
+	{
+		elapsed = run(dir, threads, iterations, &visible);
+		if (visible != entries - hidden) {
+			fprintf(stderr, "listed %ld entries instead of %d\n",
+			        visible, entries - hidden);
+			return 1;
+		}
+		ns = elapsed * 1e9 / ((double) entries * iterations);
+		rate = (double) entries * iterations * threads / elapsed;
+		if (threads == 1) {
+			base_rate = rate;
+		}
+		printf("%8d %12.1f %14.0f %9.2f\n",
+		       threads, ns, rate, rate / base_rate);
+	}
+	return 0;
+}
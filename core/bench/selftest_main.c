@@ -0,0 +1,24 @@
+/*
+ *  Runs the module's selftest as an ordinary program, see kshim.h.
+ *  Threads are pthreads here, so it tells about the locking and the
+ *  data structures rather than about the kernel's scheduling.
+ */
+
+#include "../hashtable.c"
+#include "../selftest.c"
+
+void humble_event_post(char type, u64 ino)
+{
+}
+
+/* There is a single original table, so a single wrapped one */
+struct file_operations* humble_wrap_fops(struct file_operations *original)
+{
+	static struct file_operations wrapped;
+	return &wrapped;
+}
+
+int main(void)
+{
+	return humble_selftest() ? 1 : 0;
+}
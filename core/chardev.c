@@ -10,6 +10,10 @@ static struct cdev g_cdev;
 
 static int g_open_count = 0;
 
+/* Group and TTL which `H' applies to files. Reset on every open. */
+static int g_current_group = HUMBLE_DEFAULT_GROUP;
+static unsigned int g_current_ttl = 0;
+
 #define OUTPUT_BUFFER_SIZE 40
 #define INPUT_BUFFER_SIZE 512
 
@@ -17,6 +21,23 @@ static char obuffer[OUTPUT_BUFFER_SIZE];
 static char ibuffer[INPUT_BUFFER_SIZE];
 static ssize_t obuffer_len;
 
+/*
+ *  A single write may carry a batch of commands, each terminated by '\n'
+ *  (or '\0'). Their replies are queued in the same order, one line each,
+ *  so a client can keep many commands in flight and match the replies
+ *  by their sequence. The queue is drained by reads.
+ *
+ *  Commands are executed only while there is room for their replies,
+ *  so a write may be short. If not a single command fits, it fails with
+ *  EAGAIN and the client has to read the replies first.
+ */
+#define BATCH_BUFFER_SIZE 4096
+#define REPLY_QUEUE_SIZE  16384
+
+static char g_batch[BATCH_BUFFER_SIZE];
+static DEFINE_KFIFO(g_replies, char, REPLY_QUEUE_SIZE);
+static DEFINE_MUTEX(g_device_lock);
+
 #define print_out(args...) \
     (obuffer_len = snprintf(obuffer, OUTPUT_BUFFER_SIZE, args), \
      obuffer_len = (obuffer_len >= 0 ? obuffer_len + 1 : 0) )
@@ -26,20 +47,34 @@ static inline int output_error(int code)
 	return print_out("E%d\n", code);
 }
 
+/*
+ *  Files opened read-only are event listeners, they are handled by events.c
+ *  and have their private_data set.
+ */
+static inline int is_listener(struct file *filp)
+{
+	return filp->private_data != NULL;
+}
+
 static ssize_t device_read(struct file *filp, char __user *buffer,
                            size_t size, loff_t *offset)
 {
 	ssize_t bytes_read = 0;
+	unsigned int copied = 0;
 
-	PRdebug("Read @ %d: %s\n", size, obuffer);
-
-	if (obuffer[0] == '\0') {
-		return 0;
+	if (is_listener(filp)) {
+		return humble_events_read(filp, buffer, size);
 	}
-	if (size >= obuffer_len) {
-		bytes_read = obuffer_len;
-		bytes_read -= copy_to_user(buffer, obuffer, obuffer_len);
+
+	PRdebug("Read @ %d: %d queued\n", size, kfifo_len(&g_replies));
+
+	mutex_lock(&g_device_lock);
+	if (kfifo_to_user(&g_replies, buffer, size, &copied)) {
+		bytes_read = -EFAULT;
+	} else {
+		bytes_read = copied;
 	}
+	mutex_unlock(&g_device_lock);
 	return bytes_read;
 }
 
@@ -55,7 +90,8 @@ static void handle_hiding(void)
 		output_error(-EINVAL);
 		return;
 	}
-	err = humble_hide_file(ibuffer + 2, &ino);
+	err = humble_hide_file(ibuffer + 2, g_current_group, g_current_ttl,
+	                       &ino);
 	if (!err) {
 		PRdebug("Hidden %s\n", ibuffer + 2);
 		print_out("%lld\n", ino);
@@ -65,6 +101,79 @@ static void handle_hiding(void)
 	}
 }
 
+/*
+ *  F <fd>  hides the file the writer has opened as <fd>
+ */
+static void handle_hiding_fd(void)
+{
+	int err;
+	u64 ino;
+	unsigned int fd;
+
+	PRdebug("Hide fd\n");
+
+	if (ibuffer[1] != ' ' || sscanf(ibuffer + 2, "%u", &fd) != 1) {
+		PRdebug("Invalid fd hiding format: %s\n", ibuffer);
+		output_error(-EINVAL);
+		return;
+	}
+	err = humble_hide_fd(fd, g_current_group, g_current_ttl, &ino);
+	if (!err) {
+		PRdebug("Hidden fd %u\n", fd);
+		print_out("%lld\n", ino);
+	} else {
+		PRdebug("Failed hiding fd %u: %d\n", fd, err);
+		output_error(err);
+	}
+}
+
+/*
+ *  K <mount fd> <handle type> <hex handle bytes>
+ *    hides the file identified by a name_to_handle_at() handle
+ */
+static void handle_hiding_handle(void)
+{
+	int err;
+	u64 ino;
+	unsigned int mount_fd;
+	int handle_type;
+	int offset = 0;
+	size_t hex_len;
+	struct {
+		struct file_handle handle;
+		unsigned char bytes[MAX_HANDLE_SZ];
+	} fh;
+
+	PRdebug("Hide handle\n");
+
+	if (ibuffer[1] != ' ' ||
+	    sscanf(ibuffer + 2, "%u %d %n", &mount_fd, &handle_type, &offset) != 2)
+	{
+		PRdebug("Invalid handle hiding format: %s\n", ibuffer);
+		output_error(-EINVAL);
+		return;
+	}
+	hex_len = strlen(ibuffer + 2 + offset);
+	if (hex_len == 0 || hex_len % 2 != 0 || hex_len / 2 > MAX_HANDLE_SZ ||
+	    hex2bin(fh.handle.f_handle, ibuffer + 2 + offset, hex_len / 2))
+	{
+		PRdebug("Invalid handle: %s\n", ibuffer + 2 + offset);
+		output_error(-EINVAL);
+		return;
+	}
+	fh.handle.handle_bytes = hex_len / 2;
+	fh.handle.handle_type = handle_type;
+
+	err = humble_hide_handle(mount_fd, &fh.handle,
+	                         g_current_group, g_current_ttl, &ino);
+	if (!err) {
+		print_out("%lld\n", ino);
+	} else {
+		PRdebug("Failed hiding handle: %d\n", err);
+		output_error(err);
+	}
+}
+
 static void handle_unhiding(void)
 {
 	int err;
@@ -87,6 +196,80 @@ static void handle_unhiding(void)
 	}
 }
 
+/*
+ *  R /path  unhides the file by its path
+ *  Q /path  replies with the inode number of the hidden file at the path
+ *
+ *  Both resolve only the parent directory, the hidden file is found
+ *  through the module's own index.
+ */
+static void handle_path_query(void)
+{
+	int err;
+	u64 ino;
+
+	PRdebug("Path query\n");
+
+	if (ibuffer[1] != ' ' || ibuffer[2] != '/') {
+		PRdebug("Invalid path query format: %s\n", ibuffer);
+		output_error(-EINVAL);
+		return;
+	}
+	if (ibuffer[0] == 'R') {
+		err = humble_unhide_path(ibuffer + 2, &ino);
+	} else {
+		err = humble_lookup_hidden(ibuffer + 2, &ino);
+	}
+	if (!err) {
+		print_out("%lld\n", ino);
+	} else {
+		PRdebug("Failed path query %s: %d\n", ibuffer, err);
+		output_error(err);
+	}
+}
+
+/*
+ *  W+ <pattern> /dir  hides new files matching the pattern in the directory
+ *                     as they are created, using the current group and TTL
+ *  W- /dir            drops all rules of the directory
+ *
+ *  Both reply with the inode number of the directory.
+ */
+static void handle_watching(void)
+{
+	int err;
+	u64 ino;
+	char *path;
+
+	PRdebug("Watch\n");
+
+	if (ibuffer[1] == '+' && ibuffer[2] == ' ') {
+		path = strchr(ibuffer + 3, ' ');
+		if (!path || path[1] != '/') {
+			goto invalid;
+		}
+		*path++ = '\0';
+		err = humble_rule_add(path, ibuffer + 3,
+		                      g_current_group, g_current_ttl, &ino);
+	}
+	else if (ibuffer[1] == '-' && ibuffer[2] == ' ' && ibuffer[3] == '/') {
+		err = humble_rule_remove(ibuffer + 3, &ino);
+	}
+	else {
+		goto invalid;
+	}
+	if (!err) {
+		print_out("%lld\n", ino);
+	} else {
+		PRdebug("Failed watching: %d\n", err);
+		output_error(err);
+	}
+	return;
+invalid:
+	PRdebug("Invalid watching format: %s\n", ibuffer);
+	output_error(-EINVAL);
+}
+
 static void handle_clearing(void)
 {
 	int err;
@@ -107,72 +290,256 @@ static void handle_clearing(void)
 	}
 }
 
-static ssize_t device_write(struct file *filp, const char __user *buffer,
-                            size_t size, loff_t *offset)
+/*
+ *  Group commands:
+ *    G+ <name>  create a group, replies with its id
+ *    G- <id>    unhide all members and delete the group, replies with
+ *               the number of unhidden files
+ *    GE <id>    enable the group (hide its members)
+ *    GD <id>    disable the group (reveal its members)
+ *    G= <id>    put files hidden by subsequent `H' commands into the group
+ */
+static void handle_grouping(void)
 {
-	int err;
-	ssize_t bytes_written = 0;
+	int err = 0;
+	int id = 0;
+	int count = 0;
 
-	if (size >= INPUT_BUFFER_SIZE) return -ENOSPC;
+	PRdebug("Group\n");
 
-	bytes_written = strncpy_from_user(ibuffer, buffer, size);
-	if (bytes_written >= 0) {
-		ibuffer[bytes_written] = '\0';
-		if (bytes_written > 0 && ibuffer[bytes_written - 1] == '\n') {
-			ibuffer[bytes_written - 1] = '\0';
+	if (ibuffer[1] == '\0' || ibuffer[2] != ' ') {
+		PRdebug("Invalid grouping format: %s\n", ibuffer);
+		output_error(-EINVAL);
+		return;
+	}
+	if (ibuffer[1] == '+') {
+		err = humble_group_create(ibuffer + 3, &id);
+		goto reply;
+	}
+	if (sscanf(ibuffer + 3, "%d", &id) != 1) {
+		PRdebug("Invalid group id: %s\n", ibuffer);
+		output_error(-EINVAL);
+		return;
+	}
+	switch (ibuffer[1]) {
+	case '-':
+		err = humble_group_delete(id, &count);
+		if (!err && g_current_group == id) {
+			g_current_group = HUMBLE_DEFAULT_GROUP;
+		}
+		if (!err) {
+			print_out("%d\n", count);
+			return;
+		}
+		break;
+	case 'E':
+		err = humble_group_enable(id, 1);
+		break;
+	case 'D':
+		err = humble_group_enable(id, 0);
+		break;
+	case '=':
+		err = humble_group_exists(id) ? 0 : -ESRCH;
+		if (!err) {
+			g_current_group = id;
 		}
+		break;
+	default:
+		err = -EINVAL;
+		break;
 	}
+reply:
+	if (!err) {
+		print_out("%d\n", id);
+	} else {
+		PRdebug("Failed grouping %s: %d\n", ibuffer, err);
+		output_error(err);
+	}
+}
+
+/*
+ *  T <seconds>  files hidden by subsequent `H' commands are unhidden
+ *               automatically after the given time, 0 means never
+ */
+static void handle_ttl(void)
+{
+	unsigned int ttl;
+
+	PRdebug("TTL\n");
+
+	if (ibuffer[1] != ' ' || sscanf(ibuffer + 2, "%u", &ttl) != 1) {
+		PRdebug("Invalid TTL format: %s\n", ibuffer);
+		output_error(-EINVAL);
+		return;
+	}
+	g_current_ttl = ttl;
+	print_out("%u\n", ttl);
+}
 
-	PRdebug("Write (%d): %s\n", size, ibuffer);
+static void execute_command(void)
+{
+	PRdebug("Command: %s\n", ibuffer);
 
 	switch (ibuffer[0]) {
 	case 'H':
 		handle_hiding();
 		break;
+	case 'F':
+		handle_hiding_fd();
+		break;
+	case 'K':
+		handle_hiding_handle();
+		break;
 	case 'U':
 		handle_unhiding();
 		break;
+	case 'R':
+	case 'Q':
+		handle_path_query();
+		break;
 	case 'C':
 		handle_clearing();
 		break;
+	case 'G':
+		handle_grouping();
+		break;
+	case 'T':
+		handle_ttl();
+		break;
+	case 'W':
+		handle_watching();
+		break;
 	default:
 		PRdebug("Unknown: %s\n", ibuffer);
 		output_error(-EINVAL);
 		break;
 	}
+}
+
+static ssize_t device_write(struct file *filp, const char __user *buffer,
+                            size_t size, loff_t *offset)
+{
+	ssize_t bytes_written = 0;
+	size_t start, end;
+
+	if (size > BATCH_BUFFER_SIZE) {
+		size = BATCH_BUFFER_SIZE;
+	}
+
+	mutex_lock(&g_device_lock);
+	if (copy_from_user(g_batch, buffer, size)) {
+		bytes_written = -EFAULT;
+		goto out;
+	}
+
+	PRdebug("Write (%d)\n", size);
+
+	for (start = 0; start < size; start = end + 1) {
+		for (end = start; end < size; ++end) {
+			if (g_batch[end] == '\n' || g_batch[end] == '\0') {
+				break;
+			}
+		}
+		/* An unterminated command is complete only at the very end
+		 * of a write which has not been cut short */
+		if (end == size && size == BATCH_BUFFER_SIZE) {
+			break;
+		}
+		if (kfifo_avail(&g_replies) < OUTPUT_BUFFER_SIZE) {
+			break;
+		}
+		if (end - start >= INPUT_BUFFER_SIZE) {
+			output_error(-ENOSPC);
+		}
+		else if (end > start) {
+			memcpy(ibuffer, g_batch + start, end - start);
+			ibuffer[end - start] = '\0';
+			execute_command();
+		}
+		else {
+			bytes_written = min(end + 1, size);
+			continue;
+		}
+		kfifo_in(&g_replies, obuffer, obuffer_len - 1);
+		bytes_written = min(end + 1, size);
+	}
+	if (bytes_written == 0 && size > 0) {
+		bytes_written = (kfifo_avail(&g_replies) < OUTPUT_BUFFER_SIZE)
+		              ? -EAGAIN : -ENOSPC;
+	}
+out:
+	mutex_unlock(&g_device_lock);
 	return bytes_written;
 }
 
 /*
- *  Only one process can hold the device file opened. Any other will recieve
- *  EBUSY error.
+ *  Only one process can hold the device file opened for writing. Any other
+ *  will recieve EBUSY error. Any number of processes can open it read-only
+ *  to listen for events.
  *
  *  Also we get() the module to prohibit its unloading while the file is opened.
  */
 
 static int device_open(struct inode *node, struct file *filp)
 {
+	int err;
+
+	filp->private_data = NULL;
+	if ((filp->f_flags & O_ACCMODE) == O_RDONLY) {
+		err = humble_events_open(filp);
+		if (!err) {
+			try_module_get(THIS_MODULE);
+		}
+		return err;
+	}
 	if (g_open_count > 0) {
 		return -EBUSY;
 	}
 	++g_open_count;
+	kfifo_reset(&g_replies);
+	g_current_group = HUMBLE_DEFAULT_GROUP;
+	g_current_ttl = 0;
 	try_module_get(THIS_MODULE);
 	return 0;
 }
 
 static int device_release(struct inode *node, struct file *filp)
 {
-	--g_open_count;
+	if (is_listener(filp)) {
+		humble_events_release(filp);
+	} else {
+		--g_open_count;
+	}
 	module_put(THIS_MODULE);
 	return 0;
 }
 
+static unsigned int device_poll(struct file *filp, poll_table *wait)
+{
+	if (is_listener(filp)) {
+		return humble_events_poll(filp, wait);
+	}
+	return (kfifo_is_empty(&g_replies) ? 0 : POLLIN | POLLRDNORM)
+	     | (kfifo_avail(&g_replies) < OUTPUT_BUFFER_SIZE ? 0
+	                                                     : POLLOUT | POLLWRNORM);
+}
+
+static int device_fasync(int fd, struct file *filp, int on)
+{
+	if (!is_listener(filp)) {
+		return -EINVAL;
+	}
+	return humble_events_fasync(fd, filp, on);
+}
+
 static struct file_operations g_device_fops = {
 	.owner   = THIS_MODULE,
 	.read    = device_read,
 	.write   = device_write,
 	.open    = device_open,
-	.release = device_release
+	.release = device_release,
+	.poll    = device_poll,
+	.fasync  = device_fasync
 };
 
 
@@ -12,83 +12,484 @@ static int filtering_filldir(void *buffer, const char *name, int namelen,
 	return g_original_filldir(buffer, name, namelen, offset, ino, d_type);
 }
 
-static int filtering_readdir(struct file *dir, void *data, filldir_t filldir)
+/*
+ * Returning -ENOENT from hidden files' ops as if the files really do not exist.
+ *
+ * Files of disabled groups keep these ops installed, so each method first
+ * checks whether it should forward the call to the original one instead.
+ */
+
+static struct file_operations* revealed_fops(struct inode *inode)
 {
-	if (filldir != filtering_filldir) {
-		g_original_filldir = filldir;
+	struct file_operations *fops = NULL;
+	if (humble_hash_revealed_ops(inode->i_ino, NULL, &fops)) {
+		return NULL;
 	}
-
-	return dir->f_dentry->d_sb->s_root->d_inode->i_fop
-		->readdir(dir, data, filtering_filldir);
+	return fops;
 }
 
-/*
- * Returning -ENOENT from hidden files' ops as if the files really do not exist.
- */
+static struct inode_operations* revealed_iops(struct inode *inode)
+{
+	struct inode_operations *iops = NULL;
+	if (humble_hash_revealed_ops(inode->i_ino, &iops, NULL)) {
+		return NULL;
+	}
+	return iops;
+}
 
 static ssize_t notfound_read(struct file *file, char __user *buf,
                              size_t count, loff_t *offset)
 {
+	struct file_operations *fops = revealed_fops(file->f_dentry->d_inode);
+	if (fops && fops->read) {
+		return fops->read(file, buf, count, offset);
+	}
 	return -ENOENT;
 }
 
 static ssize_t notfound_write(struct file *file, const char __user *buf,
                               size_t count, loff_t *offset)
 {
+	struct file_operations *fops = revealed_fops(file->f_dentry->d_inode);
+	if (fops && fops->write) {
+		return fops->write(file, buf, count, offset);
+	}
 	return -ENOENT;
 }
 
 static int notfound_readdir(struct file *dir, void *data, filldir_t filldir)
 {
+	struct file_operations *fops = revealed_fops(dir->f_dentry->d_inode);
+	if (fops && fops->readdir) {
+		return fops->readdir(dir, data, filldir);
+	}
 	return -ENOENT;
 }
 
 static int notfound_mmap(struct file *file, struct vm_area_struct *dest)
 {
+	struct file_operations *fops = revealed_fops(file->f_dentry->d_inode);
+	if (fops && fops->mmap) {
+		return fops->mmap(file, dest);
+	}
 	return -ENOENT;
 }
 
+/*
+ * A revealed file gets its original fops for good, like chrdev_open() does,
+ * so the rest of its calls do not go through us at all.
+ */
 static int notfound_open(struct inode *inode, struct file *file)
 {
-	return -ENOENT;
+	struct file_operations *fops = revealed_fops(inode);
+	if (!fops) {
+		return -ENOENT;
+	}
+	fops_put(file->f_op);
+	file->f_op = fops_get(fops);
+	if (file->f_op && file->f_op->open) {
+		return file->f_op->open(inode, file);
+	}
+	return 0;
 }
 
 static int notfound_release(struct inode *inode, struct file *file)
 {
+	struct file_operations *fops = revealed_fops(inode);
+	if (fops && fops->release) {
+		return fops->release(inode, file);
+	}
+	return -ENOENT;
+}
+
+static struct dentry* notfound_lookup(struct inode *dir, struct dentry *dentry,
+                                      unsigned int flags)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops && iops->lookup) {
+		return iops->lookup(dir, dentry, flags);
+	}
+	return ERR_PTR(-ENOENT);
+}
+
+/*
+ * The methods creating and removing entries are called on the directory the
+ * entry is in, so they check the directory rather than the entry itself.
+ */
+
+static int notfound_create(struct inode *dir, struct dentry *dentry,
+                           umode_t mode, bool excl)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops) {
+		return iops->create ? iops->create(dir, dentry, mode, excl)
+		                    : -EACCES;
+	}
+	return -ENOENT;
+}
+
+static int notfound_mkdir(struct inode *dir, struct dentry *dentry,
+                          umode_t mode)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops) {
+		return iops->mkdir ? iops->mkdir(dir, dentry, mode) : -EPERM;
+	}
+	return -ENOENT;
+}
+
+static int notfound_mknod(struct inode *dir, struct dentry *dentry,
+                          umode_t mode, dev_t dev)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops) {
+		return iops->mknod ? iops->mknod(dir, dentry, mode, dev) : -EPERM;
+	}
+	return -ENOENT;
+}
+
+static int notfound_symlink(struct inode *dir, struct dentry *dentry,
+                            const char *target)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops) {
+		return iops->symlink ? iops->symlink(dir, dentry, target) : -EPERM;
+	}
+	return -ENOENT;
+}
+
+static int notfound_link(struct dentry *old_dentry, struct inode *dir,
+                         struct dentry *dentry)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops) {
+		return iops->link ? iops->link(old_dentry, dir, dentry) : -EPERM;
+	}
+	return -ENOENT;
+}
+
+static int notfound_unlink(struct inode *dir, struct dentry *dentry)
+{
+	struct inode_operations *iops = revealed_iops(dir);
+	if (iops) {
+		return iops->unlink ? iops->unlink(dir, dentry) : -EPERM;
+	}
 	return -ENOENT;
 }
 
 static int notfound_rmdir(struct inode *parent, struct dentry *dir)
 {
+	struct inode_operations *iops = revealed_iops(parent);
+	if (iops) {
+		return iops->rmdir ? iops->rmdir(parent, dir) : -EPERM;
+	}
 	return -ENOENT;
 }
 
 static int notfound_rename(struct inode *inode_old, struct dentry *dentry_old,
                            struct inode *inode_new, struct dentry *dentry_new)
 {
+	struct inode_operations *iops = revealed_iops(inode_old);
+	if (iops) {
+		return iops->rename ? iops->rename(inode_old, dentry_old,
+		                                   inode_new, dentry_new)
+		                    : -EPERM;
+	}
 	return -ENOENT;
 }
 
+static int notfound_readlink(struct dentry *dentry, char __user *buf,
+                             int size)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		return iops->readlink ? iops->readlink(dentry, buf, size) : -EINVAL;
+	}
+	return -ENOENT;
+}
+
+static void* notfound_follow_link(struct dentry *dentry, struct nameidata *nd)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops && iops->follow_link) {
+		return iops->follow_link(dentry, nd);
+	}
+	return ERR_PTR(-ENOENT);
+}
+
+static void notfound_put_link(struct dentry *dentry, struct nameidata *nd,
+                              void *cookie)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops && iops->put_link) {
+		iops->put_link(dentry, nd, cookie);
+	}
+}
+
 static int notfound_setattr(struct dentry *dentry, struct iattr *attrs)
 {
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		return iops->setattr ? iops->setattr(dentry, attrs)
+		                     : simple_setattr(dentry, attrs);
+	}
 	return -ENOENT;
 }
 
 static int notfound_getattr(struct vfsmount *mnt, struct dentry *dentry,
                             struct kstat *stat)
 {
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		if (iops->getattr) {
+			return iops->getattr(mnt, dentry, stat);
+		}
+		generic_fillattr(dentry->d_inode, stat);
+		return 0;
+	}
+	return -ENOENT;
+}
+
+static int notfound_setxattr(struct dentry *dentry, const char *name,
+                             const void *value, size_t size, int flags)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		return iops->setxattr ? iops->setxattr(dentry, name, value,
+		                                       size, flags)
+		                      : -EOPNOTSUPP;
+	}
+	return -ENOENT;
+}
+
+static ssize_t notfound_getxattr(struct dentry *dentry, const char *name,
+                                 void *value, size_t size)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		return iops->getxattr ? iops->getxattr(dentry, name, value, size)
+		                      : -EOPNOTSUPP;
+	}
+	return -ENOENT;
+}
+
+static ssize_t notfound_listxattr(struct dentry *dentry, char *list,
+                                  size_t size)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		return iops->listxattr ? iops->listxattr(dentry, list, size)
+		                       : -EOPNOTSUPP;
+	}
+	return -ENOENT;
+}
+
+static int notfound_removexattr(struct dentry *dentry, const char *name)
+{
+	struct inode_operations *iops = revealed_iops(dentry->d_inode);
+	if (iops) {
+		return iops->removexattr ? iops->removexattr(dentry, name)
+		                         : -EOPNOTSUPP;
+	}
 	return -ENOENT;
 }
 
 /*
- * Method tables shared between all hidden files and their parents.
+ *  Parents of hidden files get a copy of their original file operations
+ *  where only .readdir is replaced, so the rest of the filesystem's methods
+ *  (llseek, fsync, open, ...) keep working as they did. The filter hands
+ *  the listing to the very readdir it has replaced.
+ *
+ *  Wrapped tables are shared by all parents with the same original table.
+ *  They are never freed until the module is unloaded, as directories opened
+ *  while filtered keep using them after their hidden files are gone. For
+ *  the same reason each table pins this module rather than the filesystem,
+ *  which is pinned by the mount anyway.
  */
+struct wrapped_fops {
+	struct list_head       link;
 
-static struct file_operations filtering_fops = {
-	.owner   = THIS_MODULE,
-	.readdir = filtering_readdir
+	struct file_operations *original;
+	struct file_operations ops;
+};
+
+#define entry_wrapped(lp) (list_entry((lp), struct wrapped_fops, link))
+
+static LIST_HEAD(g_wrapped_fops);
+static DECLARE_RWSEM(g_wrapped_lock);
+
+static int filtering_readdir(struct file *dir, void *data, filldir_t filldir)
+{
+	struct file_operations *fops = dir->f_op;
+
+	/* Forwarded by notfound_readdir() of a revealed directory */
+	if (!fops || fops->readdir != filtering_readdir) {
+		fops = revealed_fops(dir->f_dentry->d_inode);
+		if (!fops || fops->readdir != filtering_readdir) {
+			return -ENOENT;
+		}
+	}
+	fops = container_of(fops, struct wrapped_fops, ops)->original;
+
+	if (filldir != filtering_filldir) {
+		g_original_filldir = filldir;
+	}
+
+	return fops->readdir(dir, data, filtering_filldir);
+}
+
+/*
+ *  Finds or makes a wrapped copy of @original, which may be a wrapped
+ *  table already. Tables without .readdir are copied as is.
+ */
+struct file_operations* humble_wrap_fops(struct file_operations *original)
+{
+	struct list_head *node;
+	struct wrapped_fops *wrapped;
+	struct file_operations *fops = NULL;
+
+	down_read(&g_wrapped_lock);
+	list_for_each(node, &g_wrapped_fops) {
+		wrapped = entry_wrapped(node);
+		if (wrapped->original == original || &wrapped->ops == original) {
+			fops = &wrapped->ops;
+			break;
+		}
+	}
+	up_read(&g_wrapped_lock);
+	if (fops) {
+		return fops;
+	}
+
+	down_write(&g_wrapped_lock);
+	/* Someone could have made it meanwhile */
+	list_for_each(node, &g_wrapped_fops) {
+		if (entry_wrapped(node)->original == original) {
+			fops = &entry_wrapped(node)->ops;
+			goto out;
+		}
+	}
+	wrapped = kmalloc(sizeof(*wrapped), GFP_KERNEL);
+	if (!wrapped) {
+		goto out;
+	}
+	INIT_LIST_HEAD(&wrapped->link);
+	wrapped->original = original;
+	if (original) {
+		wrapped->ops = *original;
+	} else {
+		memset(&wrapped->ops, 0, sizeof(wrapped->ops));
+	}
+	wrapped->ops.owner = THIS_MODULE;
+	if (wrapped->ops.readdir) {
+		wrapped->ops.readdir = filtering_readdir;
+	}
+	list_add(&wrapped->link, &g_wrapped_fops);
+	fops = &wrapped->ops;
+out:
+	up_write(&g_wrapped_lock);
+	return fops;
+}
+
+/*
+ *  Hidden files get a copy of their original inode operations as well,
+ *  with the methods which would reveal or change the file replaced by the
+ *  notfound ones. Everything else (.permission, .get_acl, .fiemap, ...)
+ *  stays the filesystem's, so a file of a disabled group is checked and
+ *  behaves as it did before it was hidden.
+ *
+ *  A method is only replaced when the original has it: the VFS tells
+ *  directories and symlinks by .lookup and .follow_link, and falls back
+ *  on its own for the missing ones. .setattr and .getattr have fallbacks
+ *  here, so they are always replaced.
+ *
+ *  These tables are kept until the module is unloaded like the ones above,
+ *  under the same lock.
+ */
+struct hidden_iops {
+	struct list_head        link;
+
+	struct inode_operations *original;
+	struct inode_operations ops;
 };
 
+#define entry_hidden(lp) (list_entry((lp), struct hidden_iops, link))
+
+static LIST_HEAD(g_hidden_iops);
+
+static struct inode_operations* humble_hidden_iops(struct inode_operations *original)
+{
+	struct list_head *node;
+	struct hidden_iops *hidden;
+	struct inode_operations *iops = NULL;
+
+	down_write(&g_wrapped_lock);
+	list_for_each(node, &g_hidden_iops) {
+		if (entry_hidden(node)->original == original) {
+			iops = &entry_hidden(node)->ops;
+			goto out;
+		}
+	}
+	hidden = kmalloc(sizeof(*hidden), GFP_KERNEL);
+	if (!hidden) {
+		goto out;
+	}
+	INIT_LIST_HEAD(&hidden->link);
+	hidden->original = original;
+	if (original) {
+		hidden->ops = *original;
+	} else {
+		memset(&hidden->ops, 0, sizeof(hidden->ops));
+	}
+	iops = &hidden->ops;
+	if (iops->create)      iops->create      = notfound_create;
+	if (iops->lookup)      iops->lookup      = notfound_lookup;
+	if (iops->link)        iops->link        = notfound_link;
+	if (iops->unlink)      iops->unlink      = notfound_unlink;
+	if (iops->symlink)     iops->symlink     = notfound_symlink;
+	if (iops->mkdir)       iops->mkdir       = notfound_mkdir;
+	if (iops->rmdir)       iops->rmdir       = notfound_rmdir;
+	if (iops->mknod)       iops->mknod       = notfound_mknod;
+	if (iops->rename)      iops->rename      = notfound_rename;
+	if (iops->readlink)    iops->readlink    = notfound_readlink;
+	if (iops->follow_link) iops->follow_link = notfound_follow_link;
+	if (iops->put_link)    iops->put_link    = notfound_put_link;
+	if (iops->setxattr)    iops->setxattr    = notfound_setxattr;
+	if (iops->getxattr)    iops->getxattr    = notfound_getxattr;
+	if (iops->listxattr)   iops->listxattr   = notfound_listxattr;
+	if (iops->removexattr) iops->removexattr = notfound_removexattr;
+	iops->setattr = notfound_setattr;
+	iops->getattr = notfound_getattr;
+	list_add(&hidden->link, &g_hidden_iops);
+out:
+	up_write(&g_wrapped_lock);
+	return iops;
+}
+
+/*
+ *  Frees the wrapped tables. The hash must be cleared before, so that
+ *  no inode refers to a wrapped table.
+ */
+void humble_fops_cleanup(void)
+{
+	struct list_head *node = NULL, *next = NULL;
+
+	down_write(&g_wrapped_lock);
+	list_for_each_safe(node, next, &g_wrapped_fops) {
+		list_del(node);
+		kfree(entry_wrapped(node));
+	}
+	list_for_each_safe(node, next, &g_hidden_iops) {
+		list_del(node);
+		kfree(entry_hidden(node));
+	}
+	up_write(&g_wrapped_lock);
+}
+
+/*
+ * File operations shared between all hidden files.
+ */
+
 static struct file_operations notfound_fops = {
 	.owner   = THIS_MODULE,
 	.read    = notfound_read,
@@ -99,36 +500,38 @@ static struct file_operations notfound_fops = {
 	.release = notfound_release
 };
 
-static struct inode_operations notfound_iops = {
-	.rmdir   = notfound_rmdir,
-	.rename  = notfound_rename,
-	.setattr = notfound_setattr,
-	.getattr = notfound_getattr
-};
-
 
 /*
- *  Hides the file located at @path, writes its inode number to @ino.
+ *  Hides the file behind @dentry as a member of @group for @ttl seconds
+ *  (forever if @ttl is zero), writes its inode number to @ino.
+ *  With @listing_only set the file is only filtered out of its parent's
+ *  listing, but its own methods are left intact.
+ *
+ *  The caller holds a reference to @dentry, which pins its inode,
+ *  so only the parent has to be pinned here.
  */
-int humble_hide_file(const char *path, u64 *ino)
+int humble_hide_dentry(struct dentry *dentry, int group, unsigned int ttl,
+                       int listing_only, u64 *ino)
 {
 	int err;
-	struct path dest;
+	struct dentry *parent;
 	struct inode *fnode;
 	struct inode *pnode;
+	struct inode_operations *iops = NULL;
+	char name[NAME_MAX + 1];
+	unsigned int len;
 
-	err = kern_path(path, 0, &dest);
-	if (err) {
-		PRnotice("Could not find file %s\n", path);
-		goto failed_lookup;
+	fnode = dentry->d_inode;
+	if (!fnode) {
+		return -ENOENT;
 	}
+	parent = dget_parent(dentry);
+	pnode = parent->d_inode;
 
-	dget(dest.dentry);
-	dget(dest.dentry->d_parent);
-	fnode = dest.dentry->d_inode;
-	pnode = dest.dentry->d_parent->d_inode;
-	ihold(fnode);
-	ihold(pnode);
+	spin_lock(&dentry->d_lock);
+	len = min_t(unsigned int, dentry->d_name.len, NAME_MAX);
+	memcpy(name, dentry->d_name.name, len);
+	spin_unlock(&dentry->d_lock);
 
 	if ((fnode->i_sb->s_root->d_inode == fnode) ||
 	    (fnode->i_sb->s_root->d_inode == pnode))
@@ -136,26 +539,117 @@ int humble_hide_file(const char *path, u64 *ino)
 		err = -EPERM;
 		goto out;
 	}
+	/* A disconnected dentry has no parent to filter the listing of */
+	if (IS_ROOT(dentry)) {
+		err = -ESTALE;
+		goto out;
+	}
 
-	err = humble_hash_add(fnode, pnode);
+	if (!listing_only) {
+		iops = humble_hidden_iops((struct inode_operations *) fnode->i_op);
+		if (!iops) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	err = humble_hash_add(fnode, pnode, name, len, group, ttl);
 	if (err) {
-		PRerror("Could not add file %s to hash\n", path);
+		PRerror("Could not add file #%lu to hash\n", fnode->i_ino);
 		goto out;
 	}
-	fnode->i_op = &notfound_iops;
-	fnode->i_fop = &notfound_fops;
-	pnode->i_fop = &filtering_fops;
-
+	if (!listing_only) {
+		fnode->i_op = iops;
+		fnode->i_fop = &notfound_fops;
+	}
 	if (ino != NULL) {
 		*ino = fnode->i_ino;
 	}
 out:
-	iput(pnode);
-	iput(fnode);
-	dput(dest.dentry->d_parent);
-	dput(dest.dentry);
+	dput(parent);
+	return err;
+}
+
+/*
+ *  Hides the file located at @path.
+ */
+int humble_hide_file(const char *path, int group, unsigned int ttl, u64 *ino)
+{
+	int err;
+	struct path dest;
+
+	err = kern_path(path, 0, &dest);
+	if (err) {
+		PRnotice("Could not find file %s\n", path);
+		return err;
+	}
+	err = humble_hide_dentry(dest.dentry, group, ttl, 0, ino);
 	path_put(&dest);
-failed_lookup:
+	return err;
+}
+
+/*
+ *  Hides the file opened as @fd by the current process. This hides exactly
+ *  the inode the caller has opened, no matter where it has been moved since.
+ */
+int humble_hide_fd(unsigned int fd, int group, unsigned int ttl, u64 *ino)
+{
+	int err;
+	struct file *file;
+
+	file = fget(fd);
+	if (!file) {
+		return -EBADF;
+	}
+	err = humble_hide_dentry(file->f_dentry, group, ttl, 0, ino);
+	fput(file);
+	return err;
+}
+
+/*
+ *  Files out of the dentry cache, such as all of them after a reboot, are
+ *  decoded as disconnected dentries. Refusing those makes exportfs connect
+ *  them to their real parent directory.
+ */
+static int handle_acceptable(void *context, struct dentry *dentry)
+{
+	return !(dentry->d_flags & DCACHE_DISCONNECTED);
+}
+
+/*
+ *  Hides the file identified by a name_to_handle_at() @handle on the
+ *  filesystem where @mount_fd is opened. Handles survive reboots, so this
+ *  is the way to restore a saved hidden set without walking any paths.
+ *
+ *  Just like open_by_handle_at(), requires CAP_DAC_READ_SEARCH.
+ */
+int humble_hide_handle(unsigned int mount_fd, struct file_handle *handle,
+                       int group, unsigned int ttl, u64 *ino)
+{
+	int err;
+	struct file *mount;
+	struct dentry *dentry;
+
+	if (!capable(CAP_DAC_READ_SEARCH)) {
+		return -EPERM;
+	}
+	mount = fget(mount_fd);
+	if (!mount) {
+		return -EBADF;
+	}
+	dentry = exportfs_decode_fh(mount->f_path.mnt,
+	                            (struct fid *) handle->f_handle,
+	                            handle->handle_bytes >> 2,
+	                            handle->handle_type,
+	                            handle_acceptable, NULL);
+	if (IS_ERR_OR_NULL(dentry)) {
+		err = dentry ? PTR_ERR(dentry) : -ESTALE;
+		goto out;
+	}
+	err = humble_hide_dentry(dentry, group, ttl, 0, ino);
+	dput(dentry);
+out:
+	fput(mount);
 	return err;
 }
 
@@ -167,3 +661,58 @@ int humble_unhide_file(u64 ino)
 	}
 	return err;
 }
+
+/*
+ *  Finds a hidden file by its @path through the reverse index. Only the
+ *  parent directory is looked up, the hidden file itself is never touched.
+ */
+int humble_lookup_hidden(const char *path, u64 *ino)
+{
+	int err;
+	struct path dir;
+	char *dirpath;
+	const char *name;
+	size_t len = strlen(path);
+
+	while (len > 1 && path[len - 1] == '/') {
+		--len;
+	}
+	dirpath = kstrndup(path, len, GFP_KERNEL);
+	if (!dirpath) {
+		return -ENOMEM;
+	}
+	name = strrchr(dirpath, '/');
+	if (!name || name[1] == '\0' ||
+	    !strcmp(name + 1, ".") || !strcmp(name + 1, ".."))
+	{
+		err = -EINVAL;
+		goto out;
+	}
+	dirpath[name - dirpath] = '\0';
+	name += 1;
+
+	err = kern_path(dirpath[0] ? dirpath : "/", LOOKUP_DIRECTORY, &dir);
+	if (err) {
+		goto out;
+	}
+	err = humble_hash_lookup_name(dir.dentry->d_inode->i_ino,
+	                              name, strlen(name), ino);
+	path_put(&dir);
+out:
+	kfree(dirpath);
+	return err;
+}
+
+int humble_unhide_path(const char *path, u64 *ino)
+{
+	u64 found = 0;
+	int err = humble_lookup_hidden(path, &found);
+	if (err) {
+		return err;
+	}
+	err = humble_unhide_file(found);
+	if (!err && ino != NULL) {
+		*ino = found;
+	}
+	return err;
+}
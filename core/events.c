@@ -0,0 +1,167 @@
+#include "humble.h"
+
+/*
+ *  Changes of the hidden set are recorded in a ring of events shared by
+ *  all listeners. Every listener keeps its own position in the ring, like
+ *  /dev/kmsg readers do, so slow listeners only lose their own events and
+ *  are told how many of them they have missed.
+ *
+ *  Events are posted as the hidden set changes, so a hidden file that is
+ *  unlinked is reported once it leaves the set, see humble.h.
+ */
+
+#define EVENT_RING_SIZE 1024
+#define EVENT_RING_MASK (EVENT_RING_SIZE - 1)
+
+/* "T 18446744073709551615\n" */
+#define EVENT_LINE_MAX 24
+
+struct humble_event {
+	u64  ino;
+	char type;
+};
+
+struct humble_listener {
+	u64 seq;
+};
+
+static struct humble_event g_ring[EVENT_RING_SIZE];
+static u64 g_head;
+
+static DEFINE_SPINLOCK(g_event_lock);
+static DECLARE_WAIT_QUEUE_HEAD(g_event_wait);
+static struct fasync_struct *g_event_fasync;
+
+
+void humble_event_post(char type, u64 ino)
+{
+	struct humble_event *event;
+
+	spin_lock(&g_event_lock);
+	event = &g_ring[g_head & EVENT_RING_MASK];
+	event->type = type;
+	event->ino = ino;
+	g_head += 1;
+	spin_unlock(&g_event_lock);
+
+	wake_up_interruptible(&g_event_wait);
+	kill_fasync(&g_event_fasync, SIGIO, POLL_IN);
+}
+
+static int humble_events_pending(struct humble_listener *listener)
+{
+	int res;
+	spin_lock(&g_event_lock);
+	res = (listener->seq != g_head);
+	spin_unlock(&g_event_lock);
+	return res;
+}
+
+
+/*
+ *  Listeners start with the events posted after they have opened the file.
+ */
+int humble_events_open(struct file *filp)
+{
+	struct humble_listener *listener;
+
+	listener = kmalloc(sizeof(*listener), GFP_KERNEL);
+	if (!listener) {
+		return -ENOMEM;
+	}
+	spin_lock(&g_event_lock);
+	listener->seq = g_head;
+	spin_unlock(&g_event_lock);
+
+	filp->private_data = listener;
+	return 0;
+}
+
+void humble_events_release(struct file *filp)
+{
+	humble_events_fasync(-1, filp, 0);
+	kfree(filp->private_data);
+	filp->private_data = NULL;
+}
+
+/*
+ *  Reads as many whole event lines as fit into @size bytes:
+ *
+ *    H <ino>  the file has been hidden
+ *    U <ino>  the file has been unhidden (explicitly or on expiry)
+ *    D <ino>  the file has been unhidden after it had been deleted
+ *    L <ino>  the file has lost its parent and cannot be restored
+ *    C 0      all files have been unhidden
+ *    O <n>    n events have been missed because of the ring overflow
+ *
+ *  Blocks until there is at least one event unless the file is nonblocking.
+ */
+ssize_t humble_events_read(struct file *filp, char __user *buffer, size_t size)
+{
+	int err = 0;
+	char *kbuffer;
+	size_t kbuffer_len = 0;
+	size_t limit = min_t(size_t, size, PAGE_SIZE);
+	struct humble_listener *listener = filp->private_data;
+	struct humble_event *event;
+
+	if (limit < EVENT_LINE_MAX) {
+		return -EINVAL;
+	}
+	kbuffer = kmalloc(limit, GFP_KERNEL);
+	if (!kbuffer) {
+		return -ENOMEM;
+	}
+
+	while (!humble_events_pending(listener)) {
+		if (filp->f_flags & O_NONBLOCK) {
+			err = -EAGAIN;
+			goto out;
+		}
+		if (wait_event_interruptible(g_event_wait,
+		                             humble_events_pending(listener)))
+		{
+			err = -ERESTARTSYS;
+			goto out;
+		}
+	}
+
+	spin_lock(&g_event_lock);
+	if (g_head - listener->seq > EVENT_RING_SIZE) {
+		kbuffer_len += snprintf(kbuffer, EVENT_LINE_MAX, "O %llu\n",
+		                        g_head - listener->seq - EVENT_RING_SIZE);
+		listener->seq = g_head - EVENT_RING_SIZE;
+	}
+	while (listener->seq != g_head &&
+	       kbuffer_len + EVENT_LINE_MAX <= limit)
+	{
+		event = &g_ring[listener->seq & EVENT_RING_MASK];
+		kbuffer_len += snprintf(kbuffer + kbuffer_len, EVENT_LINE_MAX,
+		                        "%c %llu\n", event->type, event->ino);
+		listener->seq += 1;
+	}
+	spin_unlock(&g_event_lock);
+
+	if (copy_to_user(buffer, kbuffer, kbuffer_len)) {
+		err = -EFAULT;
+	}
+out:
+	kfree(kbuffer);
+	return err ? err : kbuffer_len;
+}
+
+unsigned int humble_events_poll(struct file *filp, poll_table *wait)
+{
+	struct humble_listener *listener = filp->private_data;
+
+	poll_wait(filp, &g_event_wait, wait);
+	if (humble_events_pending(listener)) {
+		return POLLIN | POLLRDNORM;
+	}
+	return 0;
+}
+
+int humble_events_fasync(int fd, struct file *filp, int on)
+{
+	return fasync_helper(fd, filp, on, &g_event_fasync);
+}
@@ -12,19 +12,44 @@ struct hash_entry_parent {
 	int                    hidden_cnt;
 };
 
+struct humble_group {
+	struct list_head         link;
+	struct hlist_head        members;
+
+	int                      id;
+	int                      enabled;
+	char                     name[HUMBLE_GROUP_NAME_MAX + 1];
+};
+
 struct hash_entry_file {
 	struct hlist_node        link;
+	struct hlist_node        name_link;
+	struct hlist_node        group_link;
+	struct hlist_node        expiry_link;
 
 	struct inode             *inode;
 	struct inode_operations  *old_iops;
 	struct file_operations   *old_fops;
 
 	struct hash_entry_parent *parent;
+	struct humble_group      *group;
+
+	u64                      expires;
+
+	unsigned int             name_hash;
+	unsigned int             name_len;
+	char                     name[0];
 };
 
 #define entry_file(lp)   (hlist_entry((lp), struct hash_entry_file,   link))
+#define entry_named(lp)  (hlist_entry((lp), struct hash_entry_file, name_link))
 #define entry_parent(lp) (hlist_entry((lp), struct hash_entry_parent, link))
+#define entry_member(lp) (hlist_entry((lp), struct hash_entry_file, group_link))
+#define entry_group(lp)  (list_entry((lp), struct humble_group, link))
+#define entry_timed(lp)  (hlist_entry((lp), struct hash_entry_file, expiry_link))
 #define get_bucket(hash, ino) ((hash) + hash_64((ino), HASH_BITS))
+#define get_name_bucket(hash, p_ino, name_hash) \
+        ((hash) + hash_64((p_ino) ^ ((u64) (name_hash) << 32), HASH_BITS))
 
 
 /*
@@ -38,6 +63,64 @@ static struct hlist_head g_humble_file_hash[HASH_BUCKET_COUNT];
 static struct hlist_head g_humble_parent_hash[HASH_BUCKET_COUNT];
 static DECLARE_RWSEM(g_hash_lock);
 
+/*
+ *  Reverse index of hidden files keyed by (parent ino, name), so that files
+ *  can be found by their paths without looking up the hidden dentries.
+ */
+static struct hlist_head g_humble_name_hash[HASH_BUCKET_COUNT];
+
+/*
+ *  Every hidden file belongs to a group. Disabled groups keep their files
+ *  in the hash with our methods installed, the methods just pretend to be
+ *  the original ones. This makes toggling a group a single flag flip.
+ *
+ *  The default group always exists and cannot be deleted.
+ */
+
+static struct humble_group g_default_group = {
+	.link    = LIST_HEAD_INIT(g_default_group.link),
+	.members = HLIST_HEAD_INIT,
+	.id      = HUMBLE_DEFAULT_GROUP,
+	.enabled = 1,
+	.name    = "default"
+};
+static LIST_HEAD(g_humble_groups);
+static int g_next_group_id = HUMBLE_DEFAULT_GROUP + 1;
+
+/*
+ *  Files hidden with a TTL are kept in a two-level timer wheel, measured in
+ *  EXPIRY_TICKs. The first level has a slot per tick, the second one has a
+ *  slot per revolution of the first level and is cascaded into it each time
+ *  the first level wraps. Files too far in the future are parked in the last
+ *  reachable second-level slot and reinserted when it is cascaded.
+ *
+ *  A single delayed work drives the wheel, releasing at most EXPIRY_BATCH
+ *  files per g_hash_lock acquisition. It runs only while there are timed
+ *  files in the hash.
+ */
+
+/* TTLs are given in seconds, so a tick has to be exactly one second */
+#define EXPIRY_TICK  HZ
+#define EXPIRY_BATCH 1024
+
+#define WHEEL_BITS  8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE ((u64) (WHEEL_SLOTS - 1) * WHEEL_SLOTS)
+
+static struct hlist_head g_wheel[2][WHEEL_SLOTS];
+static u64 g_wheel_clock;
+static int g_wheel_cascaded;
+static int g_timed_cnt;
+
+static void humble_expiry_work(struct work_struct *work);
+static DECLARE_DELAYED_WORK(g_expiry_work, humble_expiry_work);
+
+static inline u64 humble_expiry_now(void)
+{
+	return div_u64(get_jiffies_64(), EXPIRY_TICK);
+}
+
 static struct hash_entry_file* humble_get_file(u64 ino)
 {
 	struct hlist_node *node;
@@ -62,26 +145,247 @@ static struct hash_entry_parent* humble_get_parent(u64 ino)
 	return NULL;
 }
 
+static struct hash_entry_file* humble_get_file_by_name(u64 p_ino,
+                                                       const char *name,
+                                                       unsigned int len)
+{
+	struct hlist_node *node;
+	struct hash_entry_file *fentry;
+	unsigned int name_hash = full_name_hash(name, len);
+	struct hlist_head *bucket = get_name_bucket(g_humble_name_hash,
+	                                            p_ino, name_hash);
+	hlist_for_each(node, bucket) {
+		fentry = entry_named(node);
+		if (fentry->name_hash == name_hash &&
+		    fentry->name_len == len &&
+		    fentry->parent->inode->i_ino == p_ino &&
+		    !memcmp(fentry->name, name, len))
+		{
+			return fentry;
+		}
+	}
+	return NULL;
+}
+
+
+static struct humble_group* humble_get_group(int id)
+{
+	struct list_head *node;
+	if (id == HUMBLE_DEFAULT_GROUP) {
+		return &g_default_group;
+	}
+	list_for_each(node, &g_humble_groups) {
+		if (entry_group(node)->id == id) {
+			return entry_group(node);
+		}
+	}
+	return NULL;
+}
+
+/*
+ *  Restores the original methods of the file and frees its entry,
+ *  releasing the parent entry as well if it was the last hidden child.
+ *  Posts an event about it if @notify is set, telling a deleted file from
+ *  an unhidden one: the inode is freed by our iput() below, see humble.h.
+ */
+static void humble_release_file(struct hash_entry_file *fentry, int notify)
+{
+	struct hash_entry_parent *pentry = fentry->parent;
+	struct hash_entry_file *powner = NULL;
+
+	fentry->inode->i_op = fentry->old_iops;
+	fentry->inode->i_fop = fentry->old_fops;
+	hlist_del(&fentry->link);
+	hlist_del(&fentry->name_link);
+	hlist_del(&fentry->group_link);
+	if (!hlist_unhashed(&fentry->expiry_link)) {
+		hlist_del(&fentry->expiry_link);
+		g_timed_cnt -= 1;
+	}
+	if (notify) {
+		humble_event_post(fentry->inode->i_nlink ? HUMBLE_EVENT_UNHIDDEN
+		                                         : HUMBLE_EVENT_DELETED,
+		                  fentry->inode->i_ino);
+	}
+	iput(fentry->inode);
+	kfree(fentry);
+
+	if (pentry && --pentry->hidden_cnt == 0) {
+		/* Forced removals may leave a hidden parent, it will restore
+		 * the original fops itself when it gets unhidden */
+		powner = humble_get_file(pentry->inode->i_ino);
+		if (powner) {
+			if (pentry->inode->i_fop == powner->old_fops) {
+				pentry->inode->i_fop = pentry->old_fops;
+			}
+			powner->old_fops = pentry->old_fops;
+		} else {
+			pentry->inode->i_fop = pentry->old_fops;
+		}
+		hlist_del(&pentry->link);
+		iput(pentry->inode);
+		kfree(pentry);
+	}
+}
+
+static void humble_wheel_insert(struct hash_entry_file *fentry)
+{
+	u64 tick = fentry->expires;
+	struct hlist_head *slot = NULL;
+
+	if ((s64) (tick - g_wheel_clock) < 0) {
+		tick = g_wheel_clock;
+	}
+	if (tick - g_wheel_clock < WHEEL_SLOTS) {
+		slot = &g_wheel[0][tick & WHEEL_MASK];
+	} else {
+		if (tick - g_wheel_clock >= WHEEL_RANGE) {
+			tick = g_wheel_clock + WHEEL_RANGE - 1;
+		}
+		slot = &g_wheel[1][(tick >> WHEEL_BITS) & WHEEL_MASK];
+	}
+	hlist_add_head(&fentry->expiry_link, slot);
+}
+
+static void humble_wheel_cascade(void)
+{
+	struct hlist_node *node = NULL, *next = NULL;
+	struct hlist_head *slot = &g_wheel[1][(g_wheel_clock >> WHEEL_BITS)
+	                                      & WHEEL_MASK];
+	hlist_for_each_safe(node, next, slot) {
+		hlist_del(node);
+		humble_wheel_insert(entry_timed(node));
+	}
+}
+
+static void humble_expiry_work(struct work_struct *work)
+{
+	int budget = EXPIRY_BATCH;
+	u64 now = humble_expiry_now();
+	struct hlist_node *node = NULL, *next = NULL;
+	struct hlist_head *slot = NULL;
 
+	down_write(&g_hash_lock);
+	while ((s64) (now - g_wheel_clock) >= 0 && budget > 0) {
+		if ((g_wheel_clock & WHEEL_MASK) == 0 && !g_wheel_cascaded) {
+			humble_wheel_cascade();
+			g_wheel_cascaded = 1;
+		}
+		slot = &g_wheel[0][g_wheel_clock & WHEEL_MASK];
+		hlist_for_each_safe(node, next, slot) {
+			if (budget-- == 0) {
+				break;
+			}
+			humble_release_file(entry_timed(node), 1);
+		}
+		if (!hlist_empty(slot)) {
+			break;
+		}
+		g_wheel_clock += 1;
+		g_wheel_cascaded = 0;
+	}
+	if (g_timed_cnt > 0) {
+		if (budget <= 0) {
+			schedule_delayed_work(&g_expiry_work, 0);
+		} else {
+			schedule_delayed_work(&g_expiry_work, EXPIRY_TICK);
+		}
+	}
+	up_write(&g_hash_lock);
+}
+
+/*
+ *  Returns nonzero only for files that must be invisible right now,
+ *  i.e. files of enabled groups.
+ */
 int humble_hash_contains(u64 ino)
 {
 	int res;
+	struct hash_entry_file *fentry;
 	down_read(&g_hash_lock);
-	res = (humble_get_file(ino) != NULL);
+	fentry = humble_get_file(ino);
+	res = (fentry != NULL && fentry->group->enabled);
 	up_read(&g_hash_lock);
 	return res;
 }
 
-/*  Errors:
+/*  Fetches the original methods of a file whose group is disabled.
+ *
+ *  Errors:
+ *    -ENOENT  the file is hidden (or is not in the hash at all)
+ */
+int humble_hash_revealed_ops(u64 ino, struct inode_operations **iops,
+                             struct file_operations **fops)
+{
+	int err = 0;
+	struct hash_entry_file *fentry;
+
+	down_read(&g_hash_lock);
+	fentry = humble_get_file(ino);
+	if (!fentry || fentry->group->enabled) {
+		err = -ENOENT;
+		goto out;
+	}
+	if (iops) {
+		*iops = fentry->old_iops;
+	}
+	if (fops) {
+		*fops = fentry->old_fops;
+	}
+out:
+	up_read(&g_hash_lock);
+	return err;
+}
+
+/*  Looks up a hidden file by its parent and @name of @len bytes.
+ *
+ *  Errors:
+ *    -ENOENT  no such file in hash
+ */
+int humble_hash_lookup_name(u64 p_ino, const char *name, unsigned int len,
+                            u64 *ino)
+{
+	int err = 0;
+	struct hash_entry_file *fentry;
+
+	down_read(&g_hash_lock);
+	fentry = humble_get_file_by_name(p_ino, name, len);
+	if (!fentry) {
+		err = -ENOENT;
+		goto out;
+	}
+	if (ino != NULL) {
+		*ino = fentry->inode->i_ino;
+	}
+out:
+	up_read(&g_hash_lock);
+	return err;
+}
+
+/*  Adds the file named @name (of @len bytes) to the hash. It is released
+ *  automatically after @ttl seconds unless @ttl is zero.
+ *
+ *  The parent gets the filtering methods wrapping its original ones. If it
+ *  is hidden itself, it keeps its hidden methods and the filtering ones are
+ *  what it gets back when it is unhidden. Either way the parent entry holds
+ *  the original methods.
+ *
+ *  Errors:
  *    -EEXIST  the inode is already hidden
  *    -ENOMEM  could not allocate enough memory
+ *    -ESRCH   no such group
  */
-int humble_hash_add(struct inode *f_inode, struct inode *p_inode)
+int humble_hash_add(struct inode *f_inode, struct inode *p_inode,
+                    const char *name, unsigned int len,
+                    int group, unsigned int ttl)
 {
 	int err = 0;
 	struct hlist_head *bucket = NULL;
 	struct hash_entry_parent *pentry = NULL;
 	struct hash_entry_file *fentry = NULL;
+	struct hash_entry_file *powner = NULL;
+	struct humble_group *gentry = NULL;
+	struct file_operations *filtering_fops = NULL;
 	int release_p = 0;
 
 	down_write(&g_hash_lock);
@@ -89,11 +393,23 @@ int humble_hash_add(struct inode *f_inode, struct inode *p_inode)
 		err = -EEXIST;
 		goto out;
 	}
+	gentry = humble_get_group(group);
+	if (!gentry) {
+		err = -ESRCH;
+		goto out;
+	}
 
 	pentry = humble_get_parent(p_inode->i_ino);
 	if (pentry) {
 		pentry->hidden_cnt += 1;
 	} else {
+		powner = humble_get_file(p_inode->i_ino);
+		filtering_fops = humble_wrap_fops(powner ? powner->old_fops
+		                                         : p_inode->i_fop);
+		if (!filtering_fops) {
+			err = -ENOMEM;
+			goto out;
+		}
 		pentry = kmalloc(sizeof(*pentry), GFP_KERNEL);
 		if (!pentry) {
 			err = -ENOMEM;
@@ -103,7 +419,7 @@ int humble_hash_add(struct inode *f_inode, struct inode *p_inode)
 		INIT_HLIST_NODE(&pentry->link);
 		pentry->inode = p_inode;
 		ihold(p_inode);
-		pentry->old_fops = p_inode->i_fop;
+		pentry->old_fops = powner ? powner->old_fops : p_inode->i_fop;
 		pentry->hidden_cnt = 1;
 		release_p = 1;
 
@@ -111,29 +427,64 @@ int humble_hash_add(struct inode *f_inode, struct inode *p_inode)
 		hlist_add_head(&pentry->link, bucket);
 	}
 
-	fentry = kmalloc(sizeof(*fentry), GFP_KERNEL);
+	fentry = kmalloc(sizeof(*fentry) + len + 1, GFP_KERNEL);
 	if (!fentry) {
 		err = -ENOMEM;
 		goto nomem;
 	}
 
 	INIT_HLIST_NODE(&fentry->link);
+	INIT_HLIST_NODE(&fentry->name_link);
+	INIT_HLIST_NODE(&fentry->group_link);
+	INIT_HLIST_NODE(&fentry->expiry_link);
 	fentry->inode = f_inode;
 	ihold(f_inode);
 	fentry->old_iops = f_inode->i_op;
 	fentry->old_fops = f_inode->i_fop;
 	fentry->parent = pentry;
+	fentry->group = gentry;
+	fentry->expires = 0;
+	fentry->name_hash = full_name_hash(name, len);
+	fentry->name_len = len;
+	memcpy(fentry->name, name, len);
+	fentry->name[len] = '\0';
 
 	bucket = get_bucket(g_humble_file_hash, f_inode->i_ino);
 	hlist_add_head(&fentry->link, bucket);
+	bucket = get_name_bucket(g_humble_name_hash,
+	                         p_inode->i_ino, fentry->name_hash);
+	hlist_add_head(&fentry->name_link, bucket);
+	hlist_add_head(&fentry->group_link, &gentry->members);
+	if (powner) {
+		/* Hidden for listings only, the methods are intact */
+		if (p_inode->i_fop == powner->old_fops) {
+			p_inode->i_fop = filtering_fops;
+		}
+		powner->old_fops = filtering_fops;
+	} else if (filtering_fops) {
+		p_inode->i_fop = filtering_fops;
+	}
+	humble_event_post(HUMBLE_EVENT_HIDDEN, f_inode->i_ino);
+
+	if (ttl > 0) {
+		if (g_timed_cnt++ == 0) {
+			g_wheel_clock = humble_expiry_now();
+			g_wheel_cascaded = 1;
+			schedule_delayed_work(&g_expiry_work, EXPIRY_TICK);
+		}
+		fentry->expires = humble_expiry_now() + ttl;
+		humble_wheel_insert(fentry);
+	}
 
 	goto out;
 nomem:
 	if (release_p) {
+		hlist_del(&pentry->link);
 		iput(p_inode);
+		kfree(pentry);
+	} else if (pentry) {
+		pentry->hidden_cnt -= 1;
 	}
-	kfree(fentry);
-	kfree(pentry);
 out:
 	up_write(&g_hash_lock);
 	return err;
@@ -160,6 +511,7 @@ int humble_hash_remove(u64 ino)
 	pentry = fentry->parent;
 	if (!pentry) {
 		PRcritical("File #%lld has lost its parent\n", ino);
+		humble_event_post(HUMBLE_EVENT_LOST_PARENT, ino);
 		err = -EBADF;
 		goto out;
 	}
@@ -167,19 +519,7 @@ int humble_hash_remove(u64 ino)
 		err = -ENOTEMPTY;
 		goto out;
 	}
-
-	fentry->inode->i_op = fentry->old_iops;
-	fentry->inode->i_fop = fentry->old_fops;
-	hlist_del(&fentry->link);
-	iput(fentry->inode);
-	kfree(fentry);
-
-	if (--pentry->hidden_cnt == 0) {
-		pentry->inode->i_fop = pentry->old_fops;
-		hlist_del(&pentry->link);
-		iput(pentry->inode);
-		kfree(pentry);
-	}
+	humble_release_file(fentry, 1);
 out:
 	up_write(&g_hash_lock);
 	return err;
@@ -190,7 +530,6 @@ int humble_hash_clear(void)
 	int err = 0;
 	struct hlist_node *node = NULL, *next = NULL;
 	struct hlist_head *bucket = NULL;
-	struct hash_entry_file *fentry = NULL;
 	struct hash_entry_parent *pentry = NULL;
 
 	down_write(&g_hash_lock);
@@ -199,12 +538,7 @@ int humble_hash_clear(void)
 	     ++bucket)
 	{
 		hlist_for_each_safe(node, next, bucket) {
-			fentry = entry_file(node);
-			fentry->inode->i_op = fentry->old_iops;
-			fentry->inode->i_fop = fentry->old_fops;
-			hlist_del(node);
-			iput(fentry->inode);
-			kfree(fentry);
+			humble_release_file(entry_file(node), 0);
 		}
 	}
 	for (bucket = g_humble_parent_hash;
@@ -219,6 +553,212 @@ int humble_hash_clear(void)
 			kfree(pentry);
 		}
 	}
+	g_timed_cnt = 0;
+	humble_event_post(HUMBLE_EVENT_CLEARED, 0);
+	up_write(&g_hash_lock);
+	return err;
+}
+
+/*
+ *  Stops the expiry work. Must be called before unloading the module.
+ */
+void humble_hash_shutdown(void)
+{
+	cancel_delayed_work_sync(&g_expiry_work);
+}
+
+
+/*  Errors:
+ *    -EINVAL  the name is empty or too long
+ *    -EEXIST  a group with this name already exists
+ *    -ENOMEM  could not allocate enough memory
+ */
+int humble_group_create(const char *name, int *id)
+{
+	int err = 0;
+	size_t len = strlen(name);
+	struct list_head *node = NULL;
+	struct humble_group *gentry = NULL;
+
+	if (len == 0 || len > HUMBLE_GROUP_NAME_MAX) {
+		return -EINVAL;
+	}
+
+	down_write(&g_hash_lock);
+	if (!strcmp(g_default_group.name, name)) {
+		err = -EEXIST;
+		goto out;
+	}
+	list_for_each(node, &g_humble_groups) {
+		if (!strcmp(entry_group(node)->name, name)) {
+			err = -EEXIST;
+			goto out;
+		}
+	}
+
+	gentry = kmalloc(sizeof(*gentry), GFP_KERNEL);
+	if (!gentry) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	INIT_LIST_HEAD(&gentry->link);
+	INIT_HLIST_HEAD(&gentry->members);
+	gentry->id = g_next_group_id++;
+	gentry->enabled = 1;
+	strcpy(gentry->name, name);
+	list_add_tail(&gentry->link, &g_humble_groups);
+
+	if (id != NULL) {
+		*id = gentry->id;
+	}
+out:
+	up_write(&g_hash_lock);
+	return err;
+}
+
+/*
+ *  Unhides every member of the group and forgets the group itself.
+ *  Members are removed forcibly, regardless of their parents' state,
+ *  just like humble_hash_clear() does.
+ *
+ *  Errors:
+ *    -ESRCH  no such group
+ *    -EPERM  the default group cannot be deleted
+ */
+int humble_group_delete(int id, int *count)
+{
+	int err = 0;
+	int removed = 0;
+	struct hlist_node *node = NULL, *next = NULL;
+	struct humble_group *gentry = NULL;
+
+	if (id == HUMBLE_DEFAULT_GROUP) {
+		return -EPERM;
+	}
+
+	down_write(&g_hash_lock);
+	gentry = humble_get_group(id);
+	if (!gentry) {
+		err = -ESRCH;
+		goto out;
+	}
+	hlist_for_each_safe(node, next, &gentry->members) {
+		humble_release_file(entry_member(node), 1);
+		removed += 1;
+	}
+	list_del(&gentry->link);
+	kfree(gentry);
+
+	if (count != NULL) {
+		*count = removed;
+	}
+out:
 	up_write(&g_hash_lock);
 	return err;
 }
+
+/*  Errors:
+ *    -ESRCH  no such group
+ */
+int humble_group_enable(int id, int enabled)
+{
+	int err = 0;
+	struct humble_group *gentry = NULL;
+
+	down_write(&g_hash_lock);
+	gentry = humble_get_group(id);
+	if (!gentry) {
+		err = -ESRCH;
+		goto out;
+	}
+	gentry->enabled = !!enabled;
+out:
+	up_write(&g_hash_lock);
+	return err;
+}
+
+int humble_group_exists(int id)
+{
+	int res;
+	down_read(&g_hash_lock);
+	res = (humble_get_group(id) != NULL);
+	up_read(&g_hash_lock);
+	return res;
+}
+
+
+#ifdef HUMBLE_SELFTEST
+/*
+ *  Checks that the tables agree with each other: every file can be found
+ *  by its inode and by its name, its parent entry is in the parent hash
+ *  and counts exactly the files pointing to it. Returns the number of
+ *  problems found.
+ */
+int humble_hash_check(void)
+{
+	int problems = 0;
+	int counted;
+	struct hlist_node *node = NULL, *fnode = NULL;
+	struct hlist_head *bucket = NULL, *fbucket = NULL;
+	struct hash_entry_file *fentry = NULL;
+	struct hash_entry_parent *pentry = NULL;
+
+	down_read(&g_hash_lock);
+	for (bucket = g_humble_file_hash;
+	     bucket < g_humble_file_hash + HASH_BUCKET_COUNT;
+	     ++bucket)
+	{
+		hlist_for_each(node, bucket) {
+			fentry = entry_file(node);
+			pentry = fentry->parent;
+			if (humble_get_file(fentry->inode->i_ino) != fentry) {
+				PRerror("File #%lu is in a wrong bucket\n",
+				        fentry->inode->i_ino);
+				problems += 1;
+			}
+			if (!pentry ||
+			    humble_get_parent(pentry->inode->i_ino) != pentry)
+			{
+				PRerror("File #%lu has a stray parent\n",
+				        fentry->inode->i_ino);
+				problems += 1;
+				continue;
+			}
+			if (humble_get_file_by_name(pentry->inode->i_ino,
+			                            fentry->name,
+			                            fentry->name_len) != fentry)
+			{
+				PRerror("File #%lu cannot be found by name\n",
+				        fentry->inode->i_ino);
+				problems += 1;
+			}
+		}
+	}
+	for (bucket = g_humble_parent_hash;
+	     bucket < g_humble_parent_hash + HASH_BUCKET_COUNT;
+	     ++bucket)
+	{
+		hlist_for_each(node, bucket) {
+			pentry = entry_parent(node);
+			counted = 0;
+			for (fbucket = g_humble_file_hash;
+			     fbucket < g_humble_file_hash + HASH_BUCKET_COUNT;
+			     ++fbucket)
+			{
+				hlist_for_each(fnode, fbucket) {
+					counted += (entry_file(fnode)->parent == pentry);
+				}
+			}
+			if (counted == 0 || counted != pentry->hidden_cnt) {
+				PRerror("Parent #%lu counts %d files, has %d\n",
+				        pentry->inode->i_ino,
+				        pentry->hidden_cnt, counted);
+				problems += 1;
+			}
+		}
+	}
+	up_read(&g_hash_lock);
+	return problems;
+}
+#endif
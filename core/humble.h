@@ -4,14 +4,23 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/errno.h>
+#include <linux/exportfs.h>
+#include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/hash.h>
+#include <linux/jiffies.h>
 #include <linux/kernel.h>
+#include <linux/kfifo.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/namei.h>
+#include <linux/poll.h>
 #include <linux/rwsem.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <asm-generic/uaccess.h>
 
 #define MODULE_NAME "Humble"
@@ -31,16 +40,73 @@
 
 /* Hashtable */
 int humble_hash_contains(u64 ino);
-int humble_hash_add(struct inode *file, struct inode *dir);
+int humble_hash_revealed_ops(u64 ino, struct inode_operations **iops,
+                             struct file_operations **fops);
+int humble_hash_lookup_name(u64 p_ino, const char *name, unsigned int len,
+                            u64 *ino);
+int humble_hash_add(struct inode *file, struct inode *dir,
+                    const char *name, unsigned int len,
+                    int group, unsigned int ttl);
 int humble_hash_remove(u64 ino);
 int humble_hash_clear(void);
+void humble_hash_shutdown(void);
+
+/* Groups */
+#define HUMBLE_DEFAULT_GROUP  0
+#define HUMBLE_GROUP_NAME_MAX 31
+
+int humble_group_create(const char *name, int *id);
+int humble_group_delete(int id, int *count);
+int humble_group_enable(int id, int enabled);
+int humble_group_exists(int id);
 
 /* Clandestine */
-int humble_hide_file(const char *path, u64 *ino);
+int humble_hide_dentry(struct dentry *dentry, int group, unsigned int ttl,
+                       int listing_only, u64 *ino);
+int humble_hide_file(const char *path, int group, unsigned int ttl, u64 *ino);
+int humble_hide_fd(unsigned int fd, int group, unsigned int ttl, u64 *ino);
+int humble_hide_handle(unsigned int mount_fd, struct file_handle *handle,
+                       int group, unsigned int ttl, u64 *ino);
 int humble_unhide_file(u64 ino);
+int humble_unhide_path(const char *path, u64 *ino);
+int humble_lookup_hidden(const char *path, u64 *ino);
+struct file_operations* humble_wrap_fops(struct file_operations *original);
+void humble_fops_cleanup(void);
+
+/* Rules */
+int humble_rule_add(const char *path, const char *pattern,
+                    int group, unsigned int ttl, u64 *ino);
+int humble_rule_remove(const char *path, u64 *ino);
+void humble_rules_cleanup(void);
+
+/* Events
+ *
+ * The hash pins every hidden inode, so unlinking the last name of a hidden
+ * file does not free it: the deletion only completes once the file leaves
+ * the hidden set. HUMBLE_EVENT_DELETED is posted at that point, in place of
+ * HUMBLE_EVENT_UNHIDDEN, rather than at unlink time.
+ */
+#define HUMBLE_EVENT_HIDDEN      'H'
+#define HUMBLE_EVENT_UNHIDDEN    'U'
+#define HUMBLE_EVENT_DELETED     'D'
+#define HUMBLE_EVENT_LOST_PARENT 'L'
+#define HUMBLE_EVENT_CLEARED     'C'
+
+void humble_event_post(char type, u64 ino);
+int humble_events_open(struct file *filp);
+void humble_events_release(struct file *filp);
+ssize_t humble_events_read(struct file *filp, char __user *buffer, size_t size);
+unsigned int humble_events_poll(struct file *filp, poll_table *wait);
+int humble_events_fasync(int fd, struct file *filp, int on);
 
 /* Character device */
 int humble_devfile_startup_once(void);
 void humble_devfile_cleanup_once(void);
 
+/* Selftest, see selftest.c */
+#ifdef HUMBLE_SELFTEST
+int humble_hash_check(void);
+int humble_selftest(void);
+#endif
+
 #endif
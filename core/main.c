@@ -1,10 +1,25 @@
 #include "humble.h"
 
+#ifdef HUMBLE_SELFTEST
+static int selftest;
+module_param(selftest, int, 0);
+MODULE_PARM_DESC(selftest, "Stress test the hidden-set core before loading");
+#endif
+
 static int __init humble_init(void)
 {
 	int err = 0;
 
 	PRinfo("Loading");
+#ifdef HUMBLE_SELFTEST
+	if (selftest) {
+		err = humble_selftest();
+		if (err) {
+			PRcritical("Selftest failed\n");
+			return err;
+		}
+	}
+#endif
 	err = humble_devfile_startup_once();
 	if (err) {
 		PRcritical("Could not create a control device file\n");
@@ -14,9 +29,12 @@ static int __init humble_init(void)
 
 static void __exit humble_exit(void)
 {
+	humble_hash_shutdown();
 	if (humble_hash_clear()) {
 		PRcritical("Could not unhide remaining files\n");
 	}
+	humble_rules_cleanup();
+	humble_fops_cleanup();
 	humble_devfile_cleanup_once();
 	PRinfo("Unloaded");
 }
@@ -0,0 +1,431 @@
+#include "humble.h"
+
+/*
+ *  Auto-hide rules. A watched directory gets its inode operations replaced
+ *  with a copy of the original table where the methods creating new entries
+ *  are wrapped. Once the original method succeeds, the new name is matched
+ *  against the rules of the directory and the file is hidden right away,
+ *  before anyone else can see it.
+ *
+ *  Such files are hidden from listings only: the process which has just
+ *  created the file must still be able to open and write it.
+ */
+
+#define RULES_HASH_BITS 6
+#define RULES_BUCKET_COUNT (1 << RULES_HASH_BITS)
+
+#define RULE_PATTERN_MAX 63
+
+struct humble_rule {
+	struct list_head        link;
+
+	int                     group;
+	unsigned int            ttl;
+	char                    pattern[RULE_PATTERN_MAX + 1];
+};
+
+struct watched_dir {
+	struct hlist_node       link;
+
+	struct inode            *inode;
+	struct inode_operations *old_iops;
+	struct inode_operations *wrapped_iops;
+
+	struct list_head        rules;
+};
+
+/*
+ *  Wrapped tables are shared by all watched directories with the same
+ *  original table. They are never freed until the module is unloaded,
+ *  as some task may still be running a wrapper when the rules are removed.
+ */
+struct wrapped_iops {
+	struct list_head        link;
+
+	struct inode_operations *original;
+	struct inode_operations ops;
+};
+
+#define entry_rule(lp)    (list_entry((lp), struct humble_rule, link))
+#define entry_watched(lp) (hlist_entry((lp), struct watched_dir, link))
+#define entry_wrapped(lp) (list_entry((lp), struct wrapped_iops, link))
+#define get_bucket(hash, ino) ((hash) + hash_64((ino), RULES_HASH_BITS))
+
+static struct hlist_head g_watched_hash[RULES_BUCKET_COUNT];
+static LIST_HEAD(g_wrapped_iops);
+static DECLARE_RWSEM(g_rules_lock);
+
+
+static struct watched_dir* humble_get_watched(u64 ino)
+{
+	struct hlist_node *node;
+	struct hlist_head *bucket = get_bucket(g_watched_hash, ino);
+	hlist_for_each(node, bucket) {
+		if (entry_watched(node)->inode->i_ino == ino) {
+			return entry_watched(node);
+		}
+	}
+	return NULL;
+}
+
+/*
+ *  Shell-style matching of `*' and `?'.
+ */
+static int humble_glob_match(const char *pattern, const char *name)
+{
+	const char *star = NULL;
+	const char *backtrack = NULL;
+
+	while (*name) {
+		if (*pattern == '*') {
+			star = ++pattern;
+			backtrack = name;
+		} else if (*pattern == '?' || *pattern == *name) {
+			++pattern;
+			++name;
+		} else if (star) {
+			pattern = star;
+			name = ++backtrack;
+		} else {
+			return 0;
+		}
+	}
+	while (*pattern == '*') {
+		++pattern;
+	}
+	return *pattern == '\0';
+}
+
+/*
+ *  The rules may be removed while a wrapper is running, so the directory
+ *  can have its original table back (or even be hidden) by now.
+ */
+static struct inode_operations* original_iops(struct inode *dir)
+{
+	struct list_head *node;
+	struct watched_dir *watched;
+	struct inode_operations *iops = (struct inode_operations *) dir->i_op;
+
+	down_read(&g_rules_lock);
+	watched = humble_get_watched(dir->i_ino);
+	if (watched) {
+		iops = watched->old_iops;
+		goto out;
+	}
+	list_for_each(node, &g_wrapped_iops) {
+		if (&entry_wrapped(node)->ops == iops) {
+			iops = entry_wrapped(node)->original;
+			goto out;
+		}
+	}
+out:
+	up_read(&g_rules_lock);
+	return iops;
+}
+
+static void humble_apply_rules(struct inode *dir, struct dentry *dentry)
+{
+	struct list_head *node;
+	struct watched_dir *watched;
+	struct humble_rule *rule;
+	int matched = 0;
+	int group = HUMBLE_DEFAULT_GROUP;
+	unsigned int ttl = 0;
+
+	if (!dentry->d_inode) {
+		return;
+	}
+
+	down_read(&g_rules_lock);
+	watched = humble_get_watched(dir->i_ino);
+	if (watched) {
+		list_for_each(node, &watched->rules) {
+			rule = entry_rule(node);
+			if (humble_glob_match(rule->pattern, dentry->d_name.name)) {
+				matched = 1;
+				group = rule->group;
+				ttl = rule->ttl;
+				break;
+			}
+		}
+	}
+	up_read(&g_rules_lock);
+
+	if (matched) {
+		if (humble_hide_dentry(dentry, group, ttl, 1, NULL)) {
+			PRnotice("Could not auto-hide %s\n", dentry->d_name.name);
+		}
+	}
+}
+
+static int watched_create(struct inode *dir, struct dentry *dentry,
+                          umode_t mode, bool excl)
+{
+	int err;
+	struct inode_operations *iops = original_iops(dir);
+	if (!iops->create) {
+		return -ENOENT;
+	}
+	err = iops->create(dir, dentry, mode, excl);
+	if (!err) {
+		humble_apply_rules(dir, dentry);
+	}
+	return err;
+}
+
+static int watched_mkdir(struct inode *dir, struct dentry *dentry, umode_t mode)
+{
+	int err;
+	struct inode_operations *iops = original_iops(dir);
+	if (!iops->mkdir) {
+		return -ENOENT;
+	}
+	err = iops->mkdir(dir, dentry, mode);
+	if (!err) {
+		humble_apply_rules(dir, dentry);
+	}
+	return err;
+}
+
+static int watched_mknod(struct inode *dir, struct dentry *dentry,
+                         umode_t mode, dev_t dev)
+{
+	int err;
+	struct inode_operations *iops = original_iops(dir);
+	if (!iops->mknod) {
+		return -ENOENT;
+	}
+	err = iops->mknod(dir, dentry, mode, dev);
+	if (!err) {
+		humble_apply_rules(dir, dentry);
+	}
+	return err;
+}
+
+static int watched_symlink(struct inode *dir, struct dentry *dentry,
+                           const char *target)
+{
+	int err;
+	struct inode_operations *iops = original_iops(dir);
+	if (!iops->symlink) {
+		return -ENOENT;
+	}
+	err = iops->symlink(dir, dentry, target);
+	if (!err) {
+		humble_apply_rules(dir, dentry);
+	}
+	return err;
+}
+
+static int watched_link(struct dentry *old_dentry, struct inode *dir,
+                        struct dentry *dentry)
+{
+	int err;
+	struct inode_operations *iops = original_iops(dir);
+	if (!iops->link) {
+		return -ENOENT;
+	}
+	err = iops->link(old_dentry, dir, dentry);
+	if (!err) {
+		humble_apply_rules(dir, dentry);
+	}
+	return err;
+}
+
+/*
+ *  Finds or makes a wrapped copy of @original. Only the methods which
+ *  the original table has are wrapped, the rest is copied as is.
+ */
+static struct inode_operations* humble_wrap_iops(struct inode_operations *original)
+{
+	struct list_head *node;
+	struct wrapped_iops *wrapped;
+
+	list_for_each(node, &g_wrapped_iops) {
+		if (entry_wrapped(node)->original == original) {
+			return &entry_wrapped(node)->ops;
+		}
+	}
+
+	wrapped = kmalloc(sizeof(*wrapped), GFP_KERNEL);
+	if (!wrapped) {
+		return NULL;
+	}
+	INIT_LIST_HEAD(&wrapped->link);
+	wrapped->original = original;
+	wrapped->ops = *original;
+	if (original->create)  wrapped->ops.create  = watched_create;
+	if (original->mkdir)   wrapped->ops.mkdir   = watched_mkdir;
+	if (original->mknod)   wrapped->ops.mknod   = watched_mknod;
+	if (original->symlink) wrapped->ops.symlink = watched_symlink;
+	if (original->link)    wrapped->ops.link    = watched_link;
+	list_add(&wrapped->link, &g_wrapped_iops);
+
+	return &wrapped->ops;
+}
+
+static void humble_unwatch(struct watched_dir *watched)
+{
+	struct list_head *node = NULL, *next = NULL;
+
+	list_for_each_safe(node, next, &watched->rules) {
+		list_del(node);
+		kfree(entry_rule(node));
+	}
+	watched->inode->i_op = watched->old_iops;
+	hlist_del(&watched->link);
+	iput(watched->inode);
+	kfree(watched);
+}
+
+
+/*
+ *  Hides new files matching @pattern in the directory at @path.
+ *
+ *  Errors:
+ *    -EINVAL   the pattern is empty or too long
+ *    -ENOTDIR  the path is not a directory
+ *    -EPERM    the directory is a mount point
+ *    -EBUSY    the directory is hidden
+ *    -ENOMEM   could not allocate enough memory
+ */
+int humble_rule_add(const char *path, const char *pattern,
+                    int group, unsigned int ttl, u64 *ino)
+{
+	int err = 0;
+	struct path dir;
+	struct inode *inode;
+	struct watched_dir *watched = NULL;
+	struct humble_rule *rule = NULL;
+	size_t len = strlen(pattern);
+
+	if (len == 0 || len > RULE_PATTERN_MAX) {
+		return -EINVAL;
+	}
+	err = kern_path(path, LOOKUP_DIRECTORY, &dir);
+	if (err) {
+		return err;
+	}
+	inode = dir.dentry->d_inode;
+	if (inode->i_sb->s_root->d_inode == inode) {
+		err = -EPERM;
+		goto out_path;
+	}
+
+	rule = kmalloc(sizeof(*rule), GFP_KERNEL);
+	if (!rule) {
+		err = -ENOMEM;
+		goto out_path;
+	}
+	INIT_LIST_HEAD(&rule->link);
+	rule->group = group;
+	rule->ttl = ttl;
+	strcpy(rule->pattern, pattern);
+
+	down_write(&g_rules_lock);
+	watched = humble_get_watched(inode->i_ino);
+	if (!watched) {
+		if (humble_hash_contains(inode->i_ino) ||
+		    !humble_hash_revealed_ops(inode->i_ino, NULL, NULL))
+		{
+			err = -EBUSY;
+			goto out_nomem;
+		}
+		watched = kmalloc(sizeof(*watched), GFP_KERNEL);
+		if (!watched) {
+			err = -ENOMEM;
+			goto out_nomem;
+		}
+		watched->wrapped_iops = humble_wrap_iops(
+		                        (struct inode_operations *) inode->i_op);
+		if (!watched->wrapped_iops) {
+			kfree(watched);
+			err = -ENOMEM;
+			goto out_nomem;
+		}
+		INIT_HLIST_NODE(&watched->link);
+		INIT_LIST_HEAD(&watched->rules);
+		watched->inode = inode;
+		ihold(inode);
+		watched->old_iops = (struct inode_operations *) inode->i_op;
+		hlist_add_head(&watched->link,
+		               get_bucket(g_watched_hash, inode->i_ino));
+		inode->i_op = watched->wrapped_iops;
+	}
+	list_add_tail(&rule->link, &watched->rules);
+	rule = NULL;
+
+	if (ino != NULL) {
+		*ino = inode->i_ino;
+	}
+out_nomem:
+	up_write(&g_rules_lock);
+	kfree(rule);
+out_path:
+	path_put(&dir);
+	return err;
+}
+
+/*
+ *  Drops all rules of the directory at @path.
+ *
+ *  Errors:
+ *    -ENOENT  the directory has no rules
+ *    -EBUSY   the directory has been hidden since, unhide it first
+ */
+int humble_rule_remove(const char *path, u64 *ino)
+{
+	int err = 0;
+	struct path dir;
+	struct watched_dir *watched;
+
+	err = kern_path(path, LOOKUP_DIRECTORY, &dir);
+	if (err) {
+		return err;
+	}
+
+	down_write(&g_rules_lock);
+	watched = humble_get_watched(dir.dentry->d_inode->i_ino);
+	if (!watched) {
+		err = -ENOENT;
+		goto out;
+	}
+	if (watched->inode->i_op != watched->wrapped_iops) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (ino != NULL) {
+		*ino = watched->inode->i_ino;
+	}
+	humble_unwatch(watched);
+out:
+	up_write(&g_rules_lock);
+	path_put(&dir);
+	return err;
+}
+
+/*
+ *  Drops all the rules and frees the wrapped tables. The hash must be
+ *  cleared before, so that no hidden directory refers to a wrapped table.
+ */
+void humble_rules_cleanup(void)
+{
+	struct hlist_node *node = NULL, *next = NULL;
+	struct list_head *lnode = NULL, *lnext = NULL;
+	struct hlist_head *bucket = NULL;
+
+	down_write(&g_rules_lock);
+	for (bucket = g_watched_hash;
+	     bucket < g_watched_hash + RULES_BUCKET_COUNT;
+	     ++bucket)
+	{
+		hlist_for_each_safe(node, next, bucket) {
+			humble_unwatch(entry_watched(node));
+		}
+	}
+	list_for_each_safe(lnode, lnext, &g_wrapped_iops) {
+		list_del(lnode);
+		kfree(entry_wrapped(lnode));
+	}
+	up_write(&g_rules_lock);
+}
@@ -0,0 +1,427 @@
+#include "humble.h"
+
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+/*
+ *  Stress test of the hidden-set core, built only with `make SELFTEST=1'
+ *  and run on load with `insmod humble.ko selftest=1'. The module refuses
+ *  to load if anything is wrong.
+ *
+ *  Every round mutator threads hide and unhide files of their own under
+ *  shared parents, in random order, while reader threads keep looking up
+ *  random inodes and time it. Once the mutators are done the hash is
+ *  checked against what they believe is hidden, then it is cleared under
+ *  the readers' feet and every inode must have its methods back.
+ *
+ *  Methods are swapped the way humble_hide_dentry() does, after the file
+ *  is in the hash, so parent restoration is tested as it really happens.
+ */
+
+#define ST_ROUNDS   8
+#define ST_MUTATORS 4
+#define ST_READERS  4
+#define ST_PARENTS  16
+#define ST_FILES    4096   /* per mutator */
+#define ST_OPS      32768  /* per mutator per round */
+#define ST_SAMPLES  65536  /* per reader */
+
+struct st_file {
+	struct inode inode;
+	int          parent;
+	int          hidden;
+	char         name[16];
+};
+
+struct st_thread {
+	struct completion done;
+	int               id;
+	u32               rnd;
+	int               failed;
+	u64               *samples;
+	int               sample_cnt;
+};
+
+static struct inode *g_st_parents;
+static struct st_file *g_st_files;
+static volatile int g_st_stop;
+static volatile int g_st_timing;
+
+/* Tables standing for the original methods and for ours */
+static struct file_operations g_st_original_fops;
+static struct inode_operations g_st_original_iops;
+/* What humble_hash_add() gives the parents of hidden files */
+static struct file_operations *g_st_filtering_fops;
+static struct file_operations g_st_notfound_fops;
+static struct inode_operations g_st_notfound_iops;
+
+/* xorshift32, each thread has its own state */
+static u32 st_random(struct st_thread *t)
+{
+	t->rnd ^= t->rnd << 13;
+	t->rnd ^= t->rnd >> 17;
+	t->rnd ^= t->rnd << 5;
+	return t->rnd;
+}
+
+static void st_init_inode(struct inode *inode, unsigned long ino, umode_t mode)
+{
+	inode_init_once(inode);
+	atomic_set(&inode->i_count, 1);
+	inode->i_ino = ino;
+	inode->i_mode = mode;
+	inode->i_nlink = 1;
+	inode->i_op = &g_st_original_iops;
+	inode->i_fop = &g_st_original_fops;
+}
+
+static int st_mutator(void *data)
+{
+	int i, err;
+	struct st_thread *t = data;
+	struct st_file *files = g_st_files + t->id * ST_FILES;
+	struct st_file *file;
+	struct inode *parent;
+
+	for (i = 0; i < ST_OPS && !t->failed; ++i) {
+		file = &files[st_random(t) % ST_FILES];
+		parent = &g_st_parents[file->parent];
+		if (!file->hidden) {
+			err = humble_hash_add(&file->inode, parent, file->name,
+			                      strlen(file->name),
+			                      HUMBLE_DEFAULT_GROUP, 0);
+			if (err) {
+				PRerror("selftest: adding #%lu failed: %d\n",
+				        file->inode.i_ino, err);
+				t->failed = 1;
+				break;
+			}
+			file->inode.i_op = &g_st_notfound_iops;
+			file->inode.i_fop = &g_st_notfound_fops;
+			file->hidden = 1;
+		} else if (st_random(t) & 1) {
+			err = humble_hash_remove(file->inode.i_ino);
+			if (err) {
+				PRerror("selftest: removing #%lu failed: %d\n",
+				        file->inode.i_ino, err);
+				t->failed = 1;
+				break;
+			}
+			file->hidden = 0;
+		} else if (!humble_hash_contains(file->inode.i_ino)) {
+			PRerror("selftest: #%lu got lost\n", file->inode.i_ino);
+			t->failed = 1;
+		}
+		if ((i & 1023) == 0) {
+			cond_resched();
+		}
+	}
+	complete(&t->done);
+	return 0;
+}
+
+static int st_reader(void *data)
+{
+	struct st_thread *t = data;
+	int total = ST_MUTATORS * ST_FILES;
+	u64 ino, start, end;
+	int i = 0;
+
+	while (!g_st_stop) {
+		/* One lookup in eight is for an inode that is never hidden */
+		ino = g_st_files[st_random(t) % total].inode.i_ino;
+		if ((st_random(t) & 7) == 0) {
+			ino -= total;
+		}
+		start = ktime_to_ns(ktime_get());
+		humble_hash_contains(ino);
+		end = ktime_to_ns(ktime_get());
+		if (g_st_timing && t->sample_cnt < ST_SAMPLES) {
+			t->samples[t->sample_cnt++] = end - start;
+		}
+		if ((++i & 1023) == 0) {
+			cond_resched();
+		}
+	}
+	complete(&t->done);
+	return 0;
+}
+
+static int st_start(struct st_thread *t, int (*fn)(void *), const char *kind)
+{
+	struct task_struct *task;
+
+	init_completion(&t->done);
+	task = kthread_run(fn, t, "humble-%s/%d", kind, t->id);
+	if (IS_ERR(task)) {
+		PRerror("selftest: could not start a thread\n");
+		return PTR_ERR(task);
+	}
+	return 0;
+}
+
+/*
+ *  Runs the readers while the mutators do their work, or while the hash
+ *  gets cleared if there are no @mutators
+ */
+static int st_run(struct st_thread *mutators, struct st_thread *readers)
+{
+	int i, err = 0, started_m = 0, started_r = 0;
+
+	g_st_stop = 0;
+	for (i = 0; i < ST_READERS && !err; ++i) {
+		err = st_start(&readers[i], st_reader, "reader");
+		started_r += !err;
+	}
+	for (i = 0; mutators && i < ST_MUTATORS && !err; ++i) {
+		err = st_start(&mutators[i], st_mutator, "mutator");
+		started_m += !err;
+	}
+	if (!mutators && !err) {
+		humble_hash_clear();
+	}
+	for (i = 0; i < started_m; ++i) {
+		wait_for_completion(&mutators[i].done);
+		if (mutators[i].failed && !err) {
+			err = -EINVAL;
+		}
+	}
+	g_st_stop = 1;
+	for (i = 0; i < started_r; ++i) {
+		wait_for_completion(&readers[i].done);
+	}
+	return err;
+}
+
+/*
+ *  Compares the hash and the methods of every inode with what the
+ *  mutators think is hidden. With @cleared nothing should be.
+ */
+static int st_verify(int cleared)
+{
+	int i, problems = humble_hash_check();
+	int hidden_in[ST_PARENTS] = { 0 };
+	struct st_file *file;
+	struct inode *parent;
+	int expect;
+
+	for (i = 0; i < ST_MUTATORS * ST_FILES; ++i) {
+		file = &g_st_files[i];
+		if (cleared) {
+			file->hidden = 0;
+		}
+		expect = file->hidden;
+		hidden_in[file->parent] += expect;
+		if (humble_hash_contains(file->inode.i_ino) != expect) {
+			PRerror("selftest: #%lu should%s be hidden\n",
+			        file->inode.i_ino, expect ? "" : " not");
+			problems += 1;
+		}
+		if ((file->inode.i_fop == &g_st_notfound_fops) != expect ||
+		    (file->inode.i_op == &g_st_notfound_iops) != expect)
+		{
+			PRerror("selftest: #%lu has wrong methods\n",
+			        file->inode.i_ino);
+			problems += 1;
+		}
+	}
+	for (i = 0; i < ST_PARENTS; ++i) {
+		parent = &g_st_parents[i];
+		expect = hidden_in[i] > 0;
+		if ((parent->i_fop == g_st_filtering_fops) != expect ||
+		    (!expect && parent->i_fop != &g_st_original_fops))
+		{
+			PRerror("selftest: parent #%lu has wrong methods\n",
+			        parent->i_ino);
+			problems += 1;
+		}
+	}
+	return problems;
+}
+
+/*
+ *  A hidden directory takes over the original methods of its parent
+ *  entry when its last hidden child goes, whichever goes first.
+ */
+static int st_check_nested(void)
+{
+	int group, problems = 0;
+	struct inode *top = &g_st_parents[0];
+	struct inode *dir = &g_st_parents[1];
+	struct inode *file = &g_st_files[0].inode;
+
+	humble_hash_add(file, dir, "f", 1, HUMBLE_DEFAULT_GROUP, 0);
+	humble_hash_add(dir, top, "d", 1, HUMBLE_DEFAULT_GROUP, 0);
+	dir->i_fop = &g_st_notfound_fops;
+
+	if (humble_hash_remove(file->i_ino) != -ENOTEMPTY) {
+		PRerror("selftest: removed a file from a hidden directory\n");
+		problems += 1;
+	}
+	humble_hash_remove(dir->i_ino);
+	if (dir->i_fop != g_st_filtering_fops) {
+		PRerror("selftest: directory lost its filtering methods\n");
+		problems += 1;
+	}
+	humble_hash_remove(file->i_ino);
+	if (dir->i_fop != &g_st_original_fops ||
+	    top->i_fop != &g_st_original_fops)
+	{
+		PRerror("selftest: directories did not get their methods back\n");
+		problems += 1;
+	}
+
+	humble_hash_add(file, dir, "f", 1, HUMBLE_DEFAULT_GROUP, 0);
+	humble_hash_add(dir, top, "d", 1, HUMBLE_DEFAULT_GROUP, 0);
+	humble_hash_clear();
+	if (dir->i_fop != &g_st_original_fops) {
+		PRerror("selftest: clearing lost the original methods\n");
+		problems += 1;
+	}
+
+	/* The other way round: the directory is hidden first and goes first,
+	 * forced out along with its group */
+	if (humble_group_create("selftest", &group)) {
+		PRerror("selftest: could not create a group\n");
+		return problems + 1;
+	}
+	humble_hash_add(dir, top, "d", 1, group, 0);
+	dir->i_fop = &g_st_notfound_fops;
+	humble_hash_add(file, dir, "f", 1, HUMBLE_DEFAULT_GROUP, 0);
+	if (dir->i_fop != &g_st_notfound_fops) {
+		PRerror("selftest: hidden directory got its methods back\n");
+		problems += 1;
+	}
+	humble_group_delete(group, NULL);
+	if (dir->i_fop != g_st_filtering_fops) {
+		PRerror("selftest: released directory does not filter\n");
+		problems += 1;
+	}
+	humble_hash_remove(file->i_ino);
+	if (dir->i_fop != &g_st_original_fops) {
+		PRerror("selftest: directory did not get its methods back\n");
+		problems += 1;
+	}
+	file->i_op = &g_st_original_iops;
+	file->i_fop = &g_st_original_fops;
+	top->i_fop = &g_st_original_fops;
+	return problems;
+}
+
+static int st_compare_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+	return (x > y) - (x < y);
+}
+
+static void st_report_latency(struct st_thread *readers)
+{
+	int i, count = 0;
+	u64 *all;
+
+	for (i = 0; i < ST_READERS; ++i) {
+		count += readers[i].sample_cnt;
+	}
+	if (count == 0) {
+		return;
+	}
+	all = vmalloc(count * sizeof(*all));
+	if (!all) {
+		return;
+	}
+	count = 0;
+	for (i = 0; i < ST_READERS; ++i) {
+		memcpy(all + count, readers[i].samples,
+		       readers[i].sample_cnt * sizeof(*all));
+		count += readers[i].sample_cnt;
+	}
+	sort(all, count, sizeof(*all), st_compare_u64, NULL);
+	PRinfo("selftest: lookup latency over %d samples: "
+	       "p50 %llu ns, p99 %llu ns, p999 %llu ns, max %llu ns\n",
+	       count, all[count / 2], all[count * 99 / 100],
+	       all[count * 999 / 1000], all[count - 1]);
+	vfree(all);
+}
+
+int humble_selftest(void)
+{
+	int i, round, err = 0, problems = 0;
+	struct st_thread *mutators = NULL, *readers = NULL;
+	int total = ST_MUTATORS * ST_FILES;
+
+	g_st_parents = vzalloc(ST_PARENTS * sizeof(*g_st_parents));
+	g_st_files = vzalloc(total * sizeof(*g_st_files));
+	mutators = vzalloc(ST_MUTATORS * sizeof(*mutators));
+	readers = vzalloc(ST_READERS * sizeof(*readers));
+	if (!g_st_parents || !g_st_files || !mutators || !readers) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < ST_READERS; ++i) {
+		readers[i].id = i;
+		readers[i].rnd = 0x9e3779b9 ^ (i + 1);
+		readers[i].samples = vmalloc(ST_SAMPLES * sizeof(u64));
+		if (!readers[i].samples) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+	for (i = 0; i < ST_MUTATORS; ++i) {
+		mutators[i].id = i;
+		mutators[i].rnd = 0x85ebca6b ^ (i + 1);
+	}
+
+	g_st_filtering_fops = humble_wrap_fops(&g_st_original_fops);
+	if (!g_st_filtering_fops) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	/* Inode numbers far from anything real, the hash is global */
+	for (i = 0; i < ST_PARENTS; ++i) {
+		st_init_inode(&g_st_parents[i], ~0UL - i, S_IFDIR);
+	}
+	for (i = 0; i < total; ++i) {
+		st_init_inode(&g_st_files[i].inode, ~0UL - ST_PARENTS - i,
+		              S_IFREG);
+		g_st_files[i].parent = i % ST_PARENTS;
+		snprintf(g_st_files[i].name, sizeof(g_st_files[i].name),
+		         "st%d", i);
+	}
+
+	problems += st_check_nested();
+	for (round = 0; round < ST_ROUNDS && !err && !problems; ++round) {
+		g_st_timing = 1;
+		err = st_run(mutators, readers);
+		g_st_timing = 0;
+		if (err) {
+			break;
+		}
+		problems += st_verify(0);
+		err = st_run(NULL, readers);
+		problems += st_verify(1);
+	}
+	if (!err && problems) {
+		PRerror("selftest: %d problems\n", problems);
+		err = -EINVAL;
+	}
+	if (!err) {
+		PRinfo("selftest: %d rounds passed\n", ST_ROUNDS);
+		st_report_latency(readers);
+	}
+out:
+	humble_hash_clear();
+	if (readers) {
+		for (i = 0; i < ST_READERS; ++i) {
+			vfree(readers[i].samples);
+		}
+	}
+	vfree(readers);
+	vfree(mutators);
+	vfree(g_st_files);
+	vfree(g_st_parents);
+	return err;
+}
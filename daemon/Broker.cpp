@@ -0,0 +1,438 @@
+#include "Broker.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+Broker::Broker(DriverGate *gate, const char *device)
+  : gate(gate), device(device), listenFd(-1), eventFd(-1), running(false)
+{}
+
+Broker::~Broker()
+{
+    for (std::map<int, Client>::iterator it = clients.begin();
+         it != clients.end(); ++it)
+    {
+        ::close(it->first);
+    }
+    if (listenFd != -1) {
+        ::close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    if (eventFd != -1) {
+        ::close(eventFd);
+    }
+    gate->close();
+}
+
+bool Broker::listen(const char *path)
+{
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "humbled: socket path is too long\n");
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1) {
+        perror("humbled: socket");
+        return false;
+    }
+    unlink(path);
+    if (bind(listenFd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        perror("humbled: bind");
+        return false;
+    }
+    socketPath = path;
+    chmod(path, 0600);
+    if (::listen(listenFd, SOMAXCONN) == -1) {
+        perror("humbled: listen");
+        return false;
+    }
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+bool Broker::run()
+{
+    switch (gate->tryOpen()) {
+    case DriverGate::OPEN:
+    case DriverGate::ALREADY_OPEN:
+        break;
+    case DriverGate::BUSY:
+        fprintf(stderr, "humbled: %s is busy\n", device.c_str());
+        return false;
+    case DriverGate::NOT_FOUND:
+        fprintf(stderr, "humbled: %s not found\n", device.c_str());
+        return false;
+    default:
+        perror("humbled: open");
+        return false;
+    }
+    // Without events the cache cannot be trusted, so it is not used then
+    eventFd = ::open(device.c_str(), O_RDONLY | O_NONBLOCK);
+    if (eventFd == -1) {
+        perror("humbled: cannot listen for events, caching disabled");
+    }
+
+    running = true;
+    while (running) {
+        std::vector<struct pollfd> fds;
+        struct pollfd entry;
+
+        entry.fd = listenFd;
+        entry.events = POLLIN;
+        fds.push_back(entry);
+        if (eventFd != -1) {
+            entry.fd = eventFd;
+            entry.events = POLLIN;
+            fds.push_back(entry);
+        }
+        for (std::map<int, Client>::iterator it = clients.begin();
+             it != clients.end(); ++it)
+        {
+            entry.fd = it->first;
+            entry.events = POLLIN;
+            if (!it->second.output.empty()) {
+                entry.events |= POLLOUT;
+            }
+            fds.push_back(entry);
+        }
+
+        if (poll(&fds[0], fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("humbled: poll");
+            return false;
+        }
+
+        // Events first, so that the cache is fresh for this round
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].fd == eventFd && fds[i].revents) {
+                readEvents();
+            }
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (!fds[i].revents || fds[i].fd == eventFd) {
+                continue;
+            }
+            if (fds[i].fd == listenFd) {
+                acceptClient();
+                continue;
+            }
+            std::map<int, Client>::iterator it = clients.find(fds[i].fd);
+            if (it == clients.end()) {
+                continue;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                readClient(it->second);
+            }
+        }
+        processPending();
+        for (std::map<int, Client>::iterator it = clients.begin();
+             it != clients.end(); )
+        {
+            int fd = (it++)->first;
+            writeClient(clients[fd]);
+        }
+    }
+    return true;
+}
+
+void Broker::acceptClient()
+{
+    int fd;
+    while ((fd = accept(listenFd, NULL, NULL)) != -1) {
+        if (clients.size() >= max_clients) {
+            ::close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        Client &client = clients[fd];
+        client.fd = fd;
+    }
+}
+
+//
+// Commands are terminated either by '\n' or by '\0' (DriverGate sends
+// the terminating zero along with every command).
+//
+void Broker::readClient(Client &client)
+{
+    char buffer[4096];
+    ssize_t numRead;
+    int fd = client.fd;
+
+    while ((numRead = read(fd, buffer, sizeof(buffer))) > 0) {
+        client.input.append(buffer, numRead);
+    }
+    if (numRead == 0 || (numRead == -1 && errno != EAGAIN)) {
+        dropClient(fd);
+        return;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i < client.input.size(); ++i) {
+        char c = client.input[i];
+        if (c != '\n' && c != '\0') {
+            continue;
+        }
+        if (i > start) {
+            Request request;
+            request.client = fd;
+            request.command = client.input.substr(start, i - start);
+            pending.push_back(request);
+        }
+        start = i + 1;
+    }
+    client.input.erase(0, start);
+    if (client.input.size() >= max_line) {
+        dropClient(fd);
+    }
+}
+
+void Broker::writeClient(Client &client)
+{
+    while (!client.output.empty()) {
+        ssize_t numWritten = write(client.fd, client.output.data(),
+                                   client.output.size());
+        if (numWritten == -1) {
+            if (errno != EAGAIN) {
+                dropClient(client.fd);
+            }
+            return;
+        }
+        client.output.erase(0, numWritten);
+    }
+}
+
+void Broker::dropClient(int fd)
+{
+    ::close(fd);
+    clients.erase(fd);
+}
+
+namespace {
+
+struct BatchReplies {
+    std::vector<std::string> *replies;
+    const std::vector<size_t> *slots;
+};
+
+void storeReply(size_t index, const char *reply, void *context)
+{
+    BatchReplies *batch = static_cast<BatchReplies*>(context);
+    std::string &slot = (*batch->replies)[(*batch->slots)[index]];
+    slot = reply ? reply : "E-22";
+    slot += '\n';
+}
+
+} // namespace
+
+//
+// Every device-bound request of the round goes out in a single pipelined
+// batch. Queries are answered locally only while nothing in the round has
+// changed the hidden set yet; later ones go to the device in order.
+//
+void Broker::processPending()
+{
+    // Identical queries of one round are executed only once
+    std::map<std::string, size_t> answered;
+    std::vector<std::pair<size_t, size_t> > duplicates;
+    std::vector<std::string> replies(pending.size());
+    std::vector<size_t> slots;
+    std::vector<const char*> commands;
+    bool mutated = false;
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        const std::string &command = pending[i].command;
+
+        if (!allowed(command)) {
+            replies[i] = "E-22\n";
+            continue;
+        }
+        if (command[0] == 'Q' && !mutated) {
+            std::map<std::string, size_t>::iterator it = answered.find(command);
+            if (it != answered.end()) {
+                duplicates.push_back(std::make_pair(i, it->second));
+                continue;
+            }
+            answered[command] = i;
+            if (answerFromCache(command, &replies[i])) {
+                continue;
+            }
+        }
+        if (command[0] != 'Q') {
+            mutated = true;
+        }
+        slots.push_back(i);
+        commands.push_back(command.c_str());
+    }
+
+    if (!commands.empty()) {
+        BatchReplies batch = { &replies, &slots };
+        bool failed = (gate->execute(&commands[0], commands.size(), storeReply,
+                                     &batch) != DriverGate::OKAY);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            std::string &reply = replies[slots[i]];
+            // What the device left unanswered got a NULL reply as well
+            if (failed && reply == "E-22\n") {
+                reply = "E-5\n";
+            }
+            updateCache(pending[slots[i]].command, reply);
+        }
+    }
+    for (size_t i = 0; i < duplicates.size(); ++i) {
+        replies[duplicates[i].first] = replies[duplicates[i].second];
+    }
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        std::map<int, Client>::iterator client = clients.find(pending[i].client);
+        if (client != clients.end()) {
+            client->second.output += replies[i];
+        }
+    }
+    pending.clear();
+}
+
+//
+// Session state of the device is shared by every client,
+// so the commands changing it are not let through. Queries are
+// answered from the cache, so they have to be "Q /path" exactly.
+//
+bool Broker::allowed(const std::string &command)
+{
+    switch (command[0]) {
+    case 'Q':
+        return command.size() > 2 && command.compare(0, 3, "Q /") == 0;
+    case 'H': case 'U': case 'R': case 'C':
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Broker::answerFromCache(const std::string &command, std::string *reply) const
+{
+    if (eventFd == -1) {
+        return false;
+    }
+    std::string path = command.substr(2);
+    std::map<std::string, unsigned long long>::const_iterator it = hiddenPaths.find(path);
+    if (it != hiddenPaths.end()) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%llu\n", it->second);
+        *reply = buffer;
+        return true;
+    }
+    if (visiblePaths.count(path)) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "E%d\n", -ENOENT);
+        *reply = buffer;
+        return true;
+    }
+    return false;
+}
+
+void Broker::updateCache(const std::string &command, const std::string &reply)
+{
+    unsigned long long ino = 0;
+    bool failed = (reply[0] == 'E');
+    int code = 0;
+    if (failed) {
+        sscanf(reply.c_str(), "E%d", &code);
+    } else {
+        sscanf(reply.c_str(), "%llu", &ino);
+    }
+
+    std::string argument = command.size() > 2 ? command.substr(2) : "";
+    switch (command[0]) {
+    case 'H':
+    case 'Q':
+        if (!failed) {
+            visiblePaths.erase(argument);
+            hiddenPaths[argument] = ino;
+            hiddenInodes[ino] = argument;
+        }
+        else if (command[0] == 'Q' && code == -ENOENT) {
+            visiblePaths.insert(argument);
+        }
+        break;
+    case 'U':
+    case 'R':
+        if (!failed) {
+            forgetInode(ino);
+        }
+        break;
+    case 'C':
+        if (!failed) {
+            forgetAll();
+        }
+        break;
+    }
+}
+
+void Broker::readEvents()
+{
+    char buffer[4096];
+    ssize_t numRead;
+
+    while ((numRead = read(eventFd, buffer, sizeof(buffer) - 1)) > 0) {
+        buffer[numRead] = '\0';
+        for (char *line = strtok(buffer, "\n"); line; line = strtok(NULL, "\n")) {
+            char type;
+            unsigned long long ino;
+            if (sscanf(line, "%c %llu", &type, &ino) != 2) {
+                continue;
+            }
+            switch (type) {
+            case 'U':
+            case 'D':
+            case 'L':
+                forgetInode(ino);
+                break;
+            case 'H':
+                // hidden by somebody else (e.g. an auto-hide rule),
+                // any path we think is visible may be the one
+                if (!hiddenInodes.count(ino)) {
+                    visiblePaths.clear();
+                }
+                break;
+            case 'C':
+            case 'O':
+                forgetAll();
+                break;
+            }
+        }
+    }
+}
+
+void Broker::forgetInode(unsigned long long ino)
+{
+    std::map<unsigned long long, std::string>::iterator it = hiddenInodes.find(ino);
+    if (it != hiddenInodes.end()) {
+        hiddenPaths.erase(it->second);
+        hiddenInodes.erase(it);
+    }
+    visiblePaths.clear();
+}
+
+void Broker::forgetAll()
+{
+    hiddenPaths.clear();
+    hiddenInodes.clear();
+    visiblePaths.clear();
+}
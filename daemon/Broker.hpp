@@ -0,0 +1,71 @@
+#ifndef BROKER_H__
+#define BROKER_H__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "DriverGate.hpp"
+
+//
+// Holds the control device open and serves any number of clients over
+// a Unix socket, speaking the same line protocol as the device itself.
+//
+// Requests which arrive during one poll round are pipelined to the
+// device in one batch. Queries are answered from a local cache of the
+// hidden set, which is kept in sync through the device event stream.
+//
+class Broker {
+public:
+    Broker(DriverGate *gate, const char *device);
+    ~Broker();
+
+    bool listen(const char *socketPath);
+    bool run();
+    void stop() { running = false; }
+
+private:
+    struct Client {
+        int fd;
+        std::string input;
+        std::string output;
+    };
+
+    struct Request {
+        int client;
+        std::string command;
+    };
+
+    static const size_t max_line = 512;
+    static const size_t max_clients = 1024;
+
+    DriverGate *gate;
+    std::string device;
+    std::string socketPath;
+    int listenFd;
+    int eventFd;
+    volatile bool running;
+
+    std::map<int, Client> clients;
+    std::vector<Request> pending;
+
+    std::map<std::string, unsigned long long> hiddenPaths;
+    std::map<unsigned long long, std::string> hiddenInodes;
+    std::set<std::string> visiblePaths;
+
+    void acceptClient();
+    void readClient(Client &client);
+    void writeClient(Client &client);
+    void dropClient(int fd);
+
+    void readEvents();
+    void processPending();
+    static bool allowed(const std::string &command);
+    bool answerFromCache(const std::string &command, std::string *reply) const;
+    void updateCache(const std::string &command, const std::string &reply);
+    void forgetInode(unsigned long long ino);
+    void forgetAll();
+};
+
+#endif // BROKER_H__
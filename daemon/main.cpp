@@ -0,0 +1,62 @@
+#include "Broker.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <signal.h>
+#include <unistd.h>
+
+static Broker *g_broker = NULL;
+
+static void stopBroker(int)
+{
+    if (g_broker) {
+        g_broker->stop();
+    }
+}
+
+static void usage()
+{
+    fprintf(stderr, "Usage: humbled [-d device] [-s socket] [-t trace]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *device = "/dev/hcontrol";
+    const char *socketPath = "/var/run/humble.sock";
+    const char *tracePath = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:t:h")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg;     break;
+        case 's': socketPath = optarg; break;
+        case 't': tracePath = optarg;  break;
+        default:
+            usage();
+            return (opt == 'h')? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopBroker;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    DriverGate gate(device);
+    if (tracePath && !gate.startTrace(tracePath)) {
+        perror("humbled: trace");
+        return EXIT_FAILURE;
+    }
+    Broker broker(&gate, device);
+    g_broker = &broker;
+    if (!broker.listen(socketPath)) {
+        return EXIT_FAILURE;
+    }
+    bool okay = broker.run();
+    g_broker = NULL;
+    return okay ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,168 @@
+#include "Broker.hpp"
+
+#include <string>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+//
+// Runs the broker against a device played by a thread on a Unix socket,
+// which answers every request it gets with E-2. Replies the broker makes
+// up itself are told from the device's ones that way.
+//
+
+namespace {
+
+int failures = 0;
+
+#define CHECK_EQUAL(actual, expected) \
+    checkEqual((actual), (expected), #actual, __LINE__)
+
+void checkEqual(const std::string &actual, const std::string &expected,
+                const char *what, int line)
+{
+    if (actual != expected) {
+        fprintf(stderr, "Test_Broker.cpp:%d: %s is \"%s\", expected \"%s\"\n",
+                line, what, actual.c_str(), expected.c_str());
+        ++failures;
+    }
+}
+
+bool bindTo(int fd, const std::string &path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    return bind(fd, (struct sockaddr*) &address, sizeof(address)) == 0
+        && listen(fd, 1) == 0;
+}
+
+int connectTo(const std::string &path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd != -1 && connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Answers each line the device gets, commands may end in '\n' or '\0'
+void* playDevice(void *context)
+{
+    int listenFd = *static_cast<int*>(context);
+    int fd = accept(listenFd, NULL, NULL);
+    char buffer[4096];
+    ssize_t numRead;
+    while (fd != -1 && (numRead = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < numRead; ++i) {
+            if (buffer[i] == '\n' || buffer[i] == '\0') {
+                write(fd, "E-2\n", 4);
+            }
+        }
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return NULL;
+}
+
+void* runBroker(void *context)
+{
+    static_cast<Broker*>(context)->run();
+    return NULL;
+}
+
+// Sends @request and reads back @lines reply lines
+std::string exchange(int fd, const std::string &request, int lines)
+{
+    std::string reply;
+    write(fd, request.data(), request.size());
+    char c;
+    while (lines > 0 && read(fd, &c, 1) == 1) {
+        reply += c;
+        if (c == '\n') {
+            --lines;
+        }
+    }
+    return reply;
+}
+
+void testMalformedQueries(const std::string &socketPath)
+{
+    int fd = connectTo(socketPath);
+    if (fd == -1) {
+        perror("Test_Broker: connect");
+        ++failures;
+        return;
+    }
+    CHECK_EQUAL(exchange(fd, "Q\n", 1), "E-22\n");
+    CHECK_EQUAL(exchange(fd, "Q \n", 1), "E-22\n");
+    CHECK_EQUAL(exchange(fd, "Qx\n", 1), "E-22\n");
+    // Well-formed ones still get to the device
+    CHECK_EQUAL(exchange(fd, "Q /nonexistent\n", 1), "E-2\n");
+    close(fd);
+}
+
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    char directory[] = "/tmp/humbled-test.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("Test_Broker: mkdtemp");
+        return EXIT_FAILURE;
+    }
+    std::string devicePath = std::string(directory) + "/device";
+    std::string socketPath = std::string(directory) + "/socket";
+
+    int deviceFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (deviceFd == -1 || !bindTo(deviceFd, devicePath)) {
+        perror("Test_Broker: device");
+        return EXIT_FAILURE;
+    }
+    pthread_t device;
+    pthread_create(&device, NULL, playDevice, &deviceFd);
+
+    DriverGate gate(devicePath.c_str());
+    Broker *broker = new Broker(&gate, devicePath.c_str());
+    if (!broker->listen(socketPath.c_str())) {
+        return EXIT_FAILURE;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, runBroker, broker);
+
+    testMalformedQueries(socketPath);
+
+    // One more connection wakes the broker up to see it is stopped
+    broker->stop();
+    close(connectTo(socketPath));
+    pthread_join(thread, NULL);
+    delete broker;
+    pthread_join(device, NULL);
+    close(deviceFd);
+    unlink(devicePath.c_str());
+    rmdir(directory);
+
+    if (failures > 0) {
+        fprintf(stderr, "Test_Broker: %d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("Test_Broker: passed\n");
+    return EXIT_SUCCESS;
+}
@@ -13,14 +13,27 @@ SOURCES += \
     src/main.cpp \
     src/MainWindow.cpp \
     src/HiddenFile.cpp \
+    src/HiddenTree.cpp \
+    src/NameIndex.cpp \
     src/HiddenModel.cpp \
-    src/DriverGate.cpp
+    src/DriverGate.cpp \
+    src/CommandTrace.cpp \
+    src/HideWorker.cpp \
+    src/TreeScanner.cpp \
+    src/VisibleModel.cpp
 
 HEADERS += \
     src/MainWindow.hpp \
     src/HiddenFile.h \
+    src/HiddenTree.h \
+    src/NameIndex.h \
     src/HiddenModel.h \
-    src/DriverGate.hpp
+    src/Driver.hpp \
+    src/DriverGate.hpp \
+    src/CommandTrace.hpp \
+    src/HideWorker.hpp \
+    src/TreeScanner.hpp \
+    src/VisibleModel.hpp
 
 FORMS   += \
     ui/MainWindow.ui
@@ -32,11 +45,15 @@ test {
   SOURCES += \
     test/main.cpp \
     test/Test_HiddenModel.cpp \
-    test/Test_HiddenFile.cpp
+    test/Test_HiddenFile.cpp \
+    test/Bench_HiddenModel.cpp \
+    test/FakeDriver.cpp
 
   HEADERS += \
     test/Test_HiddenModel.h \
-    test/Test_HiddenFile.h
+    test/Test_HiddenFile.h \
+    test/Bench_HiddenModel.h \
+    test/FakeDriver.h
 }
 
 RESOURCES += \
@@ -0,0 +1,178 @@
+#include "CommandTrace.hpp"
+
+#include <cstring>
+
+#include <time.h>
+
+static const char trace_magic[] = "HTRACE1\n";
+static const size_t max_string = 4096;
+
+static unsigned long long zigzag(long long value)
+{
+    return (value < 0) ? ((~(unsigned long long) value) << 1) | 1
+                       : ((unsigned long long) value) << 1;
+}
+
+static long long unzigzag(unsigned long long value)
+{
+    return (value & 1) ? (long long) ~(value >> 1) : (long long) (value >> 1);
+}
+
+// Without the line end the device leaves on replies
+static size_t lineLength(const char *line)
+{
+    size_t length = strlen(line);
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\0')) {
+        --length;
+    }
+    return length;
+}
+
+TraceWriter::TraceWriter()
+  : file(NULL), start(0), last(0)
+{}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const char *path)
+{
+    close();
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fwrite(trace_magic, 1, sizeof(trace_magic) - 1, file);
+    start = now();
+    last = 0;
+    return true;
+}
+
+void TraceWriter::close()
+{
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+long long TraceWriter::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void TraceWriter::record(long long sentAt, char op, const char *command,
+                         const char *reply)
+{
+    if (file == NULL) {
+        return;
+    }
+    long long sent = sentAt - start;
+    putNumber(zigzag(sent - last));
+    putNumber(now() - sentAt);
+    last = sent;
+
+    size_t length = lineLength(command);
+    if (op) {
+        putNumber(length + 2);
+        fputc(op, file);
+        fputc(' ', file);
+        fwrite(command, 1, length, file);
+    }
+    else {
+        putString(command, length);
+    }
+    putString(reply, lineLength(reply));
+}
+
+void TraceWriter::putNumber(unsigned long long value)
+{
+    while (value >= 0x80) {
+        fputc((int) (value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int) value, file);
+}
+
+void TraceWriter::putString(const char *data, size_t length)
+{
+    putNumber(length);
+    fwrite(data, 1, length, file);
+}
+
+TraceReader::TraceReader()
+  : file(NULL), last(0)
+{}
+
+TraceReader::~TraceReader()
+{
+    close();
+}
+
+bool TraceReader::open(const char *path)
+{
+    close();
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    char magic[sizeof(trace_magic) - 1];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, trace_magic, sizeof(magic)) != 0)
+    {
+        close();
+        return false;
+    }
+    last = 0;
+    return true;
+}
+
+void TraceReader::close()
+{
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+bool TraceReader::next(TraceRecord *record)
+{
+    unsigned long long delta, latency;
+    if (file == NULL || !getNumber(&delta) || !getNumber(&latency)) {
+        return false;
+    }
+    last += unzigzag(delta);
+    record->sent = last;
+    record->latency = latency;
+    return getString(&record->command) && getString(&record->reply);
+}
+
+bool TraceReader::getNumber(unsigned long long *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+        if (c == EOF) {
+            return false;
+        }
+        *value |= (unsigned long long) (c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::getString(std::string *string)
+{
+    unsigned long long length;
+    if (!getNumber(&length) || length > max_string) {
+        return false;
+    }
+    string->resize(length);
+    return length == 0 || fread(&(*string)[0], 1, length, file) == length;
+}
@@ -0,0 +1,69 @@
+#ifndef COMMAND_TRACE_H__
+#define COMMAND_TRACE_H__
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+//
+// A compact binary log of control protocol traffic: every command with
+// the time it was sent, how long its reply took and the reply itself.
+//
+// The file starts with the magic line "HTRACE1\n", each record follows
+// as varints: the send time in ns relative to the previous record
+// (zigzag encoded), the latency in ns, then the lengths and bytes of
+// the command and of the reply, both without their newlines.
+//
+struct TraceRecord {
+    long long sent;       // ns since the trace was started
+    long long latency;    // ns
+    std::string command;
+    std::string reply;
+};
+
+class TraceWriter {
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    bool open(const char *path);
+    void close();
+    bool isOpen() const { return file != NULL; }
+
+    // Monotonic time in ns, the clock of record()
+    static long long now();
+
+    // @command is a whole protocol line unless @op is given, it is then
+    // the argument of that command
+    void record(long long sentAt, char op, const char *command,
+                const char *reply);
+
+private:
+    FILE *file;
+    long long start;
+    long long last;
+
+    void putNumber(unsigned long long value);
+    void putString(const char *data, size_t length);
+};
+
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+
+    bool open(const char *path);
+    void close();
+
+    // False at the end of the trace or at a damaged record
+    bool next(TraceRecord *record);
+
+private:
+    FILE *file;
+    long long last;
+
+    bool getNumber(unsigned long long *value);
+    bool getString(std::string *string);
+};
+
+#endif // COMMAND_TRACE_H__
@@ -0,0 +1,57 @@
+#ifndef DRIVER_H__
+#define DRIVER_H__
+
+#include <cstddef>
+
+//
+// What the GUI needs of the kernel module. DriverGate talks to the real
+// control device, tests put an in-memory driver in its place.
+//
+class Driver {
+public:
+    enum OpenStatus {
+        OPEN,
+        ALREADY_OPEN,
+        NOT_FOUND,
+        BUSY,
+        ANOTHER
+    };
+
+    enum Status {
+        NOT_OPEN = -9,
+        UNKNOWN_ERROR = -1,
+        OKAY,
+        INVALID_FORMAT,
+        UNKNOWN_FILE,
+        MOUNT_POINT,
+        ALREADY_HIDDEN,
+        HIDDEN_PARENT,
+        LOST_PARENT,
+        MEMORY_FAULT,
+        BAD_DESCRIPTOR,
+        STALE_HANDLE
+    };
+
+public:
+    virtual ~Driver() {}
+
+    virtual bool isOpen() const = 0;
+    virtual OpenStatus tryOpen() = 0;
+    virtual void close() = 0;
+
+    virtual void setDevice(const char *device) = 0;
+
+    virtual Status hide(const char *path, unsigned long long *ino) = 0;
+    virtual Status unhide(unsigned long long ino) = 0;
+    virtual Status unhideAll() = 0;
+
+    // Per-request results are stored in @statuses and @inos (either may
+    // be NULL). Returns OKAY if every request succeeded, otherwise the
+    // status of some failed one.
+    virtual Status hide(const char *const *paths, size_t count,
+                        unsigned long long *inos, Status *statuses) = 0;
+    virtual Status unhide(const unsigned long long *inos, size_t count,
+                          Status *statuses) = 0;
+};
+
+#endif // DRIVER_H__
@@ -5,7 +5,9 @@
 #include <cstring>
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
@@ -35,6 +37,10 @@ typename DriverGate::OpenStatus DriverGate::tryOpen()
     if (open) {
         return ALREADY_OPEN;
     }
+    struct stat info;
+    if (stat(device, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        return tryConnect();
+    }
     fd = ::open(device, O_RDWR | O_NONBLOCK);
     if (fd == -1) {
         open = false;
@@ -49,6 +55,38 @@ typename DriverGate::OpenStatus DriverGate::tryOpen()
     return OPEN;
 }
 
+// The device may be served by humbled, which speaks the same protocol
+// over a Unix socket. Replies come asynchronously there, so it is blocking.
+typename DriverGate::OpenStatus DriverGate::tryConnect()
+{
+    struct sockaddr_un address;
+    if (strlen(device) >= sizeof(address.sun_path)) {
+        return ANOTHER;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, device);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return ANOTHER;
+    }
+    if (connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        int error = errno;
+        ::close(fd);
+        fd = -1;
+        switch (error) {
+        case ECONNREFUSED:
+        case ENOENT:       return NOT_FOUND;
+        case EAGAIN:       return BUSY;
+
+        default:           return ANOTHER;
+        }
+    }
+    open = true;
+    return OPEN;
+}
+
 void DriverGate::close()
 {
     if (open) {
@@ -62,13 +100,12 @@ typename DriverGate::Status DriverGate::hide(const char *path, unsigned long lon
 {
     if (!open) return NOT_OPEN;
 
-    if (path[0] != '/') {
+    if (path[0] != '/' || strchr(path, '\n')) {
         return INVALID_FORMAT;
     }
     size_t numBytes;
     numBytes = 1 + snprintf(obuffer, buffer_size, "H %s", path);
-    write(fd, obuffer, numBytes);
-    read(fd, ibuffer, buffer_size);
+    exchange(numBytes);
     if (gotError()) {
         return parseError();
     }
@@ -78,33 +115,316 @@ typename DriverGate::Status DriverGate::hide(const char *path, unsigned long lon
     return OKAY;
 }
 
+typename DriverGate::Status DriverGate::hideFd(int fd, unsigned long long *ino)
+{
+    if (!open) return NOT_OPEN;
+
+    size_t numBytes;
+    numBytes = 1 + snprintf(obuffer, buffer_size, "F %d", fd);
+    exchange(numBytes);
+    if (gotError()) {
+        // hiding never loses parents, EBADF is about the descriptor here
+        Status status = parseError();
+        return (status == LOST_PARENT)? BAD_DESCRIPTOR : status;
+    }
+    if (ino) {
+        sscanf(ibuffer, "%lld", ino);
+    }
+    return OKAY;
+}
+
+typename DriverGate::Status DriverGate::hideHandle(int mountFd,
+                                                   const struct file_handle *handle,
+                                                   unsigned long long *ino)
+{
+    if (!open) return NOT_OPEN;
+
+    size_t numBytes;
+    numBytes = snprintf(obuffer, buffer_size, "K %d %d ",
+                        mountFd, handle->handle_type);
+    if (numBytes + 2 * handle->handle_bytes + 1 > buffer_size) {
+        return INVALID_FORMAT;
+    }
+    for (unsigned i = 0; i < handle->handle_bytes; ++i) {
+        numBytes += sprintf(obuffer + numBytes, "%02x", handle->f_handle[i]);
+    }
+    numBytes += 1;
+    exchange(numBytes);
+    if (gotError()) {
+        Status status = parseError();
+        return (status == LOST_PARENT)? BAD_DESCRIPTOR : status;
+    }
+    if (ino) {
+        sscanf(ibuffer, "%lld", ino);
+    }
+    return OKAY;
+}
+
 typename DriverGate::Status DriverGate::unhide(unsigned long long ino)
 {
     if (!open) return NOT_OPEN;
 
     size_t numBytes;
     numBytes = 1 + snprintf(obuffer, buffer_size, "U %lld", ino);
-    write(fd, obuffer, numBytes);
-    read(fd, ibuffer, buffer_size);
+    exchange(numBytes);
     if (gotError()) {
         return parseError();
     }
     return OKAY;
 }
 
+typename DriverGate::Status DriverGate::unhide(const char *path, unsigned long long *ino)
+{
+    return pathCommand('R', path, ino);
+}
+
+typename DriverGate::Status DriverGate::query(const char *path, unsigned long long *ino)
+{
+    return pathCommand('Q', path, ino);
+}
+
+typename DriverGate::Status DriverGate::pathCommand(char command, const char *path,
+                                                    unsigned long long *ino)
+{
+    if (!open) return NOT_OPEN;
+
+    if (path[0] != '/' || strchr(path, '\n')) {
+        return INVALID_FORMAT;
+    }
+    size_t numBytes;
+    numBytes = 1 + snprintf(obuffer, buffer_size, "%c %s", command, path);
+    exchange(numBytes);
+    if (gotError()) {
+        return parseError();
+    }
+    if (ino) {
+        sscanf(ibuffer, "%lld", ino);
+    }
+    return OKAY;
+}
+
+typename DriverGate::Status DriverGate::execute(const char *command,
+                                                char *reply, size_t replySize)
+{
+    if (!open) return NOT_OPEN;
+
+    size_t numBytes = strlen(command) + 1;
+    if (numBytes > buffer_size || strchr(command, '\n')) {
+        return INVALID_FORMAT;
+    }
+    long long sent = trace.isOpen() ? TraceWriter::now() : 0;
+    write(fd, command, numBytes);
+    ssize_t numRead = read(fd, ibuffer, buffer_size - 1);
+    if (numRead < 0) {
+        numRead = 0;
+    }
+    ibuffer[numRead] = '\0';
+    trace.record(sent, '\0', command, ibuffer);
+    if (reply && replySize > 0) {
+        strncpy(reply, ibuffer, replySize - 1);
+        reply[replySize - 1] = '\0';
+    }
+    if (gotError()) {
+        return parseError();
+    }
+    return OKAY;
+}
+
+namespace {
+
+struct BatchResults {
+    unsigned long long *inos;
+    DriverGate::Status *statuses;
+    DriverGate::Status first;
+};
+
+}
+
+static void storeReply(size_t index, const char *reply, void *context)
+{
+    BatchResults *results = static_cast<BatchResults*>(context);
+    unsigned long long ino = 0;
+    DriverGate::Status status = DriverGate::OKAY;
+    if (reply == NULL) {
+        status = DriverGate::INVALID_FORMAT;
+    }
+    else if (reply[0] == 'E') {
+        status = DriverGate::parseError(reply);
+    }
+    else {
+        sscanf(reply, "%lld", &ino);
+    }
+    if (results->inos) {
+        results->inos[index] = ino;
+    }
+    if (results->statuses) {
+        results->statuses[index] = status;
+    }
+    if (results->first == DriverGate::OKAY) {
+        results->first = status;
+    }
+}
+
+typename DriverGate::Status DriverGate::hide(const char *const *paths, size_t count,
+                                             unsigned long long *inos, Status *statuses)
+{
+    BatchResults results = { inos, statuses, OKAY };
+    Status status = pipeline('H', paths, count, storeReply, &results);
+    return (status != OKAY)? status : results.first;
+}
+
+typename DriverGate::Status DriverGate::unhide(const unsigned long long *inos, size_t count,
+                                               Status *statuses)
+{
+    static const size_t ino_length = 24;
+    char *numbers = new char[count * ino_length];
+    const char **arguments = new const char*[count];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(numbers + i * ino_length, ino_length, "%lld", inos[i]);
+        arguments[i] = numbers + i * ino_length;
+    }
+    BatchResults results = { NULL, statuses, OKAY };
+    Status status = pipeline('U', arguments, count, storeReply, &results);
+    delete [] arguments;
+    delete [] numbers;
+    return (status != OKAY)? status : results.first;
+}
+
+typename DriverGate::Status DriverGate::execute(const char *const *commands, size_t count,
+                                                ReplyHandler handler, void *context)
+{
+    return pipeline('\0', commands, count, handler, context);
+}
+
+//
+// Keeps writing requests while there are less than max_in_flight of them
+// awaiting replies, and reads back whatever replies are ready. Replies are
+// matched to requests by their order, so a request has to be a single
+// line. Requests which cannot be sent at all (too long, more than one
+// line, a relative path to hide) are answered locally with a NULL reply, and
+// so is everything left unanswered when the device fails mid-batch.
+// With a zero @command the arguments are complete protocol lines.
+//
+typename DriverGate::Status DriverGate::pipeline(char command,
+                                                 const char *const *arguments,
+                                                 size_t count,
+                                                 ReplyHandler handler, void *context)
+{
+    if (!open) return NOT_OPEN;
+
+    size_t inFlight[max_in_flight];
+    long long sentAt[max_in_flight];
+    size_t queued = 0;    // requests put into pbuffer so far
+    size_t written = 0;   // requests completely written to the device
+    size_t answered = 0;  // requests with replies
+    size_t next = 0;
+    size_t outLength = 0;
+    size_t inLength = 0;
+    Status status = OKAY;
+
+    while (answered < queued || next < count) {
+        while (next < count && queued - answered < max_in_flight) {
+            const char *argument = arguments[next];
+            size_t length = strlen(argument) + (command ? 3 : 1);
+            if (length > buffer_size || strchr(argument, '\n') ||
+                (command == 'H' && argument[0] != '/'))
+            {
+                handler(next++, NULL, context);
+                continue;
+            }
+            if (outLength + length > pipe_size) {
+                break;
+            }
+            if (command) {
+                outLength += sprintf(pbuffer + outLength, "%c %s\n", command, argument);
+            }
+            else {
+                outLength += sprintf(pbuffer + outLength, "%s\n", argument);
+            }
+            if (trace.isOpen()) {
+                sentAt[queued % max_in_flight] = TraceWriter::now();
+            }
+            inFlight[queued++ % max_in_flight] = next++;
+        }
+
+        if (outLength > 0) {
+            ssize_t numWritten = write(fd, pbuffer, outLength);
+            if (numWritten < 0 && errno != EAGAIN) {
+                status = UNKNOWN_ERROR;
+                break;
+            }
+            if (numWritten > 0) {
+                for (ssize_t i = 0; i < numWritten; ++i) {
+                    if (pbuffer[i] == '\n') {
+                        ++written;
+                    }
+                }
+                memmove(pbuffer, pbuffer + numWritten, outLength - numWritten);
+                outLength -= numWritten;
+            }
+        }
+
+        if (answered == written) {
+            continue;
+        }
+        ssize_t numRead = read(fd, rbuffer + inLength, pipe_size - 1 - inLength);
+        if (numRead <= 0) {
+            if (numRead < 0 && errno == EAGAIN) {
+                continue;
+            }
+            status = UNKNOWN_ERROR;
+            break;
+        }
+        inLength += numRead;
+        rbuffer[inLength] = '\0';
+
+        char *line = rbuffer;
+        char *end;
+        while ((end = strchr(line, '\n')) != NULL) {
+            *end = '\0';
+            if (*line != '\0') {
+                size_t slot = answered++ % max_in_flight;
+                trace.record(sentAt[slot], command, arguments[inFlight[slot]], line);
+                handler(inFlight[slot], line, context);
+            }
+            line = end + 1;
+        }
+        inLength -= line - rbuffer;
+        memmove(rbuffer, line, inLength);
+    }
+    while (answered < queued) {
+        handler(inFlight[answered++ % max_in_flight], NULL, context);
+    }
+    while (next < count) {
+        handler(next++, NULL, context);
+    }
+    return status;
+}
+
 typename DriverGate::Status DriverGate::unhideAll()
 {
     if (!open) return NOT_OPEN;
 
     strcpy(obuffer, "C");
-    write(fd, obuffer, 2);
-    read(fd, ibuffer, buffer_size);
+    exchange(2);
     if (gotError()) {
         return parseError();
     }
     return OKAY;
 }
 
+//
+// One request, one reply. The reply is read into ibuffer as a string.
+//
+void DriverGate::exchange(size_t numBytes)
+{
+    long long sent = trace.isOpen() ? TraceWriter::now() : 0;
+    write(fd, obuffer, numBytes);
+    ssize_t numRead = read(fd, ibuffer, buffer_size - 1);
+    ibuffer[(numRead > 0) ? numRead : 0] = '\0';
+    trace.record(sent, '\0', obuffer, ibuffer);
+}
+
 inline
 bool DriverGate::gotError() const
 {
@@ -113,8 +433,13 @@ bool DriverGate::gotError() const
 
 typename DriverGate::Status DriverGate::parseError() const
 {
-    int code;
-    sscanf(ibuffer, "E%d", &code);
+    return parseError(ibuffer);
+}
+
+typename DriverGate::Status DriverGate::parseError(const char *reply)
+{
+    int code = 0;
+    sscanf(reply, "E%d", &code);
     if (code < 0) {
         code = -code;
     }
@@ -126,6 +451,7 @@ typename DriverGate::Status DriverGate::parseError() const
     case ENOTEMPTY: return HIDDEN_PARENT;
     case EBADF:     return LOST_PARENT;
     case ENOMEM:    return MEMORY_FAULT;
+    case ESTALE:    return STALE_HANDLE;
 
     default:        return UNKNOWN_ERROR;
     }
@@ -1,28 +1,18 @@
 #ifndef DRIVER_GATE_H__
 #define DRIVER_GATE_H__
 
-class DriverGate {
+#include <cstddef>
+
+#include "CommandTrace.hpp"
+#include "Driver.hpp"
+
+struct file_handle;
+
+class DriverGate : public Driver {
 public:
-    enum OpenStatus {
-        OPEN,
-        ALREADY_OPEN,
-        NOT_FOUND,
-        BUSY,
-        ANOTHER
-    };
-
-    enum Status {
-        NOT_OPEN = -9,
-        UNKNOWN_ERROR = -1,
-        OKAY,
-        INVALID_FORMAT,
-        UNKNOWN_FILE,
-        MOUNT_POINT,
-        ALREADY_HIDDEN,
-        HIDDEN_PARENT,
-        LOST_PARENT,
-        MEMORY_FAULT
-    };
+    // Called for every reply of a batch with the index of its request,
+    // @reply is NULL for requests which could not be sent at all
+    typedef void (*ReplyHandler)(size_t index, const char *reply, void *context);
 public:
     DriverGate(const char *device);
     ~DriverGate();
@@ -34,18 +24,57 @@ public:
     void setDevice(const char *device);
 
     Status hide(const char *path, unsigned long long *ino);
+    Status hideFd(int fd, unsigned long long *ino);
+    Status hideHandle(int mountFd, const struct file_handle *handle,
+                      unsigned long long *ino);
     Status unhide(unsigned long long ino);
+    Status unhide(const char *path, unsigned long long *ino);
+    Status query(const char *path, unsigned long long *ino);
     Status unhideAll();
 
+    // Sends a raw protocol line, copies the reply line into @reply
+    Status execute(const char *command, char *reply, size_t replySize);
+
+    // Batches are pipelined: many requests are kept in flight and the
+    // replies are matched to them by their order.
+    Status hide(const char *const *paths, size_t count,
+                unsigned long long *inos, Status *statuses);
+    Status unhide(const unsigned long long *inos, size_t count,
+                  Status *statuses);
+    Status execute(const char *const *commands, size_t count,
+                   ReplyHandler handler, void *context);
+
+    // Translates an error reply ("E<code>") of the device
+    static Status parseError(const char *reply);
+
+    // Logs every command from now on, see CommandTrace.hpp
+    bool startTrace(const char *path) { return trace.open(path); }
+    void stopTrace() { trace.close(); }
+
 private:
     static const unsigned buffer_size = 512;
     char obuffer[buffer_size];
     char ibuffer[buffer_size];
 
+    // Must stay within the kernel limits: a write is cut at 4096 bytes
+    // and the reply queue holds 16384 bytes, or about 400 replies
+    static const unsigned pipe_size = 4096;
+    static const unsigned max_in_flight = 256;
+    char pbuffer[pipe_size];
+    char rbuffer[pipe_size];
+
     char *device;
     int fd;
     bool open;
 
+    TraceWriter trace;
+
+    OpenStatus tryConnect();
+    void exchange(size_t numBytes);
+    Status pathCommand(char command, const char *path, unsigned long long *ino);
+    Status pipeline(char command, const char *const *arguments, size_t count,
+                    ReplyHandler handler, void *context);
+
     bool gotError() const;
     Status parseError() const;
 };
@@ -1,68 +1,113 @@
 #include "HiddenFile.h"
+#include "HiddenTree.h"
 
-HiddenFile::HiddenFile(const QString &name, bool isDirectory,
+HiddenFile::HiddenFile(HiddenTree *tree, quint32 nameId, bool isDirectory,
                        HiddenFile *parent, quint64 ino)
-  : name(name),
+  : tree(tree),
+    theParent(parent),
+    children(NULL),
+    prevSameName(NULL),
+    nextSameName(NULL),
     ino(ino),
+    nameId(nameId),
+    theRow(0),
     hidden(isDirectory? false : true),
-    directory(isDirectory),
-    theParent(parent)
+    directory(isDirectory)
 {}
 
-HiddenFile::~HiddenFile()
+const QString& HiddenFile::getName() const
 {
-    qDeleteAll(children);
+    return tree->nameOf(nameId);
 }
 
 void HiddenFile::append(HiddenFile *file)
 {
-    children.append(file);
+    if (children == NULL) {
+        children = tree->allocChildren();
+    }
+    file->theRow = children->list.count();
+    children->list.append(file);
+    if (file->isDir()) {
+        children->dirs.insert(file->nameId, file);
+    }
+    else {
+        children->files.insert(file->nameId, file);
+    }
 }
 
 void HiddenFile::removeAt(int idx)
 {
-    HiddenFile *orphan = children[idx];
-    children.removeAt(idx);
-    delete orphan;
+    tree->destroy(extractAt(idx));
+}
+
+//
+// Removes the children from @first to @last inclusive, renumbering
+// the ones after them only once
+//
+void HiddenFile::removeRange(int first, int last)
+{
+    QList<HiddenFile*> &list = children->list;
+    for (int i = first; i <= last; ++i) {
+        unindex(list[i]);
+        tree->destroy(list[i]);
+    }
+    list.erase(list.begin() + first, list.begin() + last + 1);
+    renumberFrom(first);
 }
 
 void HiddenFile::removeAll()
 {
-    qDeleteAll(children);
-    children.clear();
+    if (children == NULL) {
+        return;
+    }
+    foreach (HiddenFile *child, children->list) {
+        tree->destroy(child);
+    }
+    tree->freeChildren(children);
+    children = NULL;
 }
 
 HiddenFile* HiddenFile::extractAt(int idx)
 {
-    HiddenFile *orphan = children[idx];
-    children.removeAt(idx);
+    HiddenFile *orphan = children->list[idx];
+    children->list.removeAt(idx);
+    unindex(orphan);
+    renumberFrom(idx);
     return orphan;
 }
 
-int HiddenFile::row() const
+void HiddenFile::unindex(HiddenFile *child)
+{
+    if (child->isDir()) {
+        children->dirs.remove(child->nameId, child);
+    }
+    else {
+        children->files.remove(child->nameId, child);
+    }
+}
+
+void HiddenFile::renumberFrom(int idx)
 {
-    if (theParent != NULL) {
-        return theParent->children.indexOf(const_cast<HiddenFile*>(this));
+    QList<HiddenFile*> &list = children->list;
+    for (int i = idx, len = list.count(); i < len; ++i) {
+        list[i]->theRow = i;
     }
-    return 0;
 }
 
 HiddenFile* HiddenFile::childFileByName(const QString &name) const
 {
-    foreach (HiddenFile *theOne, children) {
-        if (!theOne->isDir() && theOne->getName() == name) {
-            return theOne;
-        }
+    quint32 id;
+    if (children == NULL || !tree->findName(name, &id)) {
+        return NULL;
     }
-    return NULL;
+    return children->files.value(id, NULL);
 }
 
 HiddenFile* HiddenFile::childDirByName(const QString &name) const
 {
-    foreach (HiddenFile *theOne, children) {
-        if (theOne->isDir() && theOne->getName() == name) {
-            return theOne;
-        }
+    quint32 id;
+    if (children == NULL || !tree->findName(name, &id)) {
+        return NULL;
     }
-    return NULL;
+    return children->dirs.value(id, NULL);
 }
@@ -2,18 +2,22 @@
 #define HIDDENFILE_H
 
 #include <QList>
+#include <QMultiHash>
 #include <QString>
 
+class HiddenTree;
+
+//
+// A node of a HiddenTree. Nodes are carved out of the arenas of their
+// tree and never move, so a pointer to one stays valid until the node
+// is removed. Only nodes with children own any memory of their own.
+//
 class HiddenFile {
 public:
     static const quint64 INVALID_INO = ~((quint64)0);
 
 public:
-    HiddenFile(const QString &name, bool isDirectory,
-               HiddenFile *parent = 0, quint64 ino = INVALID_INO);
-    ~HiddenFile();
-
-    const QString& getName() const { return name; }
+    const QString& getName() const;
     void setIno(quint64 ino) { this->ino = ino; }
     quint64 getIno()  const { return ino; }
 
@@ -23,26 +27,58 @@ public:
 
     void append(HiddenFile *file);
     void removeAt(int idx);
+    void removeRange(int first, int last);
     void removeAll();
     HiddenFile* extractAt(int idx);
 
-    HiddenFile* childAt(int idx) { return children[idx]; }
+    HiddenFile* childAt(int idx) { return children->list[idx]; }
     HiddenFile* parent() { return theParent; }
-    int childrenCount() const { return children.count(); }
-    int row() const;
+    int childrenCount() const { return children ? children->list.count() : 0; }
+
+    // How many of the children the model has shown so far
+    int fetchedCount() const { return children ? children->fetched : 0; }
+    void setFetchedCount(int count) { children->fetched = count; }
+    int row() const { return theRow; }
 
     HiddenFile* childFileByName(const QString &name) const;
     HiddenFile* childDirByName(const QString &name) const;
 
+    // The next live node with the same name anywhere in the tree
+    HiddenFile* nextNamesake() const { return nextSameName; }
+
 private:
-    QString name;
+    friend class HiddenTree;
+
+    // Children by position and by name, files and directories apart
+    struct Children {
+        QList<HiddenFile*> list;
+        QMultiHash<quint32, HiddenFile*> files;
+        QMultiHash<quint32, HiddenFile*> dirs;
+        int fetched;
+
+        // Every Children of the tree, so that it can be torn down
+        // without walking the nodes
+        Children *prev;
+        Children *next;
+    };
+
+    HiddenTree *tree;
+    HiddenFile *theParent;
+    Children *children;
+    HiddenFile *prevSameName;
+    HiddenFile *nextSameName;
     quint64 ino;
+    quint32 nameId;
+    int theRow;
 
     bool hidden;
     bool directory;
 
-    QList<HiddenFile*> children;
-    HiddenFile *theParent;
+    HiddenFile(HiddenTree *tree, quint32 nameId, bool isDirectory,
+               HiddenFile *parent, quint64 ino);
+
+    void unindex(HiddenFile *child);
+    void renumberFrom(int idx);
 };
 
 #endif // HIDDENFILE_H
@@ -1,17 +1,22 @@
 #include "HiddenModel.h"
 
-#include <QPixmap>
+#include <QCoreApplication>
 
-HiddenModel::HiddenModel(DriverGate *gate, QObject *parent)
+HiddenModel::HiddenModel(Driver *gate, QObject *parent)
   : QAbstractItemModel(parent),
-    gate(gate)
+    gate(gate),
+    worker(NULL),
+    workerThread(NULL),
+    lastJobError(OKAY)
 {
-    root = new HiddenFile("", false);
+    root = tree.root();
+    qRegisterMetaType< QList<quint64> >("QList<quint64>");
 }
 
 HiddenModel::~HiddenModel()
 {
-    delete root;
+    cancelHiding();
+    waitForHiding();
     delete gate;
 }
 
@@ -56,7 +61,45 @@ int HiddenModel::columnCount(const QModelIndex&) const
 
 int HiddenModel::rowCount(const QModelIndex &parent) const
 {
-    return the(parent)->childrenCount();
+    return the(parent)->fetchedCount();
+}
+
+//
+// Children are shown in chunks as the view asks for them, so that
+// a directory with a million hidden files does not have to be laid out
+// all at once
+//
+bool HiddenModel::canFetchMore(const QModelIndex &parent) const
+{
+    HiddenFile *file = the(parent);
+    return file->fetchedCount() < file->childrenCount();
+}
+
+void HiddenModel::fetchMore(const QModelIndex &parent)
+{
+    HiddenFile *file = the(parent);
+    int fetched = file->fetchedCount();
+    int count = file->childrenCount() - fetched;
+    if (count > fetch_chunk) {
+        count = fetch_chunk;
+    }
+    if (count <= 0) {
+        return;
+    }
+    beginInsertRows(parent, fetched, fetched + count - 1);
+    file->setFetchedCount(fetched + count);
+    endInsertRows();
+}
+
+void HiddenModel::fetchUpTo(HiddenFile *parent, int row)
+{
+    int fetched = parent->fetchedCount();
+    if (row < fetched) {
+        return;
+    }
+    beginInsertRows(indexOf(parent), fetched, row);
+    parent->setFetchedCount(row + 1);
+    endInsertRows();
 }
 
 QVariant HiddenModel::data(const QModelIndex &index, int role) const
@@ -66,20 +109,23 @@ QVariant HiddenModel::data(const QModelIndex &index, int role) const
         return QVariant(the(index)->getName());
 
     case Qt::DecorationRole:
-    {   QString path;
+    {   if (fileIcon.isNull()) {
+            fileIcon = QPixmap(":/icon/file.png");
+            dirIcon = QPixmap(":/icon/dir.png");
+            hiddenDirIcon = QPixmap(":/icon/hiddendir.png");
+        }
         HiddenFile *file = the(index);
         if (file->isDir()) {
             if (file->isHidden()) {
-                path = ":/icon/hiddendir.png";
+                return QVariant(hiddenDirIcon);
             }
             else {
-                path = ":/icon/dir.png";
+                return QVariant(dirIcon);
             }
         }
         else {
-            path = ":/icon/file.png";
+            return QVariant(fileIcon);
         }
-        return QVariant(QPixmap(path));
     }
     default:
         return QVariant();
@@ -96,15 +142,161 @@ HiddenFile* HiddenModel::the(const QModelIndex &index) const
     }
 }
 
+QModelIndex HiddenModel::indexOf(HiddenFile *file) const
+{
+    if (file == root) {
+        return QModelIndex();
+    }
+    return createIndex(file->row(), 0, file);
+}
+
+//
+// Paths of directories are remembered both ways, so every ancestor path
+// is built only once and shared by all of its users. The table is
+// dropped whenever nodes go away, since their memory gets reused.
+//
+QString HiddenModel::pathOf(HiddenFile *file) const
+{
+    if (file == root) {
+        return QString();
+    }
+    QHash<HiddenFile*, QString>::const_iterator known = pathByDir.constFind(file);
+    if (known != pathByDir.constEnd()) {
+        return known.value();
+    }
+    QString path;
+    if (file->parent() == root) {
+        path = file->getName();
+    }
+    else {
+        path = childPath(pathOf(file->parent()), file->getName());
+    }
+    if (file->isDir()) {
+        rememberDir(path, file);
+    }
+    return path;
+}
+
+void HiddenModel::rememberDir(const QString &path, HiddenFile *dir) const
+{
+    dirByPath.insert(path, dir);
+    pathByDir.insert(dir, path);
+}
+
+void HiddenModel::forgetDirs()
+{
+    dirByPath.clear();
+    pathByDir.clear();
+}
+
+//
+// Paths are split as strings, they are absolute and clean already
+//
+QString HiddenModel::parentPath(const QString &path)
+{
+    int slash = path.lastIndexOf('/');
+    if (slash <= 0) {
+        return QString("/");
+    }
+    return path.left(slash);
+}
+
+QString HiddenModel::childPath(const QString &dir, const QString &name)
+{
+    if (dir.endsWith('/')) {
+        return dir + name;
+    }
+    return dir + '/' + name;
+}
+
+// Whether the view may know about the node
+bool HiddenModel::isExposed(HiddenFile *file) const
+{
+    while (file != root) {
+        HiddenFile *parent = file->parent();
+        if (file->row() >= parent->fetchedCount()) {
+            return false;
+        }
+        file = parent;
+    }
+    return true;
+}
+
+//
+// Rows are announced in one go and only as far as the parent has been
+// fetched. Children of a fully shown parent are shown right away while
+// it stays within one fetch chunk, the rest waits for fetchMore().
+//
+void HiddenModel::insertChildren(HiddenFile *parent,
+                                 const QList<HiddenFile*> &children)
+{
+    int oldCount = parent->childrenCount();
+    int newCount = oldCount + children.count();
+    int limit = parent->fetchedCount();
+    if (limit == oldCount && oldCount < fetch_chunk) {
+        limit = (newCount < fetch_chunk) ? newCount : (int)fetch_chunk;
+    }
+    bool announce = (limit > oldCount) && isExposed(parent);
+    if (announce) {
+        beginInsertRows(indexOf(parent), oldCount, limit - 1);
+    }
+    foreach (HiddenFile *child, children) {
+        parent->append(child);
+    }
+    if (limit > oldCount) {
+        parent->setFetchedCount(limit);
+    }
+    if (announce) {
+        endInsertRows();
+    }
+}
+
+void HiddenModel::removeChildren(HiddenFile *parent, int first, int last)
+{
+    forgetDirs();
+    int fetched = parent->fetchedCount();
+    int visibleLast = (last < fetched) ? last : fetched - 1;
+    bool announce = (first <= visibleLast) && isExposed(parent);
+    if (announce) {
+        beginRemoveRows(indexOf(parent), first, visibleLast);
+    }
+    if (first <= visibleLast) {
+        parent->setFetchedCount(fetched - (visibleLast - first + 1));
+    }
+    parent->removeRange(first, last);
+    if (announce) {
+        endRemoveRows();
+    }
+}
+
 //
 // Internal stuff
 //
 
 void HiddenModel::changeDevice(const QString &path)
 {
+    if (isBusy()) {
+        return;
+    }
+    gate->close();
     gate->setDevice(path.toAscii().data());
 }
 
+//
+// The gate is opened on first use and is kept open for the whole session,
+// so that every operation does not pay for opening the device.
+//
+HiddenModel::ErrorCode HiddenModel::openGate()
+{
+    if (isBusy()) {
+        return DEVICE_BUSY;
+    }
+    if (gate->isOpen()) {
+        return OKAY;
+    }
+    return translate(gate->tryOpen());
+}
+
 QString HiddenModel::getClosestUnhiddenPath(const QModelIndex &index) const
 {
     if (!index.isValid()) {
@@ -117,385 +309,550 @@ QString HiddenModel::getClosestUnhiddenPath(const QModelIndex &index) const
     if (file == root) {
         return QString();
     }
-    QString result = file->getName();
-    file = file->parent();
-    if (file == root) {
-        return result;
-    }
-    while (file->parent() != root) {
-        result.prepend('/').prepend(file->getName());
-        file = file->parent();
-    }
-    result.prepend(file->getName());
-    return result;
+    return pathOf(file);
 }
 
 //
-// Hidden file tree management
+// Searching goes through the name index of the tree, only the nodes with
+// matching names are looked at
 //
-
-HiddenModel::ErrorCode
-HiddenModel::hideFile(const QString &path, bool recursive)
+QStringList HiddenModel::findFiles(const QString &query, int limit) const
 {
-    QFileInfo info(path);
-    Q_ASSERT(info.isAbsolute());
-    if (info.isFile() || info.isSymLink()) {
-        return hideFile(info);
+    QStringList result;
+    QString needle = query.section('/', -1, -1, QString::SectionSkipEmpty);
+    if (needle.isEmpty()) {
+        return result;
     }
-    else {
-        return hideDir(info, recursive);
+    bool byPath = query.contains('/');
+    foreach (quint32 id, tree.findNames(needle)) {
+        for (HiddenFile *file = tree.firstNamed(id);
+             file != NULL;
+             file = file->nextNamesake())
+        {
+            QString path = pathOf(file);
+            if (byPath && !path.contains(query, Qt::CaseInsensitive)) {
+                continue;
+            }
+            result.append(path);
+            if (result.count() == limit) {
+                return result;
+            }
+        }
     }
+    return result;
 }
 
-HiddenModel::ErrorCode
-HiddenModel::unhideFile(const QModelIndex &index, bool recursive)
+QModelIndex HiddenModel::reveal(const QString &path)
 {
-    if (the(index)->isDir()) {
-        return unhideDir(index, recursive);
+    HiddenFile *file = findDirPath(path);
+    if (file == NULL) {
+        HiddenFile *dir = findDirPath(parentPath(path));
+        if (dir != NULL) {
+            file = dir->childFileByName(path.mid(path.lastIndexOf('/') + 1));
+        }
     }
-    else {
-        return unhideFile_(index);
+    if (file == NULL) {
+        return QModelIndex();
     }
-}
-
-HiddenModel::ErrorCode
-HiddenModel::unhideAll()
-{
-    ErrorCode err = translate(gate->tryOpen());
-    if (err != OKAY) {
-        return err;
+    // From the top down, so that every parent is exposed by the time
+    // its own rows are announced
+    QList<HiddenFile*> chain;
+    for (HiddenFile *f = file; f != root; f = f->parent()) {
+        chain.prepend(f);
     }
-    err = translate(gate->unhideAll());
-    gate->close();
-    if (err != OKAY) {
-        return err;
+    foreach (HiddenFile *f, chain) {
+        fetchUpTo(f->parent(), f->row());
     }
-    beginResetModel();
-    root->removeAll();
-    endResetModel();
-    return OKAY;
+    return indexOf(file);
 }
 
-HiddenModel::ErrorCode
-HiddenModel::hideFile(QFileInfo &file)
-{
-    QStringList parentPath = tokenizeDirPath(file.dir());
-    if (fileAlreadyHidden(file, parentPath)) {
-        return ALREADY_HIDDEN;
-    }
-    QModelIndex parent = ensureDirPath(parentPath);
-    ErrorCode err = translate(gate->tryOpen());
-    if (err != OKAY) {
-        removeTrashDirectories(parent);
-        return err;
-    }
-    err = doHideFile(parent, file);
-    gate->close();
-    return err;
-}
+//
+// Hidden file tree management
+//
 
+//
+// Same as startHiding(), but returns only when the job is over
+//
 HiddenModel::ErrorCode
-HiddenModel::doHideFile(const QModelIndex &parent, const QFileInfo &file)
+HiddenModel::hideFile(const QString &path, bool recursive)
 {
-    quint64 ino;
-    ErrorCode err = internalHideFile(file, &ino);
+    ErrorCode err = startHiding(path, recursive);
     if (err != OKAY) {
-        removeTrashDirectories(parent);
         return err;
     }
-    int index = the(parent)->childrenCount();
-    beginInsertRows(parent, index, index);
-    HiddenFile *child = new HiddenFile(file.fileName(), false, the(parent), ino);
-    the(parent)->append(child);
-    endInsertRows();
-    return OKAY;
+    waitForHiding();
+    return lastJobError;
 }
 
 HiddenModel::ErrorCode
-HiddenModel::internalHideFile(const QFileInfo &file, quint64 *ino)
+HiddenModel::startHiding(const QString &path, bool recursive)
 {
-    Q_ASSERT(gate->isOpen());
-    const char *path = file.absoluteFilePath().toStdString().c_str();
-    return translate(gate->hide(path, ino));
+    return startHiding(QStringList() << path, recursive);
 }
 
+//
+// Files which are hidden already or which are hidden along with another
+// target are left out, the job fails only if nothing is left
+//
 HiddenModel::ErrorCode
-HiddenModel::hideDir(QFileInfo &dir, bool recursive)
-{
-    const QDir the_dir(dir.absoluteFilePath());
-    QStringList dirpath = tokenizeDirPath(the_dir);
-    if (dirAlreadyHidden(dirpath)) {
-        return ALREADY_HIDDEN;
-    }
-    int childCount;
-    ErrorCode err = OKAY;
-    QModelIndex dirIndex = ensureDirPath(dirpath);
-    err = hideChildFiles(dirIndex, the_dir);
-    if (err != OKAY) {
-        goto error;
-    }
-    if (recursive) {
-        err = hideChildDirs(dirIndex, the_dir);
-        if (err != OKAY) {
-            goto error;
+HiddenModel::startHiding(const QStringList &paths, bool recursive)
+{
+    QStringList targets;
+    QSet<QString> dirs;
+    QList<bool> isFile;
+    foreach (const QString &path, paths) {
+        QFileInfo info(path);
+        Q_ASSERT(info.isAbsolute());
+        QString cleanPath = QDir::cleanPath(info.absoluteFilePath());
+        bool file = info.isFile() || info.isSymLink();
+        if (file ? fileAlreadyHidden(parentPath(cleanPath), info.fileName())
+                 : dirAlreadyHidden(cleanPath))
+        {
+            continue;
         }
-    }
-    the_dir.refresh();
-    childCount = the_dir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot).count();
-    if (recursive || childCount == 0) {
-        ErrorCode err = translate(gate->tryOpen());
-        if (err != OKAY) {
-            goto error;
+        if (!file) {
+            if (dirs.contains(cleanPath)) {
+                continue;
+            }
+            dirs.insert(cleanPath);
         }
-        quint64 ino;
-        err = internalHideFile(dir, &ino);
-        gate->close();
-        if (err != OKAY) {
-            goto error;
+        targets.append(cleanPath);
+        isFile.append(file);
+    }
+    QStringList jobTargets;
+    for (int i = 0; i < targets.count(); ++i) {
+        // A directory hidden on its own covers only the files right in it
+        if ((recursive || isFile.at(i)) && coveredBy(dirs, targets.at(i), recursive)) {
+            continue;
         }
-        the(dirIndex)->setIno(ino);
-        the(dirIndex)->hide(true);
+        jobTargets.append(targets.at(i));
+    }
+    if (jobTargets.isEmpty()) {
+        return ALREADY_HIDDEN;
+    }
+    ErrorCode err = openGate();
+    if (err != OKAY) {
+        return err;
     }
+    jobPaths = jobTargets;
+    worker = new HideWorker(gate, jobPaths, recursive);
+    workerThread = new QThread(this);
+    worker->moveToThread(workerThread);
+    connect(workerThread, SIGNAL(started()), worker, SLOT(run()));
+    connect(worker, SIGNAL(filesHidden(QString,QStringList,QList<quint64>)),
+            this, SLOT(workerHidFiles(QString,QStringList,QList<quint64>)));
+    connect(worker, SIGNAL(dirHidden(QString,quint64)),
+            this, SLOT(workerHidDir(QString,quint64)));
+    connect(worker, SIGNAL(progress(int,int)),
+            this, SIGNAL(hidingProgress(int,int)));
+    connect(worker, SIGNAL(finished(int)),
+            this, SLOT(workerFinished(int)));
+    // Lets waitForHiding() join the thread while this one is blocked
+    connect(worker, SIGNAL(finished(int)),
+            workerThread, SLOT(quit()), Qt::DirectConnection);
+    workerThread->start();
     return OKAY;
-error:
-    removeTrashDirectories(dirIndex);
-    return err;
 }
 
-bool HiddenModel::fileAlreadyHidden(const QFileInfo &info,
-                                    const QStringList &dirpath) const
+bool HiddenModel::coveredBy(const QSet<QString> &dirs, const QString &path,
+                            bool recursive)
 {
-    HiddenFile *parent = tryDescent(dirpath);
-    if (!parent) {
-        return false;
+    QString dir = path;
+    while (dir != "/") {
+        dir = parentPath(dir);
+        if (dirs.contains(dir)) {
+            return true;
+        }
+        if (!recursive) {
+            break;
+        }
     }
-    HiddenFile *child = parent->childFileByName(info.fileName());
-    return (child != NULL && child->isHidden());
+    return false;
 }
 
-bool HiddenModel::dirAlreadyHidden(const QStringList &dirpath) const
+void HiddenModel::cancelHiding()
 {
-    HiddenFile *dir = tryDescent(dirpath);
-    return (dir != NULL && dir->isHidden());
+    if (worker) {
+        worker->cancel();
+    }
 }
 
-HiddenFile* HiddenModel::tryDescent(const QStringList &dirpath) const
+//
+// Blocks until the background job is over and its results are in the model
+//
+void HiddenModel::waitForHiding()
 {
-    HiddenFile *currentFile = root;
-    for (QStringList::ConstIterator currentDir = dirpath.constBegin(),
-                                    lastDir = dirpath.constEnd();
-         currentDir != lastDir;
-         ++currentDir)
-    {
-        currentFile = currentFile->childDirByName(*currentDir);
-        if (currentFile == NULL) {
-            return NULL;
-        }
+    if (workerThread) {
+        workerThread->wait();
+        QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
     }
-    return currentFile;
 }
 
-QStringList HiddenModel::tokenizeDirPath(QDir dir)
+void HiddenModel::workerHidFiles(const QString &dir, const QStringList &names,
+                                 const QList<quint64> &inos)
 {
-    QStringList result;
-    while (!dir.isRoot()) {
-        result.push_front(dir.dirName());
-        dir.cdUp();
+    HiddenFile *parent = ensureDirPath(dir);
+    QList<HiddenFile*> children;
+    for (int i = 0; i < names.count(); ++i) {
+        HiddenFile *child = tree.create(names.at(i), false, parent, inos.at(i));
+        children.append(child);
+        jobFiles.insert(child);
     }
-    result.push_front(dir.absolutePath());
-    return result;
+    insertChildren(parent, children);
+    emit visibilityChanged(dir, false);
 }
 
-QModelIndex HiddenModel::ensureDirPath(const QStringList &dirpath)
+void HiddenModel::workerHidDir(const QString &dir, quint64 ino)
 {
-    QModelIndex currentIndex = QModelIndex();
-    HiddenFile *currentFile = root;
-    QStringList::ConstIterator currentDir = dirpath.constBegin();
-    QStringList::ConstIterator lastDir = dirpath.constEnd();
-    while (currentDir != lastDir) {
-        HiddenFile *child = currentFile->childDirByName(*currentDir);
-        if (child == NULL) {
-            break;
-        }
-        currentIndex = index(child->row(), 0, currentIndex);
-        currentFile = child;
-        ++currentDir;
-    }
-    while (currentDir != lastDir) {
-        HiddenFile *child = new HiddenFile(*currentDir, true, currentFile);
-        beginInsertRows(currentIndex,
-                        currentFile->childrenCount(),
-                        currentFile->childrenCount());
-        currentFile->append(child);
-        endInsertRows();
-        currentIndex = index(child->row(), 0, currentIndex);
-        currentFile = child;
-        ++currentDir;
+    HiddenFile *file = ensureDirPath(dir);
+    file->setIno(ino);
+    file->hide(true);
+    jobDirs.append(file);
+    emit visibilityChanged(parentPath(dir), false);
+    if (isExposed(file)) {
+        QModelIndex index = indexOf(file);
+        emit dataChanged(index, index);
     }
-    return currentIndex;
 }
 
-void HiddenModel::removeTrashDirectories(const QModelIndex &index)
+//
+// After a cancel the driver has already unhidden everything the job did,
+// so the files it added are dropped and its directories are shown again.
+// Either way the directories left with nothing hidden in them go away.
+//
+void HiddenModel::workerFinished(int status)
 {
-    if (!index.isValid()) {
-        return;
-    }
-    if (the(index)->childrenCount() > 0) {
-        return;
-    }
-    QModelIndex top = index;
-    QModelIndex prev;
-    while (top.isValid()) {
-        if (the(top)->childrenCount() > 1) {
-            break;
+    workerThread->quit();
+    workerThread->wait();
+    delete worker;
+    delete workerThread;
+    worker = NULL;
+    workerThread = NULL;
+
+    ErrorCode err;
+    QSet<HiddenFile*> dropped;
+    if (status == HideWorker::CANCELLED) {
+        foreach (HiddenFile *dir, jobDirs) {
+            dir->hide(false);
+            dir->setIno(HiddenFile::INVALID_INO);
+        }
+        dropped = jobFiles;
+        err = CANCELLED;
+        QSet<QString> parents;
+        foreach (const QString &path, jobPaths) {
+            parents.insert(parentPath(path));
+        }
+        foreach (const QString &dir, parents) {
+            emit visibilityChanged(dir, true);
         }
-        prev = top;
-        top = top.parent();
     }
-    if (top == index) {
-        return;
+    else {
+        err = translate(static_cast<Driver::Status>(status));
     }
-    int idx = the(prev)->row();
-    beginRemoveRows(top, idx, idx);
-    the(top)->removeAt(idx);
-    endRemoveRows();
+    pruneTree(root, dropped);
+    jobFiles.clear();
+    jobDirs.clear();
+    jobPaths.clear();
+    lastJobError = err;
+    emit hidingFinished(err);
 }
 
 HiddenModel::ErrorCode
-HiddenModel::hideChildFiles(const QModelIndex &parentIndex, const QDir &dir)
+HiddenModel::unhideFile(const QModelIndex &index, bool recursive)
 {
-    QFileInfoList children = dir.entryInfoList();
-    ErrorCode err = translate(gate->tryOpen());
+    return unhideFiles(QModelIndexList() << index, recursive);
+}
+
+//
+// The whole selection goes to the driver in one batch, shallower files
+// first, so that a directory is always unhidden before the files in it.
+// The model is updated once, when the driver is done with all of them.
+//
+HiddenModel::ErrorCode
+HiddenModel::unhideFiles(const QModelIndexList &indexes, bool recursive)
+{
+    QMultiMap<int, HiddenFile*> byDepth;
+    foreach (const QModelIndex &index, indexes) {
+        HiddenFile *file = the(index);
+        int depth = 0;
+        for (HiddenFile *p = file; p != root; p = p->parent()) {
+            ++depth;
+        }
+        byDepth.insert(depth, file);
+    }
+    QList<HiddenFile*> targets;
+    QList<HiddenFile*> batch;
+    QSet<HiddenFile*> queued;
+    foreach (HiddenFile *file, byDepth) {
+        if (queued.contains(file)) {
+            continue;
+        }
+        HiddenFile *parent = file->parent();
+        if (parent->isHidden() && !queued.contains(parent)) {
+            return HIDDEN_PARENT;
+        }
+        targets.append(file);
+        queued.insert(file);
+        if (file->isHidden()) {
+            batch.append(file);
+        }
+        if (recursive && file->isDir()) {
+            collectHidden(file, batch, queued);
+        }
+    }
+    if (targets.isEmpty()) {
+        return OKAY;
+    }
+    ErrorCode err = openGate();
     if (err != OKAY) {
         return err;
     }
-    foreach (const QFileInfo &entry, children) {
-        if (!entry.isFile()) {
+
+    QVector<unsigned long long> inos;
+    inos.reserve(batch.count());
+    foreach (HiddenFile *file, batch) {
+        inos.append(file->getIno());
+    }
+    QVector<Driver::Status> statuses(batch.count(), Driver::UNKNOWN_ERROR);
+    err = translate(gate->unhide(inos.constData(), inos.count(), statuses.data()));
+
+    QSet<HiddenFile*> dropped;
+    QSet<QString> changedDirs;
+    for (int i = 0; i < batch.count(); ++i) {
+        if (statuses.at(i) != Driver::OKAY) {
             continue;
         }
-        err = doHideFile(parentIndex, entry);
-        if (err != OKAY) {
-            removeTrashDirectories(parentIndex);
-            break;
+        HiddenFile *file = batch.at(i);
+        changedDirs.insert(pathOf(file->parent()));
+        if (file->isDir()) {
+            file->hide(false);
+            file->setIno(HiddenFile::INVALID_INO);
+            if (isExposed(file)) {
+                QModelIndex index = indexOf(file);
+                emit dataChanged(index, index);
+            }
+        }
+        else {
+            dropped.insert(file);
         }
     }
-    gate->close();
+    QStringList changedTrees;
+    if (recursive) {
+        foreach (HiddenFile *file, targets) {
+            if (file->isDir()) {
+                changedTrees.append(pathOf(file));
+            }
+        }
+    }
+
+    // Everything affected hangs below the common ancestor of the targets
+    HiddenFile *top = targets.first()->parent();
+    foreach (HiddenFile *file, targets) {
+        top = commonAncestor(top, file->parent());
+    }
+    pruneTree(top, dropped);
+    if (!top->isHidden()) {
+        removeTrashDirectories(top);
+    }
+
+    foreach (const QString &dir, changedDirs) {
+        emit visibilityChanged(dir, false);
+    }
+    foreach (const QString &dir, changedTrees) {
+        emit visibilityChanged(dir, true);
+    }
     return err;
 }
 
-HiddenModel::ErrorCode
-HiddenModel::hideChildDirs(const QModelIndex &parentIndex, const QDir &dir)
-{
-    QFileInfoList children = dir.entryInfoList(QDir::AllDirs | QDir::NoDotAndDotDot);
-    foreach (const QFileInfo &entry, children) {
-        if (entry.isFile()) {
-            continue;
+//
+// Queues the hidden files below @dir level by level
+//
+void HiddenModel::collectHidden(HiddenFile *dir, QList<HiddenFile*> &batch,
+                                QSet<HiddenFile*> &queued)
+{
+    QList<HiddenFile*> level;
+    level.append(dir);
+    for (int i = 0; i < level.count(); ++i) {
+        HiddenFile *current = level.at(i);
+        for (int j = 0, len = current->childrenCount(); j < len; ++j) {
+            HiddenFile *child = current->childAt(j);
+            if (queued.contains(child)) {
+                continue;
+            }
+            queued.insert(child);
+            if (child->isHidden()) {
+                batch.append(child);
+            }
+            if (child->isDir()) {
+                level.append(child);
+            }
         }
-        // inefficient
-        QFileInfo theDir(entry);
-        ErrorCode err = hideDir(theDir, true);
-        if (err != OKAY) {
-            removeTrashDirectories(parentIndex);
-            return err;
+    }
+}
+
+HiddenFile* HiddenModel::commonAncestor(HiddenFile *a, HiddenFile *b) const
+{
+    QSet<HiddenFile*> ancestors;
+    for (; a != root; a = a->parent()) {
+        ancestors.insert(a);
+    }
+    for (; b != root; b = b->parent()) {
+        if (ancestors.contains(b)) {
+            return b;
         }
     }
-    return OKAY;
+    return root;
 }
 
 HiddenModel::ErrorCode
-HiddenModel::unhideDir(const QModelIndex &index, bool recursive)
+HiddenModel::unhideAll()
 {
-    HiddenFile *file = the(index);
-    if (file->parent()->isHidden()) {
-        return HIDDEN_PARENT;
+    ErrorCode err = openGate();
+    if (err != OKAY) {
+        return err;
     }
-    ErrorCode err = translate(gate->tryOpen());
+    err = translate(gate->unhideAll());
     if (err != OKAY) {
         return err;
     }
-    if (file->isHidden()) {
-        err = translate(gate->unhide(file->getIno()));
-        if (err != OKAY) {
-            goto out;
-        }
-        file->hide(false);
+    beginResetModel();
+    tree.clear();
+    root = tree.root();
+    forgetDirs();
+    endResetModel();
+    emit visibilityChanged("/", true);
+    return OKAY;
+}
+
+bool HiddenModel::fileAlreadyHidden(const QString &dirPath,
+                                    const QString &name) const
+{
+    HiddenFile *parent = findDirPath(dirPath);
+    if (!parent) {
+        return false;
     }
-    if (recursive) {
-        err = unhideTree(file);
-        if (err != OKAY) {
-            goto out;
+    HiddenFile *child = parent->childFileByName(name);
+    return (child != NULL && child->isHidden());
+}
+
+bool HiddenModel::dirAlreadyHidden(const QString &path) const
+{
+    HiddenFile *dir = findDirPath(path);
+    return (dir != NULL && dir->isHidden());
+}
+
+HiddenFile* HiddenModel::findDirPath(const QString &path) const
+{
+    HiddenFile *dir = dirByPath.value(path, NULL);
+    if (dir != NULL) {
+        return dir;
+    }
+    HiddenFile *parent;
+    QString name;
+    if (path == "/") {
+        parent = root;
+        name = path;
+    }
+    else {
+        parent = findDirPath(parentPath(path));
+        if (parent == NULL) {
+            return NULL;
         }
-        beginRemoveRows(index.parent(), index.row(), index.row());
-        file->parent()->removeAt(file->row());
-        endRemoveRows();
-        removeTrashDirectories(index.parent());
+        name = path.mid(path.lastIndexOf('/') + 1);
+    }
+    dir = parent->childDirByName(name);
+    if (dir != NULL) {
+        rememberDir(path, dir);
+    }
+    return dir;
+}
+
+HiddenFile* HiddenModel::ensureDirPath(const QString &path)
+{
+    HiddenFile *dir = dirByPath.value(path, NULL);
+    if (dir != NULL) {
+        return dir;
+    }
+    HiddenFile *parent;
+    QString name;
+    if (path == "/") {
+        parent = root;
+        name = path;
     }
     else {
-        removeTrashDirectories(index);
+        parent = ensureDirPath(parentPath(path));
+        name = path.mid(path.lastIndexOf('/') + 1);
     }
-out:
-    gate->close();
-    return err;
+    dir = parent->childDirByName(name);
+    if (dir == NULL) {
+        dir = tree.create(name, true, parent);
+        insertChildren(parent, QList<HiddenFile*>() << dir);
+    }
+    rememberDir(path, dir);
+    return dir;
 }
 
-HiddenModel::ErrorCode
-HiddenModel::unhideTree(HiddenFile *root)
+void HiddenModel::removeTrashDirectories(HiddenFile *file)
 {
-    Q_ASSERT(gate->isOpen());
-    ErrorCode err;
-    for (int i = 0, len = root->childrenCount(); i < len; ++i) {
-        HiddenFile *child = root->childAt(i);
-        err = translate(gate->unhide(child->getIno()));
-        if (err != OKAY) {
-            return err;
-        }
-        if (child->isDir()) {
-            child->hide(true);
-            err = unhideTree(child);
-            if (err != OKAY) {
-                return err;
-            }
+    if (file == root) {
+        return;
+    }
+    if (file->childrenCount() > 0) {
+        return;
+    }
+    HiddenFile *top = file;
+    HiddenFile *prev = NULL;
+    while (top != root) {
+        if (top->childrenCount() > 1) {
+            break;
         }
+        prev = top;
+        top = top->parent();
     }
-    return OKAY;
+    if (top == file) {
+        return;
+    }
+    int idx = prev->row();
+    removeChildren(top, idx, idx);
 }
 
-HiddenModel::ErrorCode
-HiddenModel::unhideFile_(const QModelIndex &index)
+//
+// Removes the @dropped files and the visible directories which end up
+// with no children, taking adjacent rows out in one go
+//
+void HiddenModel::pruneTree(HiddenFile *file, const QSet<HiddenFile*> &dropped)
 {
-    HiddenFile *file = the(index);
-    if (file->parent()->isHidden()) {
-        return HIDDEN_PARENT;
-    }
-    ErrorCode err = translate(gate->tryOpen());
-    if (err != OKAY) {
-        return err;
+    int last = file->childrenCount() - 1;
+    while (last >= 0) {
+        int first = last;
+        while (first >= 0 && prunable(file, first, dropped)) {
+            --first;
+        }
+        if (first < last) {
+            removeChildren(file, first + 1, last);
+        }
+        last = first - 1;
     }
-    err = doUnhideFile(index.parent(), file);
-    gate->close();
-    return err;
 }
 
-HiddenModel::ErrorCode
-HiddenModel::doUnhideFile(const QModelIndex &parent, HiddenFile *file)
+bool HiddenModel::prunable(HiddenFile *parent, int row,
+                           const QSet<HiddenFile*> &dropped)
 {
-    Q_ASSERT(gate->isOpen());
-    ErrorCode err = translate(gate->unhide(file->getIno()));
-    if (err != OKAY) {
-        return err;
+    HiddenFile *child = parent->childAt(row);
+    if (dropped.contains(child)) {
+        return true;
     }
-    int index = file->row();
-    beginRemoveRows(parent, index, index);
-    file->parent()->removeAt(index);
-    endRemoveRows();
-    removeTrashDirectories(parent);
-    return OKAY;
+    if (!child->isDir() || child->isHidden()) {
+        return false;
+    }
+    pruneTree(child, dropped);
+    return child->childrenCount() == 0;
 }
 
 HiddenModel::ErrorCode
 HiddenModel::unhideParents(const QModelIndex &index)
 {
-    ErrorCode err = translate(gate->tryOpen());
+    ErrorCode err = openGate();
     if (err != OKAY) {
         return err;
     }
@@ -512,32 +869,33 @@ HiddenModel::unhideParents(const QModelIndex &index)
             break;
         }
         file->hide(false);
+        emit visibilityChanged(pathOf(file->parent()), false);
     }
-    gate->close();
     return err;
 }
 
-HiddenModel::ErrorCode HiddenModel::translate(DriverGate::OpenStatus status)
+HiddenModel::ErrorCode HiddenModel::translate(Driver::OpenStatus status)
 {
     switch (status) {
-    case DriverGate::OPEN:      return OKAY;
-    case DriverGate::NOT_FOUND: return DEVICE_NOT_FOUND;
-    case DriverGate::BUSY:      return DEVICE_BUSY;
+    case Driver::OPEN:      return OKAY;
+    case Driver::NOT_FOUND: return DEVICE_NOT_FOUND;
+    case Driver::BUSY:      return DEVICE_BUSY;
     default:
         return OPEN_FILE_PROBLEM;
     }
 }
 
-HiddenModel::ErrorCode HiddenModel::translate(DriverGate::Status status)
+HiddenModel::ErrorCode HiddenModel::translate(Driver::Status status)
 {
-    Q_ASSERT(status != DriverGate::INVALID_FORMAT
-          && status != DriverGate::NOT_OPEN);
+    Q_ASSERT(status != Driver::NOT_OPEN);
     switch (status) {
-    case DriverGate::OKAY:           return OKAY;
-    case DriverGate::MOUNT_POINT:    return MOUNT_POINT;
-    case DriverGate::ALREADY_HIDDEN: return ALREADY_HIDDEN;
-    case DriverGate::HIDDEN_PARENT:  return HIDDEN_PARENT;
-    case DriverGate::UNKNOWN_FILE:   return LOST_FILE;
+    case Driver::OKAY:           return OKAY;
+    // Batches answer paths too long for a request with it
+    case Driver::INVALID_FORMAT: return HIDING_PROBLEM;
+    case Driver::MOUNT_POINT:    return MOUNT_POINT;
+    case Driver::ALREADY_HIDDEN: return ALREADY_HIDDEN;
+    case Driver::HIDDEN_PARENT:  return HIDDEN_PARENT;
+    case Driver::UNKNOWN_FILE:   return LOST_FILE;
     default:
         return HIDING_PROBLEM;
     }
@@ -3,13 +3,22 @@
 
 #include <QAbstractItemModel>
 #include <QFileInfo>
+#include <QHash>
+#include <QMultiMap>
+#include <QPixmap>
 #include <QDir>
+#include <QSet>
 #include <QStringList>
+#include <QThread>
 
-#include "DriverGate.hpp"
+#include "Driver.hpp"
 #include "HiddenFile.h"
+#include "HiddenTree.h"
+#include "HideWorker.hpp"
 
 class HiddenModel : public QAbstractItemModel {
+    Q_OBJECT
+
 public:
     enum ErrorCode { OKAY,
                      ALREADY_HIDDEN,
@@ -19,10 +28,11 @@ public:
                      MOUNT_POINT,
                      HIDDEN_PARENT,
                      LOST_FILE,
-                     HIDING_PROBLEM
+                     HIDING_PROBLEM,
+                     CANCELLED
                    };
 public:
-    HiddenModel(DriverGate *gate, QObject *parent = 0);
+    HiddenModel(Driver *gate, QObject *parent = 0);
     ~HiddenModel();
 
     QModelIndex parent(const QModelIndex &index) const;
@@ -32,8 +42,25 @@ public:
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
     QVariant data(const QModelIndex &index, int role) const;
 
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
     ErrorCode hideFile(const QString &path, bool recursive);
+
+    // Hides the file in the background, the model is filled as the work
+    // goes on. Any other operation fails with DEVICE_BUSY until
+    // hidingFinished() is emitted. A cancelled job unhides whatever
+    // it has hidden and finishes with CANCELLED.
+    ErrorCode startHiding(const QString &path, bool recursive);
+    ErrorCode startHiding(const QStringList &paths, bool recursive);
+    void cancelHiding();
+    void waitForHiding();
+    bool isBusy() const { return worker != NULL; }
+
     ErrorCode unhideFile(const QModelIndex &index, bool recursive);
+    // Fails with HIDDEN_PARENT before touching anything if a file is
+    // in a hidden directory which is not unhidden along with it
+    ErrorCode unhideFiles(const QModelIndexList &indexes, bool recursive);
     ErrorCode unhideAll();
     ErrorCode unhideParents(const QModelIndex &index);
 
@@ -41,38 +68,80 @@ public:
 
     QString getClosestUnhiddenPath(const QModelIndex &index) const;
 
-private:
-    DriverGate *gate;
-    HiddenFile *root;
+    // Paths of at most @limit entries whose names contain the last
+    // component of @query. A query with slashes has to match the path.
+    QStringList findFiles(const QString &query, int limit) const;
+    // Index of the entry at @path, fetching every row needed to show it
+    QModelIndex reveal(const QString &path);
 
-    static ErrorCode translate(DriverGate::OpenStatus);
-    static ErrorCode translate(DriverGate::Status);
+signals:
+    void hidingProgress(int hiddenCount, int perSecond);
+    void hidingFinished(HiddenModel::ErrorCode err);
 
-    HiddenFile* the(const QModelIndex &index) const;
+    // The set of visible entries of the directory has changed, with
+    // @recursive also anywhere below it
+    void visibilityChanged(const QString &dirPath, bool recursive);
 
-    ErrorCode hideFile(QFileInfo &info);
-    ErrorCode hideDir(QFileInfo &info, bool recursive);
+private slots:
+    void workerHidFiles(const QString &dir, const QStringList &names,
+                        const QList<quint64> &inos);
+    void workerHidDir(const QString &dir, quint64 ino);
+    void workerFinished(int status);
 
-    ErrorCode doHideFile(const QModelIndex &parent, const QFileInfo &file);
-    ErrorCode internalHideFile(const QFileInfo &file, quint64 *ino);
+private:
+    static const int fetch_chunk = 1024;
 
-    bool fileAlreadyHidden(const QFileInfo &file, const QStringList &dir) const;
-    bool dirAlreadyHidden(const QStringList &dirpath) const;
+    Driver *gate;
+    HiddenTree tree;
+    HiddenFile *root;
 
-    QModelIndex ensureDirPath(const QStringList &dirpath);
-    void removeTrashDirectories(const QModelIndex &index);
+    mutable QPixmap fileIcon;
+    mutable QPixmap dirIcon;
+    mutable QPixmap hiddenDirIcon;
 
-    static QStringList tokenizeDirPath(QDir dir);
-    HiddenFile* tryDescent(const QStringList &dirpath) const;
+    HideWorker *worker;
+    QThread *workerThread;
+    QSet<HiddenFile*> jobFiles;
+    QList<HiddenFile*> jobDirs;
+    QStringList jobPaths;
+    ErrorCode lastJobError;
 
-    ErrorCode hideChildFiles(const QModelIndex &parentIndex, const QDir &dir);
-    ErrorCode hideChildDirs(const QModelIndex &parentIndex, const QDir &dir);
+    // Directory paths, built once and shared
+    mutable QHash<QString, HiddenFile*> dirByPath;
+    mutable QHash<HiddenFile*, QString> pathByDir;
 
-    ErrorCode unhideFile_(const QModelIndex &index);
-    ErrorCode unhideDir(const QModelIndex &index, bool recursive);
+    static ErrorCode translate(Driver::OpenStatus);
+    static ErrorCode translate(Driver::Status);
 
-    ErrorCode doUnhideFile(const QModelIndex &parent, HiddenFile *file);
-    ErrorCode unhideTree(HiddenFile *root);
+    HiddenFile* the(const QModelIndex &index) const;
+    QModelIndex indexOf(HiddenFile *file) const;
+    QString pathOf(HiddenFile *file) const;
+    void rememberDir(const QString &path, HiddenFile *dir) const;
+    void forgetDirs();
+    static QString parentPath(const QString &path);
+    static QString childPath(const QString &dir, const QString &name);
+    static bool coveredBy(const QSet<QString> &dirs, const QString &path,
+                          bool recursive);
+    bool isExposed(HiddenFile *file) const;
+
+    void insertChildren(HiddenFile *parent, const QList<HiddenFile*> &children);
+    void fetchUpTo(HiddenFile *parent, int row);
+    void removeChildren(HiddenFile *parent, int first, int last);
+
+    ErrorCode openGate();
+
+    bool fileAlreadyHidden(const QString &dirPath, const QString &name) const;
+    bool dirAlreadyHidden(const QString &path) const;
+
+    HiddenFile* findDirPath(const QString &path) const;
+    HiddenFile* ensureDirPath(const QString &path);
+    void removeTrashDirectories(HiddenFile *file);
+    void pruneTree(HiddenFile *file, const QSet<HiddenFile*> &dropped);
+    bool prunable(HiddenFile *parent, int row, const QSet<HiddenFile*> &dropped);
+
+    void collectHidden(HiddenFile *dir, QList<HiddenFile*> &batch,
+                       QSet<HiddenFile*> &queued);
+    HiddenFile* commonAncestor(HiddenFile *a, HiddenFile *b) const;
 };
 
 #endif // HIDDENMODEL_H
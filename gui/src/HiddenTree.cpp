@@ -0,0 +1,170 @@
+#include "HiddenTree.h"
+
+#include <new>
+
+HiddenTree::HiddenTree()
+  : arenaUsed(0),
+    freeNodes(NULL),
+    allChildren(NULL)
+{
+    theRoot = create("", false);
+}
+
+HiddenTree::~HiddenTree()
+{
+    freeAll();
+}
+
+HiddenFile* HiddenTree::create(const QString &name, bool isDirectory,
+                               HiddenFile *parent, quint64 ino)
+{
+    void *memory;
+    if (freeNodes != NULL) {
+        memory = freeNodes;
+        freeNodes = freeNodes->theParent;
+    }
+    else {
+        if (arenas.isEmpty() || arenaUsed == arena_size) {
+            arenas.append(static_cast<char*>(
+                ::operator new(arena_size * sizeof(HiddenFile))));
+            arenaUsed = 0;
+        }
+        memory = arenas.last() + arenaUsed++ * sizeof(HiddenFile);
+    }
+    quint32 id = intern(name);
+    HiddenFile *file = new (memory) HiddenFile(this, id, isDirectory, parent, ino);
+    file->nextSameName = namesakes.at(id);
+    if (file->nextSameName != NULL) {
+        file->nextSameName->prevSameName = file;
+    }
+    namesakes[id] = file;
+    return file;
+}
+
+void HiddenTree::clear()
+{
+    freeAll();
+    theRoot = create("", false);
+}
+
+bool HiddenTree::findName(const QString &name, quint32 *id) const
+{
+    QHash<QString, quint32>::const_iterator it = nameIds.constFind(name);
+    if (it == nameIds.constEnd()) {
+        return false;
+    }
+    *id = it.value();
+    return true;
+}
+
+QVector<quint32> HiddenTree::findNames(const QString &needle) const
+{
+    QVector<quint32> result;
+    if (needle.isEmpty()) {
+        return result;
+    }
+    QVector<quint32> candidates;
+    if (nameIndex.candidates(needle, &candidates)) {
+        foreach (quint32 id, candidates) {
+            if (names.at(id).contains(needle, Qt::CaseInsensitive)) {
+                result.append(id);
+            }
+        }
+    }
+    else {
+        for (int id = 0, count = names.count(); id < count; ++id) {
+            if (names.at(id).contains(needle, Qt::CaseInsensitive)) {
+                result.append(id);
+            }
+        }
+    }
+    return result;
+}
+
+quint32 HiddenTree::intern(const QString &name)
+{
+    quint32 id;
+    if (findName(name, &id)) {
+        return id;
+    }
+    id = names.count();
+    names.append(name);
+    nameIds.insert(name, id);
+    nameIndex.add(id, name);
+    namesakes.append(NULL);
+    return id;
+}
+
+HiddenFile::Children* HiddenTree::allocChildren()
+{
+    HiddenFile::Children *children = new HiddenFile::Children;
+    children->fetched = 0;
+    children->prev = NULL;
+    children->next = allChildren;
+    if (allChildren != NULL) {
+        allChildren->prev = children;
+    }
+    allChildren = children;
+    return children;
+}
+
+void HiddenTree::freeChildren(HiddenFile::Children *children)
+{
+    if (children->prev != NULL) {
+        children->prev->next = children->next;
+    }
+    else {
+        allChildren = children->next;
+    }
+    if (children->next != NULL) {
+        children->next->prev = children->prev;
+    }
+    delete children;
+}
+
+//
+// Returns the subtree of @file to the free list. The node has to be
+// unlinked from its parent already.
+//
+void HiddenTree::destroy(HiddenFile *file)
+{
+    if (file->children != NULL) {
+        foreach (HiddenFile *child, file->children->list) {
+            destroy(child);
+        }
+        freeChildren(file->children);
+        file->children = NULL;
+    }
+    if (file->prevSameName != NULL) {
+        file->prevSameName->nextSameName = file->nextSameName;
+    }
+    else {
+        namesakes[file->nameId] = file->nextSameName;
+    }
+    if (file->nextSameName != NULL) {
+        file->nextSameName->prevSameName = file->prevSameName;
+    }
+    file->theParent = freeNodes;
+    freeNodes = file;
+}
+
+// Nodes are trivially destructible, so they go away with their arenas
+void HiddenTree::freeAll()
+{
+    while (allChildren != NULL) {
+        HiddenFile::Children *next = allChildren->next;
+        delete allChildren;
+        allChildren = next;
+    }
+    foreach (char *arena, arenas) {
+        ::operator delete(arena);
+    }
+    arenas.clear();
+    arenaUsed = 0;
+    freeNodes = NULL;
+    names.clear();
+    nameIds.clear();
+    nameIndex.clear();
+    namesakes.clear();
+    theRoot = NULL;
+}
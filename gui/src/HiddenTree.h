@@ -0,0 +1,71 @@
+#ifndef HIDDENTREE_H
+#define HIDDENTREE_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "HiddenFile.h"
+#include "NameIndex.h"
+
+//
+// Storage of the hidden file tree. Nodes are allocated from arenas of
+// a few thousand of them and names are interned in a pool shared by the
+// whole tree, so a million leaves take a few thousand allocations. The
+// whole tree is torn down arena by arena, only the nodes with children
+// have to be visited.
+//
+// Names are indexed for searching, and the live nodes of every name are
+// chained, so a search never has to walk the tree.
+//
+class HiddenTree {
+public:
+    HiddenTree();
+    ~HiddenTree();
+
+    HiddenFile* root() const { return theRoot; }
+
+    // The node is not linked into @parent, append() does that
+    HiddenFile* create(const QString &name, bool isDirectory,
+                       HiddenFile *parent = 0,
+                       quint64 ino = HiddenFile::INVALID_INO);
+
+    // Drops every node but a new empty root
+    void clear();
+
+    const QString& nameOf(quint32 id) const { return names.at(id); }
+    bool findName(const QString &name, quint32 *id) const;
+
+    // Ids of the names containing @needle, case insensitive
+    QVector<quint32> findNames(const QString &needle) const;
+    // Walk the rest with HiddenFile::nextNamesake()
+    HiddenFile* firstNamed(quint32 id) const { return namesakes.at(id); }
+
+private:
+    Q_DISABLE_COPY(HiddenTree)
+    friend class HiddenFile;
+
+    static const int arena_size = 4096;  // nodes
+
+    QList<char*> arenas;
+    int arenaUsed;
+    HiddenFile *freeNodes;  // linked through theParent
+    HiddenFile::Children *allChildren;
+
+    // Names are never dropped from the pool before clear()
+    QVector<QString> names;
+    QHash<QString, quint32> nameIds;
+    NameIndex nameIndex;
+    QVector<HiddenFile*> namesakes;  // first live node of every name
+
+    HiddenFile *theRoot;
+
+    quint32 intern(const QString &name);
+    HiddenFile::Children* allocChildren();
+    void freeChildren(HiddenFile::Children *children);
+    void destroy(HiddenFile *file);
+    void freeAll();
+};
+
+#endif // HIDDENTREE_H
@@ -0,0 +1,310 @@
+#include "HideWorker.hpp"
+
+#include <QFile>
+#include <QHash>
+#include <QVector>
+
+HideWorker::HideWorker(Driver *gate, const QStringList &paths, bool recursive)
+  : QObject(0),
+    gate(gate),
+    paths(paths),
+    recursive(recursive),
+    cancelled(0),
+    lastReport(0)
+{
+}
+
+void HideWorker::run()
+{
+    Q_ASSERT(gate->isOpen());
+    clock.start();
+    QList<QFileInfo> files;
+    QList<QByteArray> dirs;
+    foreach (const QString &path, paths) {
+        QFileInfo info(path);
+        if (info.isFile() || info.isSymLink()) {
+            files.append(info);
+        }
+        else {
+            dirs.append(QFile::encodeName(info.absoluteFilePath()));
+        }
+    }
+    int status = hideFiles(files);
+    if (status != CANCELLED && !dirs.isEmpty()) {
+        int dirStatus = recursive ? hideTrees(dirs) : hideDirs(dirs);
+        if (status == Driver::OKAY || dirStatus == CANCELLED) {
+            status = dirStatus;
+        }
+    }
+    reportProgress(true);
+    if (status == CANCELLED) {
+        rollBack();
+    }
+    emit finished(status);
+}
+
+//
+// Plain files are grouped by their directories, which are not hidden
+//
+int HideWorker::hideFiles(const QList<QFileInfo> &targets)
+{
+    QList<TreeScanner::Dir*> dirs;
+    QHash<QString, TreeScanner::Dir*> dirByPath;
+    foreach (const QFileInfo &info, targets) {
+        QString dirPath = info.absolutePath();
+        TreeScanner::Dir *dir = dirByPath.value(dirPath, NULL);
+        if (dir == NULL) {
+            dir = new TreeScanner::Dir(QFile::encodeName(dirPath), NULL);
+            dirByPath.insert(dirPath, dir);
+            dirs.append(dir);
+        }
+        dir->files.append(QFile::encodeName(info.fileName()));
+    }
+    int status = hideContents(dirs);
+    qDeleteAll(dirs);
+    return status;
+}
+
+//
+// Files are submitted as soon as the scanner finds them, the driver is
+// only waited for when there is nothing else to do.
+//
+int HideWorker::hideTrees(const QList<QByteArray> &roots)
+{
+    TreeScanner scanner;
+    scanner.start(roots);
+
+    QList<TreeScanner::Dir*> owned;
+    QList<TreeScanner::Dir*> ready;
+    QList<FileRef> files;
+    int status = Driver::OKAY;
+    for (;;) {
+        if (cancelled) {
+            status = CANCELLED;
+            break;
+        }
+        QList<TreeScanner::Dir*> scanned = scanner.take(files.isEmpty());
+        if (scanned.isEmpty() && files.isEmpty()) {
+            break;
+        }
+        foreach (TreeScanner::Dir *dir, scanned) {
+            owned.append(dir);
+            dir->pending = dir->subdirCount + 1;
+            for (int i = 0; i < dir->files.count(); ++i) {
+                files.append(FileRef(dir, i));
+            }
+            if (dir->files.isEmpty()) {
+                contentDone(dir, ready);
+            }
+        }
+        int batchStatus = Driver::OKAY;
+        if (!files.isEmpty()) {
+            batchStatus = submitFiles(files, ready);
+        }
+        int dirStatus = submitDirs(ready);
+        if (dirStatus == CANCELLED) {
+            status = CANCELLED;
+            break;
+        }
+        if (status == Driver::OKAY) {
+            status = (batchStatus != Driver::OKAY) ? batchStatus : dirStatus;
+        }
+    }
+    scanner.stop();
+    qDeleteAll(owned);
+    return status;
+}
+
+//
+// A directory itself is hidden only if nothing is left in it
+//
+int HideWorker::hideDirs(const QList<QByteArray> &dirPaths)
+{
+    QList<TreeScanner::Dir*> dirs;
+    foreach (const QByteArray &path, dirPaths) {
+        TreeScanner::Dir *dir = new TreeScanner::Dir(path, NULL);
+        TreeScanner::scanDir(dir->path, &dir->files, NULL);
+        dirs.append(dir);
+    }
+    int status = hideContents(dirs);
+    if (status != CANCELLED) {
+        QList<TreeScanner::Dir*> ready;
+        foreach (TreeScanner::Dir *dir, dirs) {
+            QList<QByteArray> left;
+            TreeScanner::scanDir(dir->path, &left, &left);
+            if (left.isEmpty()) {
+                ready.append(dir);
+            }
+        }
+        int dirStatus = submitDirs(ready);
+        if (status == Driver::OKAY || dirStatus == CANCELLED) {
+            status = dirStatus;
+        }
+    }
+    qDeleteAll(dirs);
+    return status;
+}
+
+//
+// Hides the files of @dirs, going on past the failed ones
+//
+int HideWorker::hideContents(const QList<TreeScanner::Dir*> &dirs)
+{
+    QList<TreeScanner::Dir*> ready;
+    QList<FileRef> files;
+    foreach (TreeScanner::Dir *dir, dirs) {
+        dir->pending = 1;
+        for (int i = 0; i < dir->files.count(); ++i) {
+            files.append(FileRef(dir, i));
+        }
+    }
+    int status = Driver::OKAY;
+    while (!files.isEmpty()) {
+        if (cancelled) {
+            return CANCELLED;
+        }
+        int batchStatus = submitFiles(files, ready);
+        if (status == Driver::OKAY) {
+            status = batchStatus;
+        }
+    }
+    return status;
+}
+
+//
+// Sends one batch of files, which may span several directories, and
+// reports the hidden ones directory by directory
+//
+int HideWorker::submitFiles(QList<FileRef> &files, QList<TreeScanner::Dir*> &ready)
+{
+    int count = files.count();
+    if (count > batch_size) {
+        count = batch_size;
+    }
+    QList<QByteArray> paths;
+    QVector<const char*> pathPointers(count);
+    for (int i = 0; i < count; ++i) {
+        const FileRef &file = files.at(i);
+        paths.append(TreeScanner::joinPath(file.dir->path, file.dir->files.at(file.index)));
+        pathPointers[i] = paths.at(i).constData();
+    }
+    QVector<quint64> inos(count);
+    QVector<Driver::Status> statuses(count, Driver::UNKNOWN_ERROR);
+    int status = gate->hide(pathPointers.constData(), count, inos.data(), statuses.data());
+
+    int i = 0;
+    while (i < count) {
+        TreeScanner::Dir *dir = files.at(i).dir;
+        QStringList names;
+        QList<quint64> hiddenInos;
+        for (; i < count && files.at(i).dir == dir; ++i) {
+            if (statuses.at(i) == Driver::OKAY) {
+                names.append(QFile::decodeName(dir->files.at(files.at(i).index)));
+                hiddenInos.append(inos.at(i));
+            }
+            else {
+                // The directory is never complete, so it stays visible
+                ++dir->pending;
+                if (status == Driver::OKAY) {
+                    status = statuses.at(i);
+                }
+            }
+        }
+        if (!names.isEmpty()) {
+            hidden += hiddenInos;
+            emit filesHidden(QFile::decodeName(dir->path), names, hiddenInos);
+        }
+        if (files.at(i - 1).index == dir->files.count() - 1) {
+            contentDone(dir, ready);
+        }
+    }
+    files.erase(files.begin(), files.begin() + count);
+    reportProgress(false);
+    return status;
+}
+
+//
+// Hiding a directory may complete its parent, so this goes on until
+// there are no complete directories left. A directory which cannot be
+// hidden keeps its parent from completing.
+//
+int HideWorker::submitDirs(QList<TreeScanner::Dir*> &ready)
+{
+    int status = Driver::OKAY;
+    while (!ready.isEmpty()) {
+        if (cancelled) {
+            return CANCELLED;
+        }
+        int count = ready.count();
+        if (count > batch_size) {
+            count = batch_size;
+        }
+        QList<TreeScanner::Dir*> batch = ready.mid(0, count);
+        ready.erase(ready.begin(), ready.begin() + count);
+
+        QVector<const char*> pathPointers(count);
+        for (int i = 0; i < count; ++i) {
+            pathPointers[i] = batch.at(i)->path.constData();
+        }
+        QVector<quint64> inos(count);
+        QVector<Driver::Status> statuses(count, Driver::UNKNOWN_ERROR);
+        Driver::Status batchStatus = gate->hide(pathPointers.constData(), count,
+                                                inos.data(), statuses.data());
+        if (status == Driver::OKAY) {
+            status = batchStatus;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            TreeScanner::Dir *dir = batch.at(i);
+            if (statuses.at(i) != Driver::OKAY) {
+                if (status == Driver::OKAY) {
+                    status = statuses.at(i);
+                }
+                continue;
+            }
+            hidden.append(inos.at(i));
+            emit dirHidden(QFile::decodeName(dir->path), inos.at(i));
+            if (dir->parent) {
+                contentDone(dir->parent, ready);
+            }
+        }
+        reportProgress(false);
+    }
+    return status;
+}
+
+void HideWorker::contentDone(TreeScanner::Dir *dir, QList<TreeScanner::Dir*> &ready)
+{
+    if (--dir->pending == 0) {
+        ready.append(dir);
+    }
+}
+
+void HideWorker::reportProgress(bool force)
+{
+    int elapsed = clock.elapsed();
+    if (!force && elapsed - lastReport < progress_interval) {
+        return;
+    }
+    lastReport = elapsed;
+    int perSecond = 0;
+    if (elapsed > 0) {
+        perSecond = (int)(hidden.count() * 1000LL / elapsed);
+    }
+    emit progress(hidden.count(), perSecond);
+}
+
+//
+// Directories were hidden after their contents, so unhiding in reverse
+// order reveals every directory before the files in it.
+//
+void HideWorker::rollBack()
+{
+    QVector<quint64> inos;
+    inos.reserve(hidden.count());
+    for (int i = hidden.count() - 1; i >= 0; --i) {
+        inos.append(hidden.at(i));
+    }
+    gate->unhide(inos.constData(), inos.count(), NULL);
+    hidden.clear();
+}
@@ -0,0 +1,83 @@
+#ifndef HIDEWORKER_H
+#define HIDEWORKER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTime>
+
+#include "Driver.hpp"
+#include "TreeScanner.hpp"
+
+//
+// Hides files and file trees on a thread of its own, reporting every
+// hidden file back through queued signals. The trees are listed by a
+// TreeScanner in parallel while the files found so far are sent to the
+// driver in batches. A directory is hidden once everything in it is.
+//
+// All the plain files of a job go to the driver together, whichever
+// directories they are in. A failed target does not stop the others,
+// finished() reports the first failure.
+//
+// The gate must be open and must not be used by anybody else until
+// finished() is emitted.
+//
+class HideWorker : public QObject {
+    Q_OBJECT
+
+public:
+    // Status of a cancelled job, not used by Driver
+    static const int CANCELLED = -2;
+
+public:
+    HideWorker(Driver *gate, const QStringList &paths, bool recursive);
+
+    // Can be called from any thread. Files hidden so far are unhidden
+    // again before finished(CANCELLED) is emitted.
+    void cancel() { cancelled = 1; }
+
+public slots:
+    void run();
+
+signals:
+    void filesHidden(const QString &dir, const QStringList &names,
+                     const QList<quint64> &inos);
+    void dirHidden(const QString &dir, quint64 ino);
+    void progress(int hiddenCount, int perSecond);
+    void finished(int status);
+
+private:
+    static const int batch_size = 1024;
+    static const int progress_interval = 250;  // msec
+
+    Driver *gate;
+    QStringList paths;
+    bool recursive;
+    QAtomicInt cancelled;
+
+    QList<quint64> hidden;
+    QTime clock;
+    int lastReport;
+
+    struct FileRef {
+        TreeScanner::Dir *dir;
+        int index;
+        FileRef(TreeScanner::Dir *dir, int index) : dir(dir), index(index) {}
+    };
+
+    int hideFiles(const QList<QFileInfo> &targets);
+    int hideTrees(const QList<QByteArray> &roots);
+    int hideDirs(const QList<QByteArray> &dirPaths);
+    int hideContents(const QList<TreeScanner::Dir*> &dirs);
+    int submitFiles(QList<FileRef> &files, QList<TreeScanner::Dir*> &ready);
+    int submitDirs(QList<TreeScanner::Dir*> &ready);
+    static void contentDone(TreeScanner::Dir *dir, QList<TreeScanner::Dir*> &ready);
+    void reportProgress(bool force);
+    void rollBack();
+};
+
+#endif // HIDEWORKER_H
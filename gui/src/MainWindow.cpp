@@ -3,10 +3,12 @@
 
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QStatusBar>
 
 MainWindow::MainWindow(QWidget *parent)
   : QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    pendingRecursive(false)
 {
     ui->setupUi(this);
     setupUi();
@@ -14,92 +16,168 @@ MainWindow::MainWindow(QWidget *parent)
 
 void MainWindow::setupUi()
 {
-    fs_model = new QDirModel(this);
+    fs_model = new VisibleModel(this);
     ui->fs_tree->setModel(fs_model);
-    ui->fs_tree->setColumnHidden(1, true);
-    ui->fs_tree->setColumnHidden(2, true);
-    ui->fs_tree->setColumnHidden(3, true);
     ui->fs_tree->sortByColumn(0, Qt::AscendingOrder);
 
     DriverGate *gate = new DriverGate("/dev/hcontrol");
+    // Commands can be captured for humble-replay, see CommandTrace.hpp
+    QByteArray tracePath = qgetenv("HUMBLE_TRACE");
+    if (!tracePath.isEmpty() && !gate->startTrace(tracePath.constData())) {
+        qWarning("Cannot write the command trace to %s", tracePath.constData());
+    }
     hd_model = new HiddenModel(gate, this);
     ui->hidden_view->setModel(hd_model);
 
+    // Only the directories touched by an operation are listed again
+    connect(hd_model, SIGNAL(visibilityChanged(QString,bool)),
+            fs_model, SLOT(invalidate(QString,bool)));
+
     connect(ui->fs_tree->selectionModel(),
             SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
             this, SLOT(visibleFileSelected()));
     connect(ui->hidden_view->selectionModel(),
             SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
             this, SLOT(hiddenFileSelected()));
+
+    progress_bar = new QProgressBar(this);
+    progress_bar->setRange(0, 0);
+    progress_bar->setMaximumWidth(150);
+    progress_label = new QLabel(this);
+    cancel_button = new QPushButton(tr("Cancel"), this);
+    statusBar()->addPermanentWidget(progress_label);
+    statusBar()->addPermanentWidget(progress_bar);
+    statusBar()->addPermanentWidget(cancel_button);
+    showProgress(false);
+
+    // The completer shows the results as they are, the index has
+    // done the matching already
+    search_results = new QStringListModel(this);
+    search_completer = new QCompleter(search_results, this);
+    search_completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    ui->search_edit->setCompleter(search_completer);
+    connect(ui->search_edit, SIGNAL(textEdited(QString)),
+            this, SLOT(searchHidden(QString)));
+    connect(search_completer, SIGNAL(activated(QString)),
+            this, SLOT(jumpToHidden(QString)));
+
+    connect(cancel_button, SIGNAL(clicked()), this, SLOT(cancelHiding()));
+    connect(hd_model, SIGNAL(hidingProgress(int,int)),
+            this, SLOT(hidingProgress(int,int)));
+    connect(hd_model, SIGNAL(hidingFinished(HiddenModel::ErrorCode)),
+            this, SLOT(hidingFinished(HiddenModel::ErrorCode)));
 }
 
 MainWindow::~MainWindow()
 {
+    hd_model->cancelHiding();
+    hd_model->waitForHiding();
     hd_model->unhideAll();
     delete ui;
 }
 
+//
+// The whole selection is hidden by a single job
+//
 void MainWindow::hideVictimFile()
 {
     QModelIndexList sel = ui->fs_tree->selectionModel()->selectedRows();
-    Q_ASSERT(sel.count() <= 1);
     if (sel.count() == 0) {
         return;
     }
-    QFileInfo file = fs_model->fileInfo(sel.at(0));
-    bool isSymlink = file.isSymLink();
-    QString symlinkTarget;
-    if (isSymlink) {
-        symlinkTarget = file.symLinkTarget();
-    }
     bool recursive = ui->recursive_checkbox->isChecked();
+    bool followLinks = ui->symlink_checkbox->isChecked();
+    QStringList paths;
+    pendingTargets.clear();
+    foreach (const QModelIndex &index, sel) {
+        QFileInfo file = fs_model->fileInfo(index);
+        paths.append(file.absoluteFilePath());
+        if (file.isSymLink() && followLinks) {
+            pendingTargets.append(file.symLinkTarget());
+        }
+    }
+    pendingRecursive = recursive;
+    if (!startHiding(paths, recursive)) {
+        pendingTargets.clear();
+    }
+}
+
+//
+// Hiding goes on in the background, hidingFinished() picks up the result
+//
+bool MainWindow::startHiding(const QStringList &paths, bool recursive)
+{
     HiddenModel::ErrorCode err;
 again:
-    err = hd_model->hideFile(file.absoluteFilePath(), recursive);
+    err = hd_model->startHiding(paths, recursive);
     switch (err) {
     case HiddenModel::DEVICE_NOT_FOUND:
         if (tryChangeDevice()) {
             goto again;
         }
-        return;
+        return false;
     case HiddenModel::OKAY:
         break;
     default:
+        displayErrorMessage(err);
+        return false;
+    }
+    progress_label->setText(tr("Hiding..."));
+    showProgress(true);
+    return true;
+}
+
+void MainWindow::hidingProgress(int hiddenCount, int perSecond)
+{
+    progress_label->setText(tr("%1 files hidden, %2 files/s")
+                            .arg(hiddenCount).arg(perSecond));
+}
+
+void MainWindow::hidingFinished(HiddenModel::ErrorCode err)
+{
+    showProgress(false);
+    if (err != HiddenModel::OKAY) {
+        pendingTargets.clear();
         displayErrorMessage(err);
         return;
     }
-    if (isSymlink && ui->symlink_checkbox->isChecked()) {
-again_symlink:
-        err = hd_model->hideFile(symlinkTarget, recursive);
-        switch (err) {
-        case HiddenModel::DEVICE_NOT_FOUND:
-            if (tryChangeDevice()) {
-                goto again_symlink;
-            }
-            break;
-        case HiddenModel::OKAY:
-            break;
-        default:
-            displayErrorMessage(err);
-            break;
-        }
+    if (!pendingTargets.isEmpty()) {
+        QStringList targets = pendingTargets;
+        pendingTargets.clear();
+        startHiding(targets, pendingRecursive);
     }
-    fs_model->refresh();
+}
+
+void MainWindow::cancelHiding()
+{
+    cancel_button->setEnabled(false);
+    progress_label->setText(tr("Cancelling..."));
+    hd_model->cancelHiding();
+}
+
+void MainWindow::showProgress(bool visible)
+{
+    progress_label->setVisible(visible);
+    progress_bar->setVisible(visible);
+    cancel_button->setVisible(visible);
+    cancel_button->setEnabled(visible);
+    ui->hide_button->setEnabled(!visible);
+    ui->unhide_button->setEnabled(!visible);
+    ui->unhide_all_button->setEnabled(!visible);
 }
 
 void MainWindow::unhideSolacedFile()
 {
 again:
     QModelIndexList sel = ui->hidden_view->selectionModel()->selectedRows();
-    Q_ASSERT(sel.count() <= 1);
     if (sel.count() == 0) {
         return;
     }
     bool recursive = ui->recursive_unhide_checkbox->isChecked();
-    HiddenModel::ErrorCode err = hd_model->unhideFile(sel.at(0), recursive);
+    HiddenModel::ErrorCode err = hd_model->unhideFiles(sel, recursive);
     switch (err) {
     case HiddenModel::HIDDEN_PARENT:
-        if (tryUnhideParents(sel.at(0))) {
+        if (tryUnhideParents(sel)) {
             goto again;
         }
         return;
@@ -114,7 +192,6 @@ again:
         displayErrorMessage(err);
         return;
     }
-    fs_model->refresh();
 }
 
 void MainWindow::unhideAll()
@@ -133,7 +210,6 @@ again:
         displayErrorMessage(err);
         return;
     }
-    fs_model->refresh();
 }
 
 void MainWindow::selectVictimFile()
@@ -170,6 +246,23 @@ void MainWindow::hiddenFileSelected()
     }
 }
 
+void MainWindow::searchHidden(const QString &query)
+{
+    search_results->setStringList(hd_model->findFiles(query, search_limit));
+    search_completer->complete();
+}
+
+void MainWindow::jumpToHidden(const QString &path)
+{
+    QModelIndex index = hd_model->reveal(path);
+    if (index.isValid()) {
+        ui->hidden_view->selectionModel()
+            ->setCurrentIndex(index, QItemSelectionModel::ClearAndSelect
+                                   | QItemSelectionModel::Rows);
+        ui->hidden_view->scrollTo(index, QAbstractItemView::PositionAtCenter);
+    }
+}
+
 void MainWindow::manualPathEntered()
 {
     scrollFsTreeTo(ui->path_display->text());
@@ -209,7 +302,7 @@ bool MainWindow::tryChangeDevice()
     return changed;
 }
 
-bool MainWindow::tryUnhideParents(const QModelIndex &index)
+bool MainWindow::tryUnhideParents(const QModelIndexList &indexes)
 {
     QMessageBox::StandardButton choice = QMessageBox::critical(
         this, tr("Humble error"),
@@ -219,10 +312,13 @@ bool MainWindow::tryUnhideParents(const QModelIndex &index)
         QMessageBox::No);
     bool didHide = (choice == QMessageBox::Yes);
     if (didHide) {
-        HiddenModel::ErrorCode err = hd_model->unhideParents(index);
-        if (err != HiddenModel::OKAY) {
-            didHide = false;
-            displayErrorMessage(err);
+        foreach (const QModelIndex &index, indexes) {
+            HiddenModel::ErrorCode err = hd_model->unhideParents(index);
+            if (err != HiddenModel::OKAY) {
+                didHide = false;
+                displayErrorMessage(err);
+                break;
+            }
         }
     }
     return didHide;
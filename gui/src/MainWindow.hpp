@@ -2,9 +2,14 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QDirModel>
+#include <QCompleter>
+#include <QLabel>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QStringListModel>
 
 #include "HiddenModel.h"
+#include "VisibleModel.hpp"
 #include "DriverGate.hpp"
 
 namespace Ui {
@@ -29,15 +34,37 @@ private slots:
     void manualPathEntered();
     void scrollFsTreeTo(const QString &path);
 
+    void hidingProgress(int hiddenCount, int perSecond);
+    void hidingFinished(HiddenModel::ErrorCode err);
+    void cancelHiding();
+
+    void searchHidden(const QString &query);
+    void jumpToHidden(const QString &path);
+
 private:
+    static const int search_limit = 100;
+
     Ui::MainWindow *ui;
-    QDirModel *fs_model;
+    VisibleModel *fs_model;
     HiddenModel *hd_model;
 
+    QProgressBar *progress_bar;
+    QLabel *progress_label;
+    QPushButton *cancel_button;
+
+    QStringListModel *search_results;
+    QCompleter *search_completer;
+
+    // Symlink targets to hide once the links themselves are hidden
+    QStringList pendingTargets;
+    bool pendingRecursive;
+
     void setupUi();
     void displayErrorMessage(HiddenModel::ErrorCode err);
+    bool startHiding(const QStringList &paths, bool recursive);
+    void showProgress(bool visible);
     bool tryChangeDevice();
-    bool tryUnhideParents(const QModelIndex &index);
+    bool tryUnhideParents(const QModelIndexList &indexes);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,66 @@
+#include "NameIndex.h"
+
+#include <QtAlgorithms>
+
+void NameIndex::add(quint32 id, const QString &name)
+{
+    QString folded = name.toLower();
+    for (int i = 0; i + 3 <= folded.length(); ++i) {
+        QVector<quint32> &ids = postings[trigramAt(folded, i)];
+        // A trigram may occur in a name more than once
+        if (ids.isEmpty() || ids.last() != id) {
+            ids.append(id);
+        }
+    }
+}
+
+void NameIndex::clear()
+{
+    postings.clear();
+}
+
+bool NameIndex::candidates(const QString &needle, QVector<quint32> *ids) const
+{
+    QString folded = needle.toLower();
+    if (folded.length() < 3) {
+        return false;
+    }
+    QList<const QVector<quint32>*> lists;
+    for (int i = 0; i + 3 <= folded.length(); ++i) {
+        QHash<quint64, QVector<quint32> >::const_iterator it =
+            postings.constFind(trigramAt(folded, i));
+        if (it == postings.constEnd()) {
+            ids->clear();
+            return true;
+        }
+        lists.append(&it.value());
+    }
+
+    const QVector<quint32> *shortest = lists.first();
+    foreach (const QVector<quint32> *list, lists) {
+        if (list->count() < shortest->count()) {
+            shortest = list;
+        }
+    }
+    ids->clear();
+    foreach (quint32 id, *shortest) {
+        bool everywhere = true;
+        for (int i = 0; i < lists.count() && everywhere; ++i) {
+            const QVector<quint32> *list = lists.at(i);
+            everywhere = (list == shortest
+                          || qBinaryFind(list->constBegin(), list->constEnd(), id)
+                             != list->constEnd());
+        }
+        if (everywhere) {
+            ids->append(id);
+        }
+    }
+    return true;
+}
+
+quint64 NameIndex::trigramAt(const QString &folded, int pos)
+{
+    return ((quint64)folded.at(pos).unicode() << 32)
+         | ((quint64)folded.at(pos + 1).unicode() << 16)
+         | (quint64)folded.at(pos + 2).unicode();
+}
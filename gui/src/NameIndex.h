@@ -0,0 +1,32 @@
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+//
+// Trigram index over the names of a HiddenTree. Every name is broken into
+// its case folded three character substrings, each of which lists the ids
+// of the names it occurs in. A search intersects the lists of the trigrams
+// of the needle, starting with the shortest, so it only ever looks at the
+// names which have all of them.
+//
+// Names are only ever added, ids have to come in ascending order.
+//
+class NameIndex {
+public:
+    void add(quint32 id, const QString &name);
+    void clear();
+
+    // Ids of the names which may contain @needle, ascending. Returns false
+    // if @needle is too short to narrow the search down.
+    bool candidates(const QString &needle, QVector<quint32> *ids) const;
+
+private:
+    QHash<quint64, QVector<quint32> > postings;
+
+    static quint64 trigramAt(const QString &folded, int pos);
+};
+
+#endif // NAMEINDEX_H
@@ -0,0 +1,211 @@
+#include "TreeScanner.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+
+TreeScanner::TreeScanner(int threadCount)
+  : outstanding(0),
+    over(true),
+    sleepers(0)
+{
+    for (int i = 0; i < threadCount; ++i) {
+        queues.append(new WorkQueue);
+        workers.append(new Worker(this, i));
+    }
+}
+
+TreeScanner::~TreeScanner()
+{
+    stop();
+    qDeleteAll(workers);
+    foreach (WorkQueue *queue, queues) {
+        qDeleteAll(queue->dirs);
+    }
+    qDeleteAll(queues);
+    qDeleteAll(out);
+}
+
+QByteArray TreeScanner::joinPath(const QByteArray &dir, const QByteArray &name)
+{
+    if (dir.endsWith('/')) {
+        return dir + name;
+    }
+    return dir + '/' + name;
+}
+
+int TreeScanner::defaultThreadCount()
+{
+    return qMax(4, 2 * QThread::idealThreadCount());
+}
+
+void TreeScanner::start(const QByteArray &root)
+{
+    start(QList<QByteArray>() << root);
+}
+
+void TreeScanner::start(const QList<QByteArray> &roots)
+{
+    if (roots.isEmpty()) {
+        return;
+    }
+    over = false;
+    outstanding = roots.count();
+    for (int i = 0; i < roots.count(); ++i) {
+        queues[i % queues.count()]->dirs.append(new Dir(roots.at(i), NULL));
+    }
+    foreach (Worker *worker, workers) {
+        worker->start();
+    }
+}
+
+void TreeScanner::stop()
+{
+    finish();
+    foreach (Worker *worker, workers) {
+        worker->wait();
+    }
+}
+
+QList<TreeScanner::Dir*> TreeScanner::take(bool wait)
+{
+    QMutexLocker locker(&outLock);
+    while (wait && out.isEmpty() && !over) {
+        outAvailable.wait(&outLock);
+    }
+    QList<Dir*> result = out;
+    out.clear();
+    return result;
+}
+
+void TreeScanner::finish()
+{
+    {
+        QMutexLocker locker(&idleLock);
+        over = true;
+        workAvailable.wakeAll();
+    }
+    QMutexLocker locker(&outLock);
+    outAvailable.wakeAll();
+}
+
+void TreeScanner::work(int id)
+{
+    Dir *dir;
+    while ((dir = grab(id)) != NULL) {
+        scan(id, dir);
+    }
+}
+
+//
+// Takes the newest directory of the own queue, or else the oldest one of
+// another queue, which is the closest to the root and likely the largest
+// subtree there. Sleeps while there is no work at all.
+//
+TreeScanner::Dir* TreeScanner::grab(int id)
+{
+    int count = queues.count();
+    for (;;) {
+        if (over) {
+            return NULL;
+        }
+        for (int i = 0; i < count; ++i) {
+            WorkQueue *queue = queues[(id + i) % count];
+            QMutexLocker locker(&queue->lock);
+            if (!queue->dirs.isEmpty()) {
+                return (i == 0) ? queue->dirs.takeLast() : queue->dirs.takeFirst();
+            }
+        }
+
+        // Work is queued before the sleepers are woken under idleLock,
+        // so checking again under it does not miss a wakeup
+        QMutexLocker locker(&idleLock);
+        bool empty = true;
+        for (int i = 0; i < count && empty; ++i) {
+            QMutexLocker queueLocker(&queues[i]->lock);
+            empty = queues[i]->dirs.isEmpty();
+        }
+        if (empty && !over) {
+            ++sleepers;
+            workAvailable.wait(&idleLock);
+            --sleepers;
+        }
+    }
+}
+
+void TreeScanner::scan(int id, Dir *dir)
+{
+    QList<QByteArray> subdirs;
+    scanDir(dir->path, &dir->files, &subdirs);
+
+    QList<Dir*> children;
+    foreach (const QByteArray &name, subdirs) {
+        children.append(new Dir(joinPath(dir->path, name), dir));
+    }
+    dir->subdirCount = children.count();
+    outstanding.fetchAndAddOrdered(children.count());
+
+    // The directory goes out before its children can be scanned
+    {
+        QMutexLocker locker(&outLock);
+        out.append(dir);
+        outAvailable.wakeOne();
+    }
+    if (!children.isEmpty()) {
+        {
+            QMutexLocker locker(&queues[id]->lock);
+            queues[id]->dirs += children;
+        }
+        QMutexLocker locker(&idleLock);
+        if (sleepers > 0) {
+            workAvailable.wakeAll();
+        }
+    }
+    if (!outstanding.deref()) {
+        finish();
+    }
+}
+
+bool TreeScanner::scanDir(const QByteArray &path, QList<QByteArray> *files,
+                          QList<QByteArray> *dirs, bool followLinks)
+{
+    DIR *dir = opendir(path.constData());
+    if (dir == NULL) {
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.'
+            && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+        bool isDir;
+        if (entry->d_type == DT_UNKNOWN
+            || (followLinks && entry->d_type == DT_LNK))
+        {
+            struct stat st;
+            int flags = followLinks ? 0 : AT_SYMLINK_NOFOLLOW;
+            if (fstatat(dirfd(dir), name, &st, flags) == -1) {
+                if (!followLinks) {
+                    continue;
+                }
+                st.st_mode = S_IFLNK;  // a dangling link
+            }
+            isDir = S_ISDIR(st.st_mode);
+        }
+        else {
+            isDir = (entry->d_type == DT_DIR);
+        }
+        if (isDir) {
+            if (dirs) dirs->append(name);
+        }
+        else {
+            if (files) files->append(name);
+        }
+    }
+    closedir(dir);
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef TREESCANNER_H
+#define TREESCANNER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+//
+// Lists a directory tree with a pool of threads. Every thread keeps a
+// queue of directories of its own, works depth first on it and steals
+// from the other end of someone else's queue when it runs dry. Each
+// directory is read in a single readdir() pass, entry types come from
+// d_type, so nothing gets stat'ed unless the file system leaves d_type
+// unknown.
+//
+// A directory is handed out by take() before any of its subdirectories.
+//
+class TreeScanner {
+public:
+    struct Dir {
+        QByteArray path;
+        QList<QByteArray> files;   // every entry which is not a directory
+        int subdirCount;
+        Dir *parent;
+        int pending;               // free for the consumer to use
+
+        Dir(const QByteArray &path, Dir *parent)
+          : path(path), subdirCount(0), parent(parent), pending(0) {}
+    };
+
+public:
+    explicit TreeScanner(int threadCount = defaultThreadCount());
+    ~TreeScanner();
+
+    void start(const QByteArray &root);
+    // Scans several trees at once, they must not be nested
+    void start(const QList<QByteArray> &roots);
+    void stop();
+
+    // Scanned directories, the caller owns them. With @wait it blocks
+    // until there are some, an empty list then means the scan is over.
+    QList<Dir*> take(bool wait);
+
+    static QByteArray joinPath(const QByteArray &dir, const QByteArray &name);
+
+    // Reads one directory, fails only if it cannot be opened. With
+    // @followLinks symlinks to directories count as directories.
+    static bool scanDir(const QByteArray &path, QList<QByteArray> *files,
+                        QList<QByteArray> *dirs, bool followLinks = false);
+
+    // Directory scanning is bound by I/O rather than by CPU,
+    // so there are more threads than cores
+    static int defaultThreadCount();
+
+private:
+    class Worker : public QThread {
+    public:
+        Worker(TreeScanner *scanner, int id) : scanner(scanner), id(id) {}
+    protected:
+        void run() { scanner->work(id); }
+    private:
+        TreeScanner *scanner;
+        int id;
+    };
+
+    struct WorkQueue {
+        QMutex lock;
+        QList<Dir*> dirs;
+    };
+
+    QList<Worker*> workers;
+    QList<WorkQueue*> queues;
+
+    // Directories found but not scanned yet
+    QAtomicInt outstanding;
+    volatile bool over;
+
+    QMutex idleLock;
+    QWaitCondition workAvailable;
+    int sleepers;
+
+    QMutex outLock;
+    QWaitCondition outAvailable;
+    QList<Dir*> out;
+
+    void work(int id);
+    Dir* grab(int id);
+    void scan(int id, Dir *dir);
+    void finish();
+};
+
+#endif // TREESCANNER_H
@@ -0,0 +1,358 @@
+#include "VisibleModel.hpp"
+#include "TreeScanner.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileIconProvider>
+#include <QSet>
+
+void DirLister::list(const QString &path)
+{
+    QList<QByteArray> dirNames;
+    QList<QByteArray> fileNames;
+    TreeScanner::scanDir(QFile::encodeName(path), &fileNames, &dirNames, true);
+    QStringList dirs;
+    QStringList files;
+    foreach (const QByteArray &name, dirNames) {
+        dirs.append(QFile::decodeName(name));
+    }
+    foreach (const QByteArray &name, fileNames) {
+        files.append(QFile::decodeName(name));
+    }
+    emit listed(path, dirs, files);
+}
+
+VisibleModel::VisibleModel(QObject *parent)
+  : QAbstractItemModel(parent)
+{
+    root = new Node(QString(), true, NULL);
+    root->requested = true;
+    root->loaded = true;
+    Node *top = new Node("/", true, root);
+    root->children.append(top);
+    root->byName.insert(top->name, top);
+
+    QFileIconProvider icons;
+    dirIcon = icons.icon(QFileIconProvider::Folder);
+    fileIcon = icons.icon(QFileIconProvider::File);
+
+    lister = new DirLister;
+    lister->moveToThread(&listerThread);
+    connect(this, SIGNAL(listRequested(QString)),
+            lister, SLOT(list(QString)));
+    connect(lister, SIGNAL(listed(QString,QStringList,QStringList)),
+            this, SLOT(listed(QString,QStringList,QStringList)));
+    connect(&watcher, SIGNAL(directoryChanged(QString)),
+            this, SLOT(directoryChanged(QString)));
+    listerThread.start();
+}
+
+VisibleModel::~VisibleModel()
+{
+    listerThread.quit();
+    listerThread.wait();
+    delete lister;
+    delete root;
+}
+
+//
+// Qt MVC boilerplate
+//
+
+QModelIndex VisibleModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return QModelIndex();
+    }
+    return indexOf(the(index)->parent);
+}
+
+QModelIndex VisibleModel::index(int row, int column,
+                                const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent)) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, the(parent)->children[row]);
+}
+
+int VisibleModel::columnCount(const QModelIndex&) const
+{
+    return 1;
+}
+
+int VisibleModel::rowCount(const QModelIndex &parent) const
+{
+    return the(parent)->children.count();
+}
+
+bool VisibleModel::hasChildren(const QModelIndex &parent) const
+{
+    Node *node = the(parent);
+    return node->isDir && (!node->loaded || !node->children.isEmpty());
+}
+
+QVariant VisibleModel::data(const QModelIndex &index, int role) const
+{
+    switch (role) {
+    case Qt::DisplayRole:
+        return QVariant(the(index)->name);
+
+    case Qt::DecorationRole:
+        return QVariant(the(index)->isDir ? dirIcon : fileIcon);
+
+    default:
+        return QVariant();
+    }
+}
+
+QVariant VisibleModel::headerData(int section, Qt::Orientation orientation,
+                                  int role) const
+{
+    if (section == 0 && orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        return QVariant(tr("Name"));
+    }
+    return QVariant();
+}
+
+bool VisibleModel::canFetchMore(const QModelIndex &parent) const
+{
+    Node *node = the(parent);
+    return node->isDir && !node->requested;
+}
+
+void VisibleModel::fetchMore(const QModelIndex &parent)
+{
+    Node *node = the(parent);
+    if (!node->isDir || node->requested) {
+        return;
+    }
+    node->requested = true;
+    emit listRequested(pathOf(node));
+}
+
+//
+// Internal stuff
+//
+
+VisibleModel::Node* VisibleModel::the(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return root;
+    }
+    return static_cast<Node*>(index.internalPointer());
+}
+
+QModelIndex VisibleModel::indexOf(Node *node) const
+{
+    if (node == root) {
+        return QModelIndex();
+    }
+    return createIndex(node->row, 0, node);
+}
+
+QString VisibleModel::pathOf(Node *node) const
+{
+    QStringList names;
+    for (; node->parent != root; node = node->parent) {
+        names.prepend(node->name);
+    }
+    return "/" + names.join("/");
+}
+
+VisibleModel::Node* VisibleModel::findNode(const QString &path) const
+{
+    Node *node = root->children.first();
+    foreach (const QString &name, path.split('/', QString::SkipEmptyParts)) {
+        node = node->byName.value(name, NULL);
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    return node;
+}
+
+QFileInfo VisibleModel::fileInfo(const QModelIndex &index) const
+{
+    return QFileInfo(pathOf(the(index)));
+}
+
+QModelIndex VisibleModel::index(const QString &path)
+{
+    QString clean = QDir::cleanPath(QDir(path).absolutePath());
+    Node *node = root->children.first();
+    foreach (const QString &name, clean.split('/', QString::SkipEmptyParts)) {
+        if (!node->loaded) {
+            DirLister lister;
+            connect(&lister, SIGNAL(listed(QString,QStringList,QStringList)),
+                    this, SLOT(listed(QString,QStringList,QStringList)));
+            node->requested = true;
+            lister.list(pathOf(node));
+        }
+        node = node->byName.value(name, NULL);
+        if (node == NULL) {
+            return QModelIndex();
+        }
+    }
+    return indexOf(node);
+}
+
+void VisibleModel::invalidate(const QString &dirPath, bool recursive)
+{
+    Node *node = findNode(dirPath);
+    if (node == NULL) {
+        return;
+    }
+    QList<Node*> stack;
+    stack.append(node);
+    while (!stack.isEmpty()) {
+        node = stack.takeLast();
+        if (!node->loaded) {
+            continue;
+        }
+        emit listRequested(pathOf(node));
+        if (!recursive) {
+            break;
+        }
+        foreach (Node *child, node->children) {
+            if (child->isDir) {
+                stack.append(child);
+            }
+        }
+    }
+}
+
+void VisibleModel::directoryChanged(const QString &path)
+{
+    invalidate(path, false);
+}
+
+void VisibleModel::listed(const QString &path, const QStringList &dirs,
+                          const QStringList &files)
+{
+    // The directory may be gone from the model by now
+    Node *node = findNode(path);
+    if (node == NULL || !node->isDir) {
+        return;
+    }
+    merge(node, dirs, files);
+    if (!node->loaded) {
+        node->loaded = true;
+        watcher.addPath(path);
+    }
+}
+
+//
+// Both the old children and the new listing are in the same order, so
+// they are merged in one pass: runs of vanished rows are removed first,
+// then runs of new rows are inserted where they belong
+//
+void VisibleModel::merge(Node *node, const QStringList &dirs,
+                         const QStringList &files)
+{
+    QList<Entry> entries;
+    QSet<QString> keep;
+    foreach (const QString &name, dirs) {
+        if (!name.startsWith('.')) {
+            entries.append(Entry(name, true));
+            keep.insert("d" + name);
+        }
+    }
+    foreach (const QString &name, files) {
+        if (!name.startsWith('.')) {
+            entries.append(Entry(name, false));
+            keep.insert("f" + name);
+        }
+    }
+    qSort(entries.begin(), entries.end(), entryLess);
+
+    QModelIndex parentIndex = indexOf(node);
+    QList<Node*> &children = node->children;
+    int last = children.count() - 1;
+    while (last >= 0) {
+        Node *child = children[last];
+        if (keep.contains((child->isDir ? "d" : "f") + child->name)) {
+            --last;
+            continue;
+        }
+        int first = last;
+        while (first > 0) {
+            Node *previous = children[first - 1];
+            if (keep.contains((previous->isDir ? "d" : "f") + previous->name)) {
+                break;
+            }
+            --first;
+        }
+        beginRemoveRows(parentIndex, first, last);
+        for (int i = last; i >= first; --i) {
+            Node *orphan = children.takeAt(i);
+            node->byName.remove(orphan->name);
+            unwatch(orphan);
+            delete orphan;
+        }
+        renumber(node, first);
+        endRemoveRows();
+        last = first - 1;
+    }
+
+    int at = 0;
+    int next = 0;
+    while (next < entries.count()) {
+        if (at < children.count() && sameEntry(children[at], entries[next])) {
+            ++at;
+            ++next;
+            continue;
+        }
+        int first = next;
+        while (next < entries.count()
+               && !(at < children.count() && sameEntry(children[at], entries[next])))
+        {
+            ++next;
+        }
+        beginInsertRows(parentIndex, at, at + next - first - 1);
+        for (int i = first; i < next; ++i) {
+            Node *child = new Node(entries[i].name, entries[i].isDir, node);
+            children.insert(at + i - first, child);
+            node->byName.insert(child->name, child);
+        }
+        renumber(node, at);
+        endInsertRows();
+        at += next - first;
+    }
+}
+
+void VisibleModel::unwatch(Node *node)
+{
+    if (!node->loaded) {
+        return;
+    }
+    watcher.removePath(pathOf(node));
+    foreach (Node *child, node->children) {
+        unwatch(child);
+    }
+}
+
+void VisibleModel::renumber(Node *node, int from)
+{
+    for (int i = from, len = node->children.count(); i < len; ++i) {
+        node->children[i]->row = i;
+    }
+}
+
+// Directories first, then by name ignoring case
+bool VisibleModel::entryLess(const Entry &left, const Entry &right)
+{
+    if (left.isDir != right.isDir) {
+        return left.isDir;
+    }
+    int order = left.name.compare(right.name, Qt::CaseInsensitive);
+    if (order != 0) {
+        return order < 0;
+    }
+    return left.name < right.name;
+}
+
+bool VisibleModel::sameEntry(const Node *node, const Entry &entry)
+{
+    return node->isDir == entry.isDir && node->name == entry.name;
+}
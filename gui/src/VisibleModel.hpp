@@ -0,0 +1,113 @@
+#ifndef VISIBLEMODEL_H
+#define VISIBLEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QIcon>
+#include <QList>
+#include <QStringList>
+#include <QThread>
+
+//
+// Lists directories for VisibleModel on a thread of its own
+//
+class DirLister : public QObject {
+    Q_OBJECT
+
+public slots:
+    void list(const QString &path);
+
+signals:
+    void listed(const QString &path, const QStringList &dirs,
+                const QStringList &files);
+};
+
+//
+// The visible file system, loaded a directory at a time in the
+// background. A listed directory is only read again when it is
+// invalidated, either explicitly after hiding or unhiding something
+// in it or by the file system watcher when it changes on disk. The new
+// listing is merged into the old one, so the view sees only the rows
+// which came and went.
+//
+class VisibleModel : public QAbstractItemModel {
+    Q_OBJECT
+
+public:
+    explicit VisibleModel(QObject *parent = 0);
+    ~VisibleModel();
+
+    QModelIndex parent(const QModelIndex &index) const;
+    QModelIndex index(int row, int column,
+                      const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const;
+
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
+    QFileInfo fileInfo(const QModelIndex &index) const;
+
+    // Lists the missing ancestors of @path right away
+    QModelIndex index(const QString &path);
+
+public slots:
+    void invalidate(const QString &dirPath, bool recursive = false);
+
+signals:
+    void listRequested(const QString &path);
+
+private slots:
+    void listed(const QString &path, const QStringList &dirs,
+                const QStringList &files);
+    void directoryChanged(const QString &path);
+
+private:
+    struct Node {
+        QString name;
+        bool isDir;
+        bool requested;  // a listing has been asked for
+        bool loaded;     // children are known
+        int row;
+        Node *parent;
+        QList<Node*> children;
+        QHash<QString, Node*> byName;
+
+        Node(const QString &name, bool isDir, Node *parent)
+          : name(name), isDir(isDir), requested(false), loaded(false),
+            row(0), parent(parent) {}
+        ~Node() { qDeleteAll(children); }
+    };
+
+    struct Entry {
+        QString name;
+        bool isDir;
+        Entry(const QString &name, bool isDir) : name(name), isDir(isDir) {}
+    };
+
+    Node *root;
+    QThread listerThread;
+    DirLister *lister;
+    QFileSystemWatcher watcher;
+    QIcon dirIcon;
+    QIcon fileIcon;
+
+    Node* the(const QModelIndex &index) const;
+    QModelIndex indexOf(Node *node) const;
+    QString pathOf(Node *node) const;
+    Node* findNode(const QString &path) const;
+
+    void merge(Node *node, const QStringList &dirs, const QStringList &files);
+    void unwatch(Node *node);
+    static void renumber(Node *node, int from);
+    static bool entryLess(const Entry &left, const Entry &right);
+    static bool sameEntry(const Node *node, const Entry &entry);
+};
+
+#endif // VISIBLEMODEL_H
@@ -0,0 +1,206 @@
+#include "Bench_HiddenModel.h"
+
+#include <cmath>
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include "FakeDriver.h"
+
+void Bench_HiddenModel::initTestCase()
+{
+    large = NULL;
+    largeNodes = qgetenv("HUMBLE_BENCH_NODES").toInt();
+    if (largeNodes <= 0) {
+        largeNodes = large_size;
+    }
+    fixture = QDir::temp().absoluteFilePath(
+        QString("humble-bench-%1").arg(QCoreApplication::applicationPid()));
+
+    widePath = fixture + "/wide";
+    QVERIFY(QDir().mkpath(widePath));
+    QVERIFY(makeFiles(widePath, wide_size));
+
+    deepPath = fixture + "/deep";
+    QString level = deepPath;
+    for (int i = 0; i < deep_depth; ++i) {
+        level += "/d";
+        QVERIFY(QDir().mkpath(level));
+        QVERIFY(makeFiles(level, deep_files));
+    }
+
+    // As many directories as files in each
+    largePath = fixture + "/large";
+    int dirCount = qMax(1, (int) std::sqrt((double) largeNodes));
+    for (int i = 0; i < dirCount; ++i) {
+        QString dir = largePath + QString("/%1").arg(i);
+        QVERIFY(QDir().mkpath(dir));
+        QVERIFY(makeFiles(dir, largeNodes / dirCount));
+    }
+}
+
+void Bench_HiddenModel::cleanupTestCase()
+{
+    delete large;
+    large = NULL;
+    removeTree(fixture);
+}
+
+bool Bench_HiddenModel::makeFiles(const QString &dir, int count)
+{
+    QByteArray prefix = QFile::encodeName(dir) + "/f";
+    for (int i = 0; i < count; ++i) {
+        int fd = ::open(prefix + QByteArray::number(i), O_WRONLY | O_CREAT, 0644);
+        if (fd == -1) {
+            return false;
+        }
+        ::close(fd);
+    }
+    return true;
+}
+
+void Bench_HiddenModel::removeTree(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QFileInfo &info,
+             dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden))
+    {
+        if (info.isDir() && !info.isSymLink()) {
+            removeTree(info.absoluteFilePath());
+        }
+        else {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+    dir.rmdir(path);
+}
+
+//
+// Walks every row the way a view does, fetching as it goes. Returns the
+// number of rows seen, @strays counts the rows whose parent() is wrong.
+//
+int Bench_HiddenModel::visitAll(HiddenModel *model, const QModelIndex &parent,
+                                QList<QModelIndex> *leaves, int *strays)
+{
+    while (model->canFetchMore(parent)) {
+        model->fetchMore(parent);
+    }
+    int count = model->rowCount(parent);
+    if (count == 0 && leaves && parent.isValid()) {
+        leaves->append(parent);
+    }
+    int seen = count;
+    for (int row = 0; row < count; ++row) {
+        QModelIndex child = model->index(row, 0, parent);
+        if (model->parent(child) != parent) {
+            ++*strays;
+        }
+        seen += visitAll(model, child, leaves, strays);
+    }
+    return seen;
+}
+
+void Bench_HiddenModel::benchHideWide_data()
+{
+    QTest::addColumn<int>("roundTrip");
+    QTest::addColumn<int>("perRequest");
+
+    QTest::newRow("no latency") << 0 << 0;
+    QTest::newRow("device latency") << 20 << 1;
+}
+
+void Bench_HiddenModel::benchHideWide()
+{
+    QFETCH(int, roundTrip);
+    QFETCH(int, perRequest);
+
+    HiddenModel model(new FakeDriver(roundTrip, perRequest));
+    HiddenModel::ErrorCode err = HiddenModel::OKAY;
+    QBENCHMARK_ONCE {
+        err = model.hideFile(widePath, true);
+    }
+    QCOMPARE(err, HiddenModel::OKAY);
+}
+
+void Bench_HiddenModel::benchHideDeep()
+{
+    HiddenModel model(new FakeDriver());
+    HiddenModel::ErrorCode err = HiddenModel::OKAY;
+    QBENCHMARK_ONCE {
+        err = model.hideFile(deepPath, true);
+    }
+    QCOMPARE(err, HiddenModel::OKAY);
+}
+
+// The model is kept for the benchmarks which follow
+void Bench_HiddenModel::benchHideLarge()
+{
+    large = new HiddenModel(new FakeDriver());
+    HiddenModel::ErrorCode err = HiddenModel::OKAY;
+    QBENCHMARK_ONCE {
+        err = large->hideFile(largePath, true);
+    }
+    QCOMPARE(err, HiddenModel::OKAY);
+}
+
+void Bench_HiddenModel::benchClosestUnhiddenPath()
+{
+    QVERIFY(large != NULL);
+    QList<QModelIndex> leaves;
+    int strays = 0;
+    visitAll(large, QModelIndex(), &leaves, &strays);
+    QVERIFY(!leaves.isEmpty());
+    QString path;
+    QBENCHMARK {
+        foreach (const QModelIndex &leaf, leaves) {
+            path = large->getClosestUnhiddenPath(leaf);
+        }
+    }
+    QCOMPARE(path, fixture);
+}
+
+void Bench_HiddenModel::benchNavigation()
+{
+    QVERIFY(large != NULL);
+    int seen = 0;
+    int strays = 0;
+    QBENCHMARK {
+        seen = visitAll(large, QModelIndex(), NULL, &strays);
+    }
+    QVERIFY(seen > largeNodes);
+    QCOMPARE(strays, 0);
+}
+
+//
+// Heap growth while a tree is hidden, per node of the model. The wide
+// tree is used, so that the number does not depend on HUMBLE_BENCH_NODES.
+//
+void Bench_HiddenModel::benchMemoryPerNode()
+{
+    HiddenModel *model = new HiddenModel(new FakeDriver());
+    struct mallinfo2 before = mallinfo2();
+    HiddenModel::ErrorCode err = model->hideFile(widePath, true);
+    int strays = 0;
+    int nodes = visitAll(model, QModelIndex(), NULL, &strays);
+    struct mallinfo2 after = mallinfo2();
+    delete model;
+
+    QCOMPARE(err, HiddenModel::OKAY);
+    QVERIFY(nodes > wide_size);
+    // The fields are size_t, so the difference is taken as a double
+    double perNode = (double(after.uordblks + after.hblkhd)
+                      - double(before.uordblks + before.hblkhd)) / nodes;
+    qDebug("%.0f bytes per node over %d nodes", perNode, nodes);
+}
+
+void Bench_HiddenModel::benchUnhideAll()
+{
+    QVERIFY(large != NULL);
+    HiddenModel::ErrorCode err = HiddenModel::OKAY;
+    QBENCHMARK_ONCE {
+        err = large->unhideAll();
+    }
+    QCOMPARE(err, HiddenModel::OKAY);
+    QCOMPARE(large->rowCount(QModelIndex()), 0);
+}
@@ -0,0 +1,51 @@
+#ifndef BENCH_HIDDENMODEL_H
+#define BENCH_HIDDENMODEL_H
+
+#include <QtTest/QtTest>
+
+#include "src/HiddenModel.h"
+
+//
+// Hot paths of the model over synthetic trees, with FakeDriver in place
+// of the kernel module. The trees are real, HideWorker lists them, and
+// are made in the temporary directory once for the whole suite.
+//
+// The large tree has a million nodes unless HUMBLE_BENCH_NODES says
+// otherwise.
+//
+class Bench_HiddenModel : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchHideWide_data();
+    void benchHideWide();
+    void benchHideDeep();
+    void benchHideLarge();
+    void benchClosestUnhiddenPath();
+    void benchNavigation();
+    void benchMemoryPerNode();
+    void benchUnhideAll();
+
+private:
+    static const int wide_size = 100000;
+    static const int deep_depth = 256;
+    static const int deep_files = 8;
+    static const int large_size = 1000000;
+
+    QString fixture;
+    QString widePath;
+    QString deepPath;
+    QString largePath;
+    int largeNodes;
+
+    HiddenModel *large;
+
+    static bool makeFiles(const QString &dir, int count);
+    static void removeTree(const QString &path);
+    static int visitAll(HiddenModel *model, const QModelIndex &parent,
+                        QList<QModelIndex> *leaves, int *strays);
+};
+
+#endif // BENCH_HIDDENMODEL_H
@@ -0,0 +1,149 @@
+#include "FakeDriver.h"
+
+#include <QMutexLocker>
+
+#include <unistd.h>
+
+FakeDriver::FakeDriver(int roundTrip, int perRequest)
+  : open(false),
+    roundTrip(roundTrip),
+    perRequest(perRequest),
+    nextIno(1000)
+{
+}
+
+void FakeDriver::setLatency(int roundTrip, int perRequest)
+{
+    this->roundTrip = roundTrip;
+    this->perRequest = perRequest;
+}
+
+int FakeDriver::hiddenCount() const
+{
+    QMutexLocker locker(&lock);
+    return inoByPath.count();
+}
+
+bool FakeDriver::isHidden(const QByteArray &path) const
+{
+    QMutexLocker locker(&lock);
+    return inoByPath.contains(path);
+}
+
+Driver::OpenStatus FakeDriver::tryOpen()
+{
+    if (open) {
+        return ALREADY_OPEN;
+    }
+    open = true;
+    return OPEN;
+}
+
+void FakeDriver::wait(size_t requests) const
+{
+    long usec = roundTrip + (long) perRequest * requests;
+    if (usec > 0) {
+        usleep(usec);
+    }
+}
+
+Driver::Status FakeDriver::hideOne(const char *path, unsigned long long *ino)
+{
+    if (path[0] != '/') {
+        return INVALID_FORMAT;
+    }
+    QByteArray key(path);
+    if (inoByPath.contains(key)) {
+        return ALREADY_HIDDEN;
+    }
+    unsigned long long newIno = nextIno++;
+    inoByPath.insert(key, newIno);
+    pathByIno.insert(newIno, key);
+    if (ino) {
+        *ino = newIno;
+    }
+    return OKAY;
+}
+
+Driver::Status FakeDriver::unhideOne(unsigned long long ino)
+{
+    QByteArray path = pathByIno.take(ino);
+    if (path.isNull()) {
+        return UNKNOWN_FILE;
+    }
+    inoByPath.remove(path);
+    return OKAY;
+}
+
+Driver::Status FakeDriver::hide(const char *path, unsigned long long *ino)
+{
+    if (!open) return NOT_OPEN;
+
+    wait(1);
+    QMutexLocker locker(&lock);
+    return hideOne(path, ino);
+}
+
+Driver::Status FakeDriver::unhide(unsigned long long ino)
+{
+    if (!open) return NOT_OPEN;
+
+    wait(1);
+    QMutexLocker locker(&lock);
+    return unhideOne(ino);
+}
+
+Driver::Status FakeDriver::unhideAll()
+{
+    if (!open) return NOT_OPEN;
+
+    wait(1);
+    QMutexLocker locker(&lock);
+    inoByPath.clear();
+    pathByIno.clear();
+    return OKAY;
+}
+
+Driver::Status FakeDriver::hide(const char *const *paths, size_t count,
+                                unsigned long long *inos, Status *statuses)
+{
+    if (!open) return NOT_OPEN;
+
+    wait(count);
+    QMutexLocker locker(&lock);
+    Status first = OKAY;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned long long ino = 0;
+        Status status = hideOne(paths[i], &ino);
+        if (inos) {
+            inos[i] = ino;
+        }
+        if (statuses) {
+            statuses[i] = status;
+        }
+        if (first == OKAY) {
+            first = status;
+        }
+    }
+    return first;
+}
+
+Driver::Status FakeDriver::unhide(const unsigned long long *inos, size_t count,
+                                  Status *statuses)
+{
+    if (!open) return NOT_OPEN;
+
+    wait(count);
+    QMutexLocker locker(&lock);
+    Status first = OKAY;
+    for (size_t i = 0; i < count; ++i) {
+        Status status = unhideOne(inos[i]);
+        if (statuses) {
+            statuses[i] = status;
+        }
+        if (first == OKAY) {
+            first = status;
+        }
+    }
+    return first;
+}
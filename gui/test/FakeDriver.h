@@ -0,0 +1,55 @@
+#ifndef FAKEDRIVER_H
+#define FAKEDRIVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include "src/Driver.hpp"
+
+//
+// Keeps the hidden set in memory, so that the model can be driven
+// without the kernel module. Every call costs @roundTrip microseconds
+// and every request in it @perRequest more, to stand in for the device.
+//
+// Files are not looked at, a path gets a made-up inode number which
+// stays the same for as long as it is hidden.
+//
+class FakeDriver : public Driver {
+public:
+    FakeDriver(int roundTrip = 0, int perRequest = 0);
+
+    void setLatency(int roundTrip, int perRequest);
+    int hiddenCount() const;
+    bool isHidden(const QByteArray &path) const;
+
+    bool isOpen() const { return open; }
+    OpenStatus tryOpen();
+    void close() { open = false; }
+    void setDevice(const char *) {}
+
+    Status hide(const char *path, unsigned long long *ino);
+    Status unhide(unsigned long long ino);
+    Status unhideAll();
+
+    Status hide(const char *const *paths, size_t count,
+                unsigned long long *inos, Status *statuses);
+    Status unhide(const unsigned long long *inos, size_t count,
+                  Status *statuses);
+
+private:
+    bool open;
+    int roundTrip;
+    int perRequest;
+    unsigned long long nextIno;
+
+    mutable QMutex lock;
+    QHash<QByteArray, unsigned long long> inoByPath;
+    QHash<unsigned long long, QByteArray> pathByIno;
+
+    void wait(size_t requests) const;
+    Status hideOne(const char *path, unsigned long long *ino);
+    Status unhideOne(unsigned long long ino);
+};
+
+#endif // FAKEDRIVER_H
@@ -2,43 +2,120 @@
 
 void Test_HiddenFile::testNameAndInoInit()
 {
+    HiddenTree tree;
     QString name("Vassily Poupkine");
     quint64 ino = 314159265358LL;
-    HiddenFile subject(name, false, 0, ino);
+    HiddenFile *subject = tree.create(name, false, 0, ino);
 
-    QCOMPARE(subject.getName(), name);
-    QCOMPARE(subject.getIno(), ino);
+    QCOMPARE(subject->getName(), name);
+    QCOMPARE(subject->getIno(), ino);
 }
 
 void Test_HiddenFile::testDirInit()
 {
-    HiddenFile dir(QString(), true);
-    HiddenFile file(QString(), false);
+    HiddenTree tree;
+    HiddenFile *dir = tree.create(QString(), true);
+    HiddenFile *file = tree.create(QString(), false);
 
-    QCOMPARE(dir.isDir(), true);
-    QCOMPARE(file.isDir(), false);
+    QCOMPARE(dir->isDir(), true);
+    QCOMPARE(file->isDir(), false);
 }
 
 void Test_HiddenFile::testParentInit()
 {
-    HiddenFile parent(QString(), false);
-    HiddenFile child(QString(), false, &parent);
+    HiddenTree tree;
+    HiddenFile *parent = tree.create(QString(), false);
+    HiddenFile *child = tree.create(QString(), false, parent);
 
-    QCOMPARE(child.parent(), &parent);
+    QCOMPARE(child->parent(), parent);
 }
 
 void Test_HiddenFile::testDefaultIno()
 {
-    HiddenFile subject(QString(), false);
+    HiddenTree tree;
+    HiddenFile *subject = tree.create(QString(), false);
 
-    QVERIFY(subject.getIno() == HiddenFile::INVALID_INO);
+    QVERIFY(subject->getIno() == HiddenFile::INVALID_INO);
 }
 
 void Test_HiddenFile::testDefaultHiddenStatus()
 {
-    HiddenFile dir(QString(), true);
-    HiddenFile file(QString(), false);
+    HiddenTree tree;
+    HiddenFile *dir = tree.create(QString(), true);
+    HiddenFile *file = tree.create(QString(), false);
 
-    QCOMPARE(dir.isHidden(), false);
-    QCOMPARE(file.isHidden(), true);
+    QCOMPARE(dir->isHidden(), false);
+    QCOMPARE(file->isHidden(), true);
+}
+
+void Test_HiddenFile::testRowAfterRemoval()
+{
+    HiddenTree tree;
+    HiddenFile *parent = tree.create(QString(), true);
+    for (int i = 0; i < 6; ++i) {
+        parent->append(tree.create(QString::number(i), false, parent));
+    }
+    parent->removeAt(1);
+    parent->removeRange(2, 3);
+
+    QCOMPARE(parent->childrenCount(), 3);
+    for (int i = 0; i < parent->childrenCount(); ++i) {
+        QCOMPARE(parent->childAt(i)->row(), i);
+    }
+    QCOMPARE(parent->childAt(2)->getName(), QString("5"));
+}
+
+void Test_HiddenFile::testLookupByName()
+{
+    HiddenTree tree;
+    HiddenFile *parent = tree.create(QString(), true);
+    HiddenFile *file = tree.create("name", false, parent);
+    HiddenFile *dir = tree.create("name", true, parent);
+    parent->append(file);
+    parent->append(dir);
+
+    QCOMPARE(parent->childFileByName("name"), file);
+    QCOMPARE(parent->childDirByName("name"), dir);
+
+    parent->removeAt(file->row());
+    QVERIFY(parent->childFileByName("name") == NULL);
+    QCOMPARE(parent->childDirByName("name"), dir);
+}
+
+void Test_HiddenFile::testClearTree()
+{
+    HiddenTree tree;
+    HiddenFile *dir = tree.create("dir", true, tree.root());
+    tree.root()->append(dir);
+    for (int i = 0; i < 10000; ++i) {
+        dir->append(tree.create(QString::number(i % 100), false, dir));
+    }
+    tree.clear();
+
+    QVERIFY(tree.root() != NULL);
+    QCOMPARE(tree.root()->childrenCount(), 0);
+    QVERIFY(tree.root()->childDirByName("dir") == NULL);
+}
+
+void Test_HiddenFile::testSearchByName()
+{
+    HiddenTree tree;
+    HiddenFile *dir = tree.create("Photos", true, tree.root());
+    tree.root()->append(dir);
+    HiddenFile *first = tree.create("holiday.jpg", false, dir);
+    HiddenFile *second = tree.create("holiday.jpg", false, dir);
+    dir->append(first);
+    dir->append(tree.create("notes.txt", false, dir));
+    dir->append(second);
+
+    QVector<quint32> ids = tree.findNames("HOLI");
+    QCOMPARE(ids.count(), 1);
+    QCOMPARE(tree.firstNamed(ids.at(0))->nextNamesake()->nextNamesake(),
+             (HiddenFile*)NULL);
+    QCOMPARE(tree.findNames("ot").count(), 2);
+    QVERIFY(tree.findNames("holidays").isEmpty());
+
+    dir->removeAt(second->row());
+    QCOMPARE(tree.firstNamed(ids.at(0)), first);
+    QVERIFY(first->nextNamesake() == NULL);
 }
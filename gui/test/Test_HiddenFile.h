@@ -4,6 +4,7 @@
 #include <QtTest/QtTest>
 
 #include "src/HiddenFile.h"
+#include "src/HiddenTree.h"
 
 class Test_HiddenFile : public QObject {
     Q_OBJECT
@@ -14,6 +15,11 @@ private slots:
 
     void testDefaultIno();
     void testDefaultHiddenStatus();
+
+    void testRowAfterRemoval();
+    void testLookupByName();
+    void testClearTree();
+    void testSearchByName();
 };
 
 #endif // TEST_HIDDENFILE_H
@@ -1,8 +1,40 @@
 #include "Test_HiddenModel.h"
 
+#include "FakeDriver.h"
+
 void Test_HiddenModel::testColumnCount_root()
 {
-    HiddenModel *model = new HiddenModel();
+    HiddenModel *model = new HiddenModel(new FakeDriver());
     QCOMPARE(model->columnCount(QModelIndex()), 1);
     delete model;
 }
+
+void Test_HiddenModel::testHideFile()
+{
+    QDir temp = QDir::temp();
+    QString name = QString("humble-test-%1").arg(QCoreApplication::applicationPid());
+    QVERIFY(temp.mkpath(name + "/sub"));
+    QString dir = temp.absoluteFilePath(name);
+    QStringList files;
+    files << dir + "/a" << dir + "/b" << dir + "/sub/c";
+    foreach (const QString &path, files) {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+
+    FakeDriver *driver = new FakeDriver();
+    HiddenModel *model = new HiddenModel(driver);
+    HiddenModel::ErrorCode err = model->hideFile(dir, true);
+    int hidden = driver->hiddenCount();
+    bool dirHidden = driver->isHidden(QFile::encodeName(dir));
+    delete model;
+
+    foreach (const QString &path, files) {
+        QFile::remove(path);
+    }
+    temp.rmpath(name + "/sub");
+
+    QCOMPARE(err, HiddenModel::OKAY);
+    QCOMPARE(hidden, 5);
+    QVERIFY(dirHidden);
+}
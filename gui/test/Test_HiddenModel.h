@@ -9,6 +9,7 @@ class Test_HiddenModel : public QObject {
     Q_OBJECT
 private slots:
     void testColumnCount_root();
+    void testHideFile();
 };
 
 #endif // TEST_HIDDENMODEL_H
@@ -1,5 +1,8 @@
+#include <QCoreApplication>
+
 #include "test/Test_HiddenFile.h"
 #include "test/Test_HiddenModel.h"
+#include "test/Bench_HiddenModel.h"
 
 #define RUN(testClass)               \
 {   QObject *test = new testClass(); \
@@ -9,6 +12,10 @@
 
 int main(int argc, char *argv[])
 {
+    // The model's background jobs report through queued signals
+    QCoreApplication app(argc, argv);
+
     RUN(Test_HiddenFile);
     RUN(Test_HiddenModel);
+    RUN(Bench_HiddenModel);
 }
@@ -0,0 +1,550 @@
+#include "DriverGate.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+// Measures what the control protocol sustains: how many requests per
+// second go through device_write()/device_read() and how long each one
+// waits for its reply, for mixes of hide, unhide and clear requests at
+// a given number of clients and pipeline depth.
+//
+// The device takes a single writer, so more than one client needs it to
+// be served by humbled, pass its socket with -d then.
+//
+// Before the mixes, every kind of request is timed alone over the whole
+// file set. The kernel cannot be timed from here, so the cost is split
+// by difference: `T' only goes through the text protocol, `U' adds the
+// hash update to it, `R' adds the path lookup to `U'.
+//
+
+namespace {
+
+enum Op { HIDE, UNHIDE, CLEAR, op_count };
+const char *const op_names[op_count] = { "hide", "unhide", "clear" };
+
+struct Options {
+    const char *device;
+    std::string root;
+    size_t files;
+    size_t dirs;
+    std::vector<int> depths;
+    std::vector<int> clientCounts;
+    double seconds;
+    int weights[op_count];
+    bool breakdown;
+};
+
+long long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+std::string filePath(const Options &options, size_t i)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/d%04zu/f%010zu", i % options.dirs, i);
+    return options.root + name;
+}
+
+bool createFiles(const Options &options)
+{
+    if (mkdir(options.root.c_str(), 0755) == -1 && errno != EEXIST) {
+        perror(options.root.c_str());
+        return false;
+    }
+    for (size_t d = 0; d < options.dirs; ++d) {
+        char name[32];
+        snprintf(name, sizeof(name), "/d%04zu", d);
+        std::string dir = options.root + name;
+        if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+            perror(dir.c_str());
+            return false;
+        }
+    }
+    for (size_t i = 0; i < options.files; ++i) {
+        std::string path = filePath(options, i);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd == -1) {
+            perror(path.c_str());
+            return false;
+        }
+        ::close(fd);
+    }
+    return true;
+}
+
+bool openGate(DriverGate &gate, const char *device)
+{
+    switch (gate.tryOpen()) {
+    case DriverGate::OPEN:
+    case DriverGate::ALREADY_OPEN:
+        return true;
+    case DriverGate::BUSY:
+        fprintf(stderr, "ctlbench: %s is busy, it takes a single writer "
+                        "unless served by humbled\n", device);
+        return false;
+    case DriverGate::NOT_FOUND:
+        fprintf(stderr, "ctlbench: %s not found\n", device);
+        return false;
+    default:
+        fprintf(stderr, "ctlbench: cannot open %s\n", device);
+        return false;
+    }
+}
+
+//
+// Replies of one batch: when each arrived, what it said
+//
+struct Batch {
+    long long start;
+    size_t offset;
+    std::vector<long long> *latencies;
+    std::vector<unsigned long long> inos;
+    std::vector<DriverGate::Status> statuses;
+};
+
+void storeReply(size_t index, const char *reply, void *context)
+{
+    Batch *batch = static_cast<Batch*>(context);
+    if (batch->latencies) {
+        batch->latencies->push_back(nowNs() - batch->start);
+    }
+    index += batch->offset;
+    if (reply == NULL) {
+        batch->statuses[index] = DriverGate::INVALID_FORMAT;
+    }
+    else if (reply[0] == 'E') {
+        batch->statuses[index] = DriverGate::parseError(reply);
+    }
+    else {
+        sscanf(reply, "%llu", &batch->inos[index]);
+    }
+}
+
+// Sends the commands @depth at a time, returns false on a broken gate
+bool send(DriverGate &gate, const std::vector<std::string> &commands,
+          size_t depth, Batch *batch)
+{
+    std::vector<const char*> lines(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        lines[i] = commands[i].c_str();
+    }
+    batch->inos.assign(commands.size(), 0);
+    batch->statuses.assign(commands.size(), DriverGate::OKAY);
+    for (size_t done = 0; done < commands.size(); done += depth) {
+        size_t count = std::min(depth, commands.size() - done);
+        batch->start = nowNs();
+        batch->offset = done;
+        if (gate.execute(&lines[done], count, storeReply, batch) != DriverGate::OKAY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t failures(const Batch &batch)
+{
+    return batch.statuses.size() - std::count(batch.statuses.begin(),
+                                            batch.statuses.end(),
+                                            DriverGate::OKAY);
+}
+
+//
+// Breakdown
+//
+
+// Sends the commands, in ns per command, negative if any failed
+double timeCommands(DriverGate &gate, const std::vector<std::string> &commands,
+                    size_t depth, Batch *batch)
+{
+    long long start = nowNs();
+    if (!send(gate, commands, depth, batch) || failures(*batch) > 0) {
+        return -1;
+    }
+    return double(nowNs() - start) / commands.size();
+}
+
+std::vector<std::string> pathCommands(const Options &options, char command)
+{
+    std::vector<std::string> commands(options.files);
+    for (size_t i = 0; i < options.files; ++i) {
+        commands[i] = std::string(1, command) + " " + filePath(options, i);
+    }
+    return commands;
+}
+
+std::vector<std::string> inoCommands(const std::vector<unsigned long long> &inos)
+{
+    std::vector<std::string> commands(inos.size());
+    for (size_t i = 0; i < inos.size(); ++i) {
+        char line[32];
+        snprintf(line, sizeof(line), "U %llu", inos[i]);
+        commands[i] = line;
+    }
+    return commands;
+}
+
+void printCost(const char *command, const char *what, double ns)
+{
+    if (ns < 0) {
+        printf("  %s  %-28s %10s\n", command, what, "failed");
+    } else {
+        printf("  %s  %-28s %10.0f ns\n", command, what, ns);
+    }
+}
+
+bool breakdown(const Options &options, size_t depth)
+{
+    DriverGate gate(options.device);
+    if (!openGate(gate, options.device)) {
+        return false;
+    }
+    Batch batch;
+    batch.latencies = NULL;
+    gate.unhideAll();
+
+    std::vector<std::string> hides = pathCommands(options, 'H');
+    double hide = timeCommands(gate, hides, depth, &batch);
+    std::vector<unsigned long long> inos = batch.inos;
+    double query = timeCommands(gate, pathCommands(options, 'Q'), depth, &batch);
+    double unhide = timeCommands(gate, inoCommands(inos), depth, &batch);
+    timeCommands(gate, hides, depth, &batch);
+    double unhidePath = timeCommands(gate, pathCommands(options, 'R'), depth, &batch);
+    double protocol = timeCommands(gate, std::vector<std::string>(options.files, "T 0"),
+                                   depth, &batch);
+    gate.unhideAll();
+
+    printf("per request, %zu files, pipeline depth %zu:\n", options.files, depth);
+    printCost("H", "lookup, hash insert", hide);
+    printCost("Q", "lookup, hash search", query);
+    printCost("U", "hash remove", unhide);
+    printCost("R", "lookup, hash remove", unhidePath);
+    printCost("T", "protocol only", protocol);
+    if (protocol >= 0 && unhide >= 0 && unhidePath >= 0) {
+        printf("breakdown: protocol %.0f ns, path lookup %.0f ns, "
+               "hash update %.0f ns\n\n",
+               protocol, unhidePath - unhide, unhide - protocol);
+    } else {
+        printf("breakdown: not available through %s\n\n", options.device);
+    }
+    return hide >= 0;
+}
+
+//
+// Mixes
+//
+
+struct Client {
+    pthread_t thread;
+    const Options *options;
+    size_t depth;
+    long long deadline;
+    unsigned seed;
+
+    DriverGate *gate;
+    std::vector<std::string> paths;
+    std::vector<size_t> visible;
+    std::vector<std::pair<unsigned long long, size_t> > hidden;
+
+    std::vector<long long> latencies[op_count];
+    long requests[op_count];
+    long errors;
+    long stale;
+    bool broken;
+};
+
+Op pickOp(Client *client)
+{
+    const int *weights = client->options->weights;
+    int total = weights[HIDE] + weights[UNHIDE] + weights[CLEAR];
+    int roll = rand_r(&client->seed) % total;
+    Op op = (roll < weights[HIDE]) ? HIDE
+          : (roll < weights[HIDE] + weights[UNHIDE]) ? UNHIDE : CLEAR;
+    if (op == HIDE && client->visible.empty()) {
+        op = UNHIDE;
+    }
+    if (op == UNHIDE && client->hidden.empty()) {
+        op = HIDE;
+    }
+    return op;
+}
+
+// Moves a random element to the back and returns it
+template <typename T>
+T takeRandom(std::vector<T> &from, unsigned *seed)
+{
+    std::swap(from[rand_r(seed) % from.size()], from.back());
+    T taken = from.back();
+    from.pop_back();
+    return taken;
+}
+
+void hideSome(Client *client)
+{
+    size_t count = std::min(client->depth, client->visible.size());
+    std::vector<size_t> targets(count);
+    std::vector<std::string> commands(count);
+    for (size_t i = 0; i < count; ++i) {
+        targets[i] = takeRandom(client->visible, &client->seed);
+        commands[i] = "H " + client->paths[targets[i]];
+    }
+    Batch batch;
+    batch.latencies = &client->latencies[HIDE];
+    if (!send(*client->gate, commands, count, &batch)) {
+        client->broken = true;
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (batch.statuses[i] == DriverGate::OKAY) {
+            client->hidden.push_back(std::make_pair(batch.inos[i], targets[i]));
+        } else {
+            client->visible.push_back(targets[i]);
+            ++client->errors;
+        }
+    }
+    client->requests[HIDE] += count;
+}
+
+void unhideSome(Client *client)
+{
+    size_t count = std::min(client->depth, client->hidden.size());
+    std::vector<std::pair<unsigned long long, size_t> > targets(count);
+    std::vector<unsigned long long> inos(count);
+    for (size_t i = 0; i < count; ++i) {
+        targets[i] = takeRandom(client->hidden, &client->seed);
+        inos[i] = targets[i].first;
+    }
+    Batch batch;
+    batch.latencies = &client->latencies[UNHIDE];
+    if (!send(*client->gate, inoCommands(inos), count, &batch)) {
+        client->broken = true;
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (batch.statuses[i] == DriverGate::OKAY) {
+            client->visible.push_back(targets[i].second);
+        }
+        else if (batch.statuses[i] == DriverGate::UNKNOWN_FILE) {
+            // somebody else has cleared everything
+            client->visible.push_back(targets[i].second);
+            ++client->stale;
+        }
+        else {
+            client->hidden.push_back(targets[i]);
+            ++client->errors;
+        }
+    }
+    client->requests[UNHIDE] += count;
+}
+
+void clearAll(Client *client)
+{
+    long long start = nowNs();
+    if (client->gate->unhideAll() != DriverGate::OKAY) {
+        ++client->errors;
+    }
+    client->latencies[CLEAR].push_back(nowNs() - start);
+    for (size_t i = 0; i < client->hidden.size(); ++i) {
+        client->visible.push_back(client->hidden[i].second);
+    }
+    client->hidden.clear();
+    ++client->requests[CLEAR];
+}
+
+void *runClient(void *argument)
+{
+    Client *client = static_cast<Client*>(argument);
+    while (!client->broken && nowNs() < client->deadline) {
+        switch (pickOp(client)) {
+        case HIDE:   hideSome(client);   break;
+        case UNHIDE: unhideSome(client); break;
+        default:     clearAll(client);   break;
+        }
+    }
+    return NULL;
+}
+
+long long percentile(const std::vector<long long> &sorted, int percent)
+{
+    return sorted.empty() ? 0 : sorted[sorted.size() * percent / 100];
+}
+
+bool runMix(const Options &options, int clientCount, size_t depth)
+{
+    std::vector<Client> clients(clientCount);
+    bool okay = true;
+    for (int c = 0; c < clientCount; ++c) {
+        Client &client = clients[c];
+        client.options = &options;
+        client.depth = depth;
+        client.seed = c + 1;
+        client.errors = client.stale = 0;
+        client.broken = false;
+        std::fill(client.requests, client.requests + op_count, 0);
+        for (size_t i = c; i < options.files; i += clientCount) {
+            client.visible.push_back(client.paths.size());
+            client.paths.push_back(filePath(options, i));
+        }
+        client.gate = new DriverGate(options.device);
+        okay = okay && openGate(*client.gate, options.device);
+    }
+    if (okay) {
+        clients[0].gate->unhideAll();
+        long long start = nowNs();
+        for (int c = 0; c < clientCount; ++c) {
+            clients[c].deadline = start + (long long) (options.seconds * 1e9);
+            pthread_create(&clients[c].thread, NULL, runClient, &clients[c]);
+        }
+        for (int c = 0; c < clientCount; ++c) {
+            pthread_join(clients[c].thread, NULL);
+        }
+        double elapsed = (nowNs() - start) * 1e-9;
+        clients[0].gate->unhideAll();
+
+        printf("clients %d, pipeline depth %zu, mix %d:%d:%d, %.1f s\n",
+               clientCount, depth, options.weights[HIDE],
+               options.weights[UNHIDE], options.weights[CLEAR], elapsed);
+        printf("  %-8s %10s %11s %9s %9s %9s %9s\n", "op", "requests",
+               "ops/s", "p50 us", "p90 us", "p99 us", "max us");
+        long total = 0, errors = 0, stale = 0;
+        for (int op = 0; op < op_count; ++op) {
+            std::vector<long long> latencies;
+            long requests = 0;
+            for (int c = 0; c < clientCount; ++c) {
+                latencies.insert(latencies.end(), clients[c].latencies[op].begin(),
+                                 clients[c].latencies[op].end());
+                requests += clients[c].requests[op];
+            }
+            std::sort(latencies.begin(), latencies.end());
+            printf("  %-8s %10ld %11.0f %9.1f %9.1f %9.1f %9.1f\n",
+                   op_names[op], requests, requests / elapsed,
+                   percentile(latencies, 50) * 1e-3, percentile(latencies, 90) * 1e-3,
+                   percentile(latencies, 99) * 1e-3,
+                   (latencies.empty() ? 0 : latencies.back()) * 1e-3);
+            total += requests;
+        }
+        for (int c = 0; c < clientCount; ++c) {
+            errors += clients[c].errors;
+            stale += clients[c].stale;
+            okay = okay && !clients[c].broken;
+        }
+        printf("  %-8s %10ld %11.0f   errors %ld, cleared under others %ld\n\n",
+               "total", total, total / elapsed, errors, stale);
+    }
+    for (int c = 0; c < clientCount; ++c) {
+        delete clients[c].gate;
+    }
+    return okay;
+}
+
+std::vector<int> parseList(const char *text)
+{
+    std::vector<int> values;
+    for (const char *p = text; *p; ) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0) {
+            return std::vector<int>();
+        }
+        values.push_back(value);
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return std::vector<int>();
+        }
+    }
+    return values;
+}
+
+void usage()
+{
+    fprintf(stderr,
+            "Usage: ctlbench [-d device] [-n files] [-w directories]\n"
+            "                [-c clients,...] [-p depth,...] [-t seconds]\n"
+            "                [-m hide:unhide:clear] [-B] DIR\n");
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.device = "/dev/hcontrol";
+    options.files = 100000;
+    options.dirs = 100;
+    options.depths.push_back(1);
+    options.depths.push_back(16);
+    options.depths.push_back(256);
+    options.clientCounts.push_back(1);
+    options.seconds = 5;
+    options.weights[HIDE] = 50;
+    options.weights[UNHIDE] = 49;
+    options.weights[CLEAR] = 1;
+    options.breakdown = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:w:c:p:t:m:Bh")) != -1) {
+        switch (opt) {
+        case 'd': options.device = optarg;                break;
+        case 'n': options.files = strtoul(optarg, 0, 10); break;
+        case 'w': options.dirs = strtoul(optarg, 0, 10);  break;
+        case 'c': options.clientCounts = parseList(optarg); break;
+        case 'p': options.depths = parseList(optarg);     break;
+        case 't': options.seconds = atof(optarg);         break;
+        case 'B': options.breakdown = false;              break;
+        case 'm':
+            if (sscanf(optarg, "%d:%d:%d", &options.weights[HIDE],
+                       &options.weights[UNHIDE], &options.weights[CLEAR]) != 3)
+            {
+                options.weights[HIDE] = -1;
+            }
+            break;
+        default:
+            usage();
+            return (opt == 'h')? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1 || argv[optind][0] != '/' ||
+        options.files == 0 || options.dirs == 0 || options.dirs > 10000 ||
+        options.depths.empty() || options.clientCounts.empty() ||
+        options.seconds <= 0 || options.weights[HIDE] < 0 ||
+        options.weights[UNHIDE] < 0 || options.weights[CLEAR] < 0 ||
+        options.weights[HIDE] + options.weights[UNHIDE] + options.weights[CLEAR] == 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    options.root = argv[optind];
+
+    if (!createFiles(options)) {
+        return EXIT_FAILURE;
+    }
+    if (options.breakdown &&
+        !breakdown(options, options.depths.back()))
+    {
+        return EXIT_FAILURE;
+    }
+    for (size_t c = 0; c < options.clientCounts.size(); ++c) {
+        for (size_t d = 0; d < options.depths.size(); ++d) {
+            if (!runMix(options, options.clientCounts[c], options.depths[d])) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,318 @@
+#include "DriverGate.hpp"
+
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+//
+// Command line client of the module. Targets come as arguments or, with
+// none given, from stdin one per line (or NUL terminated with -0, to go
+// with find -print0). They are read and sent in chunks, each chunk is
+// pipelined to the driver, and its results are written out before the
+// next one is read, so a long stream is never held in memory.
+//
+// Every target gets one result record, in input order:
+//
+//   <ino> TAB <target>
+//   E TAB <status> TAB <target>
+//
+// ended with a newline, or with a NUL under -0. The exit status is 1
+// if any target failed. Targets which cannot make a request (containing
+// a newline, or not a decimal number for unhide-ino) are reported as
+// INVALID_FORMAT without being sent. If the device goes away, the chunk in flight is
+// still reported, with UNKNOWN_ERROR for what it left unanswered, and
+// the rest of the input is not read.
+//
+
+namespace {
+
+enum Mode { HIDE, UNHIDE, UNHIDE_INO, QUERY, CLEAR };
+
+struct Options {
+    const char *device;
+    Mode mode;
+    char separator;
+    size_t chunk;
+    const char *group;
+    const char *ttl;
+};
+
+struct Chunk {
+    std::vector<std::string> targets;
+    std::vector<std::string> commands;
+    std::vector<size_t> sent;
+    std::vector<DriverGate::Status> statuses;
+    std::vector<unsigned long long> inos;
+};
+
+const char* statusName(DriverGate::Status status)
+{
+    switch (status) {
+    case DriverGate::OKAY:           return "OKAY";
+    case DriverGate::NOT_OPEN:       return "NOT_OPEN";
+    case DriverGate::INVALID_FORMAT: return "INVALID_FORMAT";
+    case DriverGate::UNKNOWN_FILE:   return "UNKNOWN_FILE";
+    case DriverGate::MOUNT_POINT:    return "MOUNT_POINT";
+    case DriverGate::ALREADY_HIDDEN: return "ALREADY_HIDDEN";
+    case DriverGate::HIDDEN_PARENT:  return "HIDDEN_PARENT";
+    case DriverGate::LOST_PARENT:    return "LOST_PARENT";
+    case DriverGate::MEMORY_FAULT:   return "MEMORY_FAULT";
+    case DriverGate::BAD_DESCRIPTOR: return "BAD_DESCRIPTOR";
+    case DriverGate::STALE_HANDLE:   return "STALE_HANDLE";
+    default:                         return "UNKNOWN_ERROR";
+    }
+}
+
+void storeReply(size_t index, const char *reply, void *context)
+{
+    Chunk *chunk = static_cast<Chunk*>(context);
+    index = chunk->sent[index];
+    if (reply == NULL) {
+        chunk->statuses[index] = DriverGate::INVALID_FORMAT;
+    }
+    else if (reply[0] == 'E') {
+        chunk->statuses[index] = DriverGate::parseError(reply);
+    }
+    else {
+        chunk->statuses[index] = DriverGate::OKAY;
+        sscanf(reply, "%llu", &chunk->inos[index]);
+    }
+}
+
+// The module resolves absolute paths only
+std::string absolute(const std::string &path, const std::string &cwd)
+{
+    return (path.empty() || path[0] == '/') ? path : cwd + "/" + path;
+}
+
+// A request is a single line, replies are matched to requests by order
+bool validTarget(const Options &options, const std::string &target)
+{
+    if (target.find('\n') != std::string::npos) {
+        return false;
+    }
+    if (options.mode == UNHIDE_INO) {
+        return !target.empty() &&
+               target.find_first_not_of("0123456789") == std::string::npos;
+    }
+    return true;
+}
+
+// Empty for a target which cannot be sent
+std::string commandFor(const Options &options, const std::string &target,
+                       const std::string &cwd)
+{
+    if (!validTarget(options, target)) {
+        return std::string();
+    }
+    switch (options.mode) {
+    case HIDE:       return "H " + absolute(target, cwd);
+    case UNHIDE:     return "R " + absolute(target, cwd);
+    case QUERY:      return "Q " + absolute(target, cwd);
+    case UNHIDE_INO: return "U " + target;
+    default:         return std::string();
+    }
+}
+
+// Returns false if the gate broke, @failed counts the failed targets
+bool runChunk(DriverGate &gate, Chunk &chunk, char separator, size_t *failed)
+{
+    bool okay = true;
+    size_t count = chunk.commands.size();
+    std::vector<const char*> lines;
+    chunk.sent.clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (!chunk.commands[i].empty()) {
+            chunk.sent.push_back(i);
+            lines.push_back(chunk.commands[i].c_str());
+        }
+    }
+    chunk.statuses.assign(count, DriverGate::UNKNOWN_ERROR);
+    chunk.inos.assign(count, 0);
+    if (!lines.empty() &&
+        gate.execute(&lines[0], lines.size(), storeReply, &chunk) != DriverGate::OKAY)
+    {
+        okay = false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        DriverGate::Status status = chunk.statuses[i];
+        if (chunk.commands[i].empty()) {
+            status = DriverGate::INVALID_FORMAT;
+        }
+        // After a failure the unanswered requests got NULL replies too
+        else if (!okay && status == DriverGate::INVALID_FORMAT) {
+            status = DriverGate::UNKNOWN_ERROR;
+        }
+        if (status == DriverGate::OKAY) {
+            printf("%llu\t%s%c", chunk.inos[i], chunk.targets[i].c_str(), separator);
+        }
+        else {
+            printf("E\t%s\t%s%c", statusName(status),
+                   chunk.targets[i].c_str(), separator);
+            ++*failed;
+        }
+    }
+    fflush(stdout);
+    chunk.targets.clear();
+    chunk.commands.clear();
+    return okay;
+}
+
+// Sets the group or TTL of the following hides, see chardev.c
+bool setUp(DriverGate &gate, const Options &options)
+{
+    char command[64];
+    char reply[64];
+    if (options.group) {
+        snprintf(command, sizeof(command), "G= %s", options.group);
+        if (gate.execute(command, reply, sizeof(reply)) != DriverGate::OKAY) {
+            fprintf(stderr, "humblectl: no group %s\n", options.group);
+            return false;
+        }
+    }
+    if (options.ttl) {
+        snprintf(command, sizeof(command), "T %s", options.ttl);
+        if (gate.execute(command, reply, sizeof(reply)) != DriverGate::OKAY) {
+            fprintf(stderr, "humblectl: invalid TTL %s\n", options.ttl);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseMode(const char *name, Mode *mode)
+{
+    static const struct { const char *name; Mode mode; } modes[] = {
+        { "hide",       HIDE },
+        { "unhide",     UNHIDE },
+        { "unhide-ino", UNHIDE_INO },
+        { "query",      QUERY },
+        { "clear",      CLEAR }
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+        if (strcmp(name, modes[i].name) == 0) {
+            *mode = modes[i].mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+void usage()
+{
+    fprintf(stderr,
+            "Usage: humblectl [-d device] [-0] [-c chunk] [-g group] [-t ttl]\n"
+            "                 hide|unhide|unhide-ino|query|clear [target...]\n"
+            "Targets are paths, or inode numbers for unhide-ino. Without any\n"
+            "they are read from stdin, one per line or NUL terminated with -0.\n");
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.device = "/dev/hcontrol";
+    options.separator = '\n';
+    options.chunk = 4096;
+    options.group = NULL;
+    options.ttl = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+d:0c:g:t:h")) != -1) {
+        switch (opt) {
+        case 'd': options.device = optarg;                break;
+        case '0': options.separator = '\0';               break;
+        case 'c': options.chunk = strtoul(optarg, 0, 10); break;
+        case 'g': options.group = optarg;                 break;
+        case 't': options.ttl = optarg;                   break;
+        default:
+            usage();
+            return (opt == 'h')? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || !parseMode(argv[optind], &options.mode) ||
+        options.chunk == 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    ++optind;
+
+    DriverGate gate(options.device);
+    switch (gate.tryOpen()) {
+    case DriverGate::OPEN:
+        break;
+    case DriverGate::BUSY:
+        fprintf(stderr, "humblectl: %s is busy\n", options.device);
+        return EXIT_FAILURE;
+    case DriverGate::NOT_FOUND:
+        fprintf(stderr, "humblectl: %s not found\n", options.device);
+        return EXIT_FAILURE;
+    default:
+        fprintf(stderr, "humblectl: cannot open %s\n", options.device);
+        return EXIT_FAILURE;
+    }
+
+    if (options.mode == CLEAR) {
+        DriverGate::Status status = gate.unhideAll();
+        if (status != DriverGate::OKAY) {
+            fprintf(stderr, "humblectl: %s\n", statusName(status));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (options.mode == HIDE && !setUp(gate, options)) {
+        return EXIT_FAILURE;
+    }
+
+    char *cwdBuffer = getcwd(NULL, 0);
+    std::string cwd = cwdBuffer ? cwdBuffer : "";
+    free(cwdBuffer);
+
+    Chunk chunk;
+    size_t failed = 0;
+    bool okay = true;
+    if (optind < argc) {
+        for (int i = optind; i < argc && okay; ++i) {
+            chunk.targets.push_back(argv[i]);
+            chunk.commands.push_back(commandFor(options, argv[i], cwd));
+            if (chunk.targets.size() == options.chunk) {
+                okay = runChunk(gate, chunk, options.separator, &failed);
+            }
+        }
+    }
+    else {
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+        int delimiter = options.separator;
+        while (okay && (length = getdelim(&line, &capacity, delimiter, stdin)) != -1) {
+            if (length > 0 && line[length - 1] == delimiter) {
+                line[--length] = '\0';
+            }
+            if (length == 0) {
+                continue;
+            }
+            chunk.targets.push_back(std::string(line, length));
+            chunk.commands.push_back(commandFor(options, chunk.targets.back(), cwd));
+            if (chunk.targets.size() == options.chunk) {
+                okay = runChunk(gate, chunk, options.separator, &failed);
+            }
+        }
+        free(line);
+    }
+    if (okay) {
+        okay = runChunk(gate, chunk, options.separator, &failed);
+    }
+    if (!okay) {
+        fprintf(stderr, "humblectl: lost the connection to %s\n", options.device);
+        return EXIT_FAILURE;
+    }
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,475 @@
+#include "CommandTrace.hpp"
+#include "DriverGate.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+// Replays a command trace (see CommandTrace.hpp) against a fixture tree,
+// at the pace it was recorded or as fast as the driver goes, and tells
+// how the replay differs from the original.
+//
+// Every traced path is moved under the fixture root, which is filled
+// with empty files and directories standing in for the originals, a
+// tmpfs is the place for it. Inode numbers and group ids in the trace
+// are translated to the ones the replay gets. Commands which refer to
+// the tracing process' file descriptors cannot be replayed and are
+// skipped, as are unhides of files hidden before the trace started.
+//
+// Commands which are due at the same time go to the driver pipelined,
+// up to the first one which needs a reply from the same batch.
+//
+
+namespace {
+
+const size_t max_batch = 256;
+
+struct Replayed {
+    bool skipped;
+    std::string command;
+    long long due;        // ns since the replay started
+    long long sent;       // likewise
+    long long latency;
+    std::string reply;
+};
+
+struct Options {
+    const char *device;
+    std::string fixture;
+    double speed;         // 0 is as fast as possible
+    bool createFixture;
+};
+
+long long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void sleepUntil(long long when)
+{
+    long long left = when - nowNs();
+    if (left > 0) {
+        struct timespec ts = { (time_t) (left / 1000000000LL), (long) (left % 1000000000LL) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+bool isPathCommand(const std::string &command)
+{
+    return command.size() > 2 && command[1] == ' ' && command[2] == '/' &&
+           strchr("HRQ", command[0]) != NULL;
+}
+
+// The path a command refers to, or an empty string
+std::string pathOf(const std::string &command)
+{
+    if (isPathCommand(command)) {
+        return command.substr(2);
+    }
+    if (command.compare(0, 2, "W+") == 0) {
+        size_t space = command.find(' ', 3);
+        return (space == std::string::npos) ? std::string() : command.substr(space + 1);
+    }
+    if (command.compare(0, 3, "W- ") == 0) {
+        return command.substr(3);
+    }
+    return std::string();
+}
+
+//
+// Fixture
+//
+
+bool makeEntry(const std::string &path, bool directory)
+{
+    if (directory) {
+        if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST) {
+            perror(path.c_str());
+            return false;
+        }
+        return true;
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+        perror(path.c_str());
+        return false;
+    }
+    ::close(fd);
+    return true;
+}
+
+// Whatever has something below it is a directory, the rest are files
+bool createFixture(const Options &options, const std::vector<TraceRecord> &records)
+{
+    std::set<std::string> dirs;
+    std::set<std::string> leaves;
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::string path = pathOf(records[i].command);
+        if (path.empty()) {
+            continue;
+        }
+        if (records[i].command[0] == 'W') {
+            dirs.insert(path);
+        } else {
+            leaves.insert(path);
+        }
+        for (size_t slash = path.rfind('/'); slash != 0 && slash != std::string::npos;
+             slash = path.rfind('/', slash - 1))
+        {
+            dirs.insert(path.substr(0, slash));
+        }
+    }
+    if (!makeEntry(options.fixture, true)) {
+        return false;
+    }
+    // Sets are ordered, parents come before their children
+    for (std::set<std::string>::iterator it = dirs.begin(); it != dirs.end(); ++it) {
+        if (!makeEntry(options.fixture + *it, true)) {
+            return false;
+        }
+    }
+    for (std::set<std::string>::iterator it = leaves.begin(); it != leaves.end(); ++it) {
+        if (!dirs.count(*it) && !makeEntry(options.fixture + *it, false)) {
+            return false;
+        }
+    }
+    fprintf(stderr, "replay: fixture of %zu directories and %zu files in %s\n",
+            dirs.size(), leaves.size(), options.fixture.c_str());
+    return true;
+}
+
+//
+// Replay
+//
+
+class Replayer {
+public:
+    Replayer(const Options &options, const std::vector<TraceRecord> &records)
+      : options(options), records(records), replayed(records.size())
+    {}
+
+    bool run(DriverGate &gate);
+    void report() const;
+
+private:
+    const Options &options;
+    const std::vector<TraceRecord> &records;
+    std::vector<Replayed> replayed;
+    long long start;
+    long long elapsed;
+
+    // Traced ids to the ones of the replay
+    std::map<std::string, std::string> inos;
+    std::map<std::string, std::string> groups;
+
+    // Traced ids which the batch being built is going to produce
+    std::set<std::string> pendingInos;
+    std::set<std::string> pendingGroups;
+
+    struct BatchContext {
+        Replayer *replayer;
+        std::vector<size_t> records;
+        long long sent;
+    };
+
+    bool translate(size_t index, bool *dependsOnBatch);
+    void learn(size_t index);
+    static void storeReply(size_t index, const char *reply, void *context);
+};
+
+std::string argumentOf(const std::string &command, size_t from)
+{
+    return (command.size() > from) ? command.substr(from) : std::string();
+}
+
+//
+// Builds the replay command of a record. Fails for records which cannot
+// be replayed, sets @dependsOnBatch if it needs an id which the current
+// batch is yet to produce.
+//
+bool Replayer::translate(size_t index, bool *dependsOnBatch)
+{
+    const std::string &command = records[index].command;
+    std::string &out = replayed[index].command;
+    *dependsOnBatch = false;
+    if (command.empty()) {
+        return false;
+    }
+    std::string path = pathOf(command);
+    if (!path.empty()) {
+        size_t at = command.size() - path.size();
+        out = command.substr(0, at) + options.fixture + path;
+        return true;
+    }
+    switch (command[0]) {
+    case 'U': {
+        std::string ino = argumentOf(command, 2);
+        if (pendingInos.count(ino)) {
+            *dependsOnBatch = true;
+            return true;
+        }
+        std::map<std::string, std::string>::const_iterator it = inos.find(ino);
+        if (it == inos.end()) {
+            return false;
+        }
+        out = "U " + it->second;
+        return true;
+    }
+    case 'G': {
+        if (command.compare(0, 2, "G+") == 0) {
+            out = command;
+            return true;
+        }
+        std::string id = argumentOf(command, 3);
+        if (pendingGroups.count(id)) {
+            *dependsOnBatch = true;
+            return true;
+        }
+        std::map<std::string, std::string>::const_iterator it = groups.find(id);
+        out = command.substr(0, 3) + ((it != groups.end()) ? it->second : id);
+        return true;
+    }
+    case 'C':
+    case 'T':
+        out = command;
+        return true;
+    default:
+        // F and K name descriptors of the tracing process
+        return false;
+    }
+}
+
+// Notes the ids a traced reply is going to be replaced by
+void Replayer::learn(size_t index)
+{
+    const TraceRecord &record = records[index];
+    if (record.reply.empty() || record.reply[0] == 'E') {
+        return;
+    }
+    if (isPathCommand(record.command) && record.command[0] != 'R') {
+        pendingInos.insert(record.reply);
+    }
+    if (record.command.compare(0, 2, "G+") == 0) {
+        pendingGroups.insert(record.reply);
+    }
+}
+
+void Replayer::storeReply(size_t index, const char *reply, void *context)
+{
+    BatchContext *batch = static_cast<BatchContext*>(context);
+    Replayer *self = batch->replayer;
+    size_t i = batch->records[index];
+    Replayed &r = self->replayed[i];
+    r.sent = batch->sent - self->start;
+    r.latency = nowNs() - batch->sent;
+    r.reply = reply ? reply : "";
+
+    const TraceRecord &record = self->records[i];
+    if (reply == NULL || reply[0] == 'E' ||
+        record.reply.empty() || record.reply[0] == 'E')
+    {
+        return;
+    }
+    if (isPathCommand(record.command) && record.command[0] != 'R') {
+        self->inos[record.reply] = reply;
+    }
+    if (record.command.compare(0, 2, "G+") == 0) {
+        self->groups[record.reply] = reply;
+    }
+}
+
+bool Replayer::run(DriverGate &gate)
+{
+    start = nowNs();
+    size_t next = 0;
+    while (next < records.size()) {
+        long long due = (options.speed > 0)
+                      ? (long long) (records[next].sent / options.speed) : 0;
+        sleepUntil(start + due);
+
+        // Everything due by now, up to the first command which needs
+        // a reply from this very batch
+        size_t first = next;
+        BatchContext context;
+        context.replayer = this;
+        std::vector<const char*> lines;
+        pendingInos.clear();
+        pendingGroups.clear();
+        long long now = nowNs() - start;
+        while (next < records.size() && lines.size() < max_batch) {
+            Replayed &r = replayed[next];
+            r.due = (options.speed > 0)
+                  ? (long long) (records[next].sent / options.speed) : 0;
+            if (r.due > now && next > first) {
+                break;
+            }
+            bool dependsOnBatch;
+            r.skipped = !translate(next, &dependsOnBatch);
+            if (dependsOnBatch) {
+                break;
+            }
+            if (!r.skipped) {
+                learn(next);
+                lines.push_back(r.command.c_str());
+                context.records.push_back(next);
+            }
+            ++next;
+        }
+        if (lines.empty()) {
+            continue;
+        }
+        context.sent = nowNs();
+        if (gate.execute(&lines[0], lines.size(), storeReply, &context) != DriverGate::OKAY) {
+            fprintf(stderr, "replay: the driver has failed\n");
+            return false;
+        }
+    }
+    elapsed = nowNs() - start;
+    return true;
+}
+
+long long percentile(const std::vector<long long> &sorted, int percent)
+{
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1,
+                                                sorted.size() * percent / 100)];
+}
+
+void printRow(const char *name, std::vector<long long> values)
+{
+    std::sort(values.begin(), values.end());
+    printf("  %-22s %10.1f %10.1f %10.1f %10.1f\n", name,
+           percentile(values, 50) * 1e-3, percentile(values, 90) * 1e-3,
+           percentile(values, 99) * 1e-3,
+           (values.empty() ? 0 : values.back()) * 1e-3);
+}
+
+void Replayer::report() const
+{
+    std::vector<long long> recorded, latency, difference, lag;
+    size_t skipped = 0, diverged = 0, shown = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Replayed &r = replayed[i];
+        if (r.skipped) {
+            ++skipped;
+            continue;
+        }
+        recorded.push_back(records[i].latency);
+        latency.push_back(r.latency);
+        difference.push_back(r.latency - records[i].latency);
+        lag.push_back(std::max(0LL, r.sent - r.due));
+
+        // Inode numbers differ anyway, only success and error codes count
+        const std::string &was = records[i].reply;
+        bool wasError = !was.empty() && was[0] == 'E';
+        bool isError = !r.reply.empty() && r.reply[0] == 'E';
+        if (wasError != isError || (wasError && was != r.reply)) {
+            ++diverged;
+            if (shown++ < 10) {
+                printf("  differs: %s: %s, was %s\n", records[i].command.c_str(),
+                       r.reply.c_str(), was.c_str());
+            }
+        }
+    }
+    size_t count = records.size() - skipped;
+    double traced = records.empty() ? 0 : records.back().sent * 1e-9;
+    double replay = elapsed * 1e-9;
+
+    printf("traced:   %zu commands in %.3f s, %.0f/s\n", records.size(), traced,
+           (traced > 0) ? records.size() / traced : 0.0);
+    printf("replayed: %zu commands in %.3f s, %.0f/s, %zu skipped\n", count, replay,
+           (replay > 0) ? count / replay : 0.0, skipped);
+    printf("  %-22s %10s %10s %10s %10s\n", "us", "p50", "p90", "p99", "max");
+    printRow("traced latency", recorded);
+    printRow("replayed latency", latency);
+    printRow("replayed - traced", difference);
+    if (options.speed > 0) {
+        printRow("behind schedule", lag);
+    }
+    printf("results differing: %zu\n", diverged);
+}
+
+void usage()
+{
+    fprintf(stderr,
+            "Usage: replay [-d device] [-f fixture] [-a | -x speed] [-n] trace\n"
+            "  -a  as fast as possible instead of the traced pace\n"
+            "  -x  pace relative to the traced one\n"
+            "  -n  the fixture exists already\n");
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.device = "/dev/hcontrol";
+    options.fixture = "/tmp/humble-replay";
+    options.speed = 1;
+    options.createFixture = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:f:ax:nh")) != -1) {
+        switch (opt) {
+        case 'd': options.device = optarg;         break;
+        case 'f': options.fixture = optarg;        break;
+        case 'a': options.speed = 0;               break;
+        case 'x': options.speed = atof(optarg);    break;
+        case 'n': options.createFixture = false;   break;
+        default:
+            usage();
+            return (opt == 'h')? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1 || options.speed < 0 || options.fixture[0] != '/') {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    TraceReader reader;
+    if (!reader.open(argv[optind])) {
+        fprintf(stderr, "replay: %s is not a command trace\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    std::vector<TraceRecord> records;
+    TraceRecord record;
+    while (reader.next(&record)) {
+        records.push_back(record);
+    }
+    if (options.createFixture && !createFixture(options, records)) {
+        return EXIT_FAILURE;
+    }
+
+    DriverGate gate(options.device);
+    switch (gate.tryOpen()) {
+    case DriverGate::OPEN:
+        break;
+    case DriverGate::BUSY:
+        fprintf(stderr, "replay: %s is busy\n", options.device);
+        return EXIT_FAILURE;
+    default:
+        fprintf(stderr, "replay: cannot open %s\n", options.device);
+        return EXIT_FAILURE;
+    }
+    Replayer replayer(options, records);
+    if (!replayer.run(gate)) {
+        return EXIT_FAILURE;
+    }
+    replayer.report();
+    return EXIT_SUCCESS;
+}